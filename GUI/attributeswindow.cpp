@@ -22,9 +22,9 @@ void AttributesWindow::updateTable()
     ui->tableWidget->setRowCount(0);
     ui->tableWidget->setRowCount(element->attributes().size());
     int row = 0;
-    for (auto &&pair : element->attributes()) {
-        ui->tableWidget->setItem(row, 0, new QTableWidgetItem(QString::fromStdString(pair.first)));
-        ui->tableWidget->setItem(row, 1, new QTableWidgetItem(QString::fromStdString(pair.second)));
+    for (auto &&attr : element->attributes()) {
+        ui->tableWidget->setItem(row, 0, new QTableWidgetItem(QString::fromUtf8(attr.name.data(), attr.name.size())));
+        ui->tableWidget->setItem(row, 1, new QTableWidgetItem(QString::fromUtf8(attr.value.data(), attr.value.size())));
         row++;
     }
 }
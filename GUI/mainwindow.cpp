@@ -1,6 +1,8 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
+#include <limits>
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
@@ -51,10 +53,7 @@ void MainWindow::on_parseButton_clicked()
     auto text = ui->textEdit->toPlainText().toStdString();
     try {
         auto doc = XML::Parser::from_string(text);
-        xmlTreeModel = std::make_unique<XML::TreeModel>(doc);
-        ui->treeView->setModel(xmlTreeModel.get());
-        connect(xmlTreeModel.get(), SIGNAL(errorOccurred(QString, QString)),
-                this, SLOT(showErrorMessage(QString, QString)));
+        showDocument(doc);
     } catch(XML::SyntaxError &e) {
         showErrorMessage("Syntax Error", e.what());
     } catch(XML::DOMError &e) {
@@ -62,6 +61,14 @@ void MainWindow::on_parseButton_clicked()
     }
 }
 
+void MainWindow::showDocument(XML::DOM::Document &doc)
+{
+    xmlTreeModel = std::make_unique<XML::TreeModel>(doc);
+    ui->treeView->setModel(xmlTreeModel.get());
+    connect(xmlTreeModel.get(), SIGNAL(errorOccurred(QString, QString)),
+            this, SLOT(showErrorMessage(QString, QString)));
+}
+
 void MainWindow::on_serializeButton_clicked()
 {
     ui->textEdit->setPlainText(QString::fromStdString(xmlTreeModel->getDocument()->serialize(2)));
@@ -73,14 +80,31 @@ void MainWindow::on_actionOpen_triggered()
                                                  "XML files (*.xml *.html *.xhtml)");
     if (filePath.size() != 0) {
         currentFile = filePath;
-        QFile file(currentFile);
-        if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-            showErrorMessage("Error", "Cannot open file");
-            return;
+        try {
+            // the editor holds the text in a QString, whose size is an int
+            XML::MappedFile file(filePath.toStdString());
+            if (file.size() <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+                // line endings as a file opened with QIODevice::Text has them
+                auto text = QString::fromUtf8(file.data(), static_cast<int>(file.size()));
+                text.replace("\r\n", "\n");
+                ui->textEdit->setText(text);
+            } else {
+                // saving the empty editor must not overwrite the file
+                currentFile.clear();
+                ui->textEdit->clear();
+                showErrorMessage("Error", "File is too large to be edited, only its tree is shown");
+            }
+
+            // the tree is parsed from a mapping of the file, without a copy of the text
+            auto doc = XML::Parser::from_file(filePath.toStdString());
+            showDocument(doc);
+        } catch (XML::IOError &e) {
+            showErrorMessage("Error", e.what());
+        } catch(XML::SyntaxError &e) {
+            showErrorMessage("Syntax Error", e.what());
+        } catch(XML::DOMError &e) {
+            showErrorMessage("DOM Error", e.what());
         }
-        QString data = file.readAll();
-
-        ui->textEdit->setText(data);
     }
 }
 
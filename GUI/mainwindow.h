@@ -10,6 +10,7 @@
 #include "appendchilddialog.h"
 #include "attributeswindow.h"
 #include "Parser.hpp"
+#include "MappedFile.hpp"
 
 namespace Ui {
 class MainWindow;
@@ -60,6 +61,9 @@ private:
     QString currentFile;
 
     QAction *createSeparator();
+
+    /// Shows document in the tree view, the model takes it over
+    void showDocument(XML::DOM::Document &doc);
 };
 
 #endif // MAINWINDOW_H
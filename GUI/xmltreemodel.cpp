@@ -105,8 +105,10 @@ QVariant TreeModel::data(const QModelIndex &index, int role) const
     auto item = getItem(index);
     auto col = index.column();
 
-    if (col == 0)
-        return QVariant(QString::fromStdString(item->name()));
+    if (col == 0) {
+        auto name = item->name();
+        return QVariant(QString::fromUtf8(name.data(), name.size()));
+    }
     else if (col == 1)
         return QVariant(QString::fromStdString(item->type_name()));
     else if (col == 2) {
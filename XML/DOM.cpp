@@ -2,14 +2,35 @@
 // Created by cyborg on 12/4/17.
 //
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include "DOM.hpp"
+#include "LazyParser.hpp"
+#include "Serializer.hpp"
 
 namespace XML
 {
 namespace DOM
 {
 
-Node::~Node() = default;
+Node::~Node()
+{
+    destroy_children();
+}
+
+void NodeDeleter::operator()(Node *node) const
+{
+    if (node->allocation_size_ == 0) {
+        delete node;
+        return;
+    }
+
+    auto resource = node->resource_;
+    auto size = node->allocation_size_;
+    node->~Node();
+    resource->deallocate(node, size, alignof(std::max_align_t));
+}
 
 std::string Node::type_name()
 {
@@ -29,25 +50,191 @@ std::string Node::type_name()
     }
 }
 
-Node::Node(Type type, const std::string &name, const std::string &value)
+Node::Node(Type type, std::string_view name, std::pmr::memory_resource *resource, NameTable *names)
         : type_(type),
-          name_(name),
-          value_(value),
+          child_index_valid_(false),
+          lazy_(false),
+          indexed_(false),
+          allocation_size_(0),
+          resource_(resource ? resource : std::pmr::get_default_resource()),
+          names_(names ? names : &NameTable::shared()),
+          name_(names_->intern(name)),
           parent_node_(nullptr),
           previous_sibling_(nullptr),
-          next_sibling_(nullptr) {}
+          next_sibling_(nullptr),
+          first_child_(nullptr),
+          last_child_(nullptr),
+          child_count_(0),
+          position_(0) {}
+
+void Node::link_child(Node *new_child, Node *ref_child)
+{
+    // children still in the source go first
+    load();
+
+    auto before_new = ref_child ? ref_child->previous_sibling_ : last_child_;
+
+    new_child->parent_node_ = this;
+    new_child->previous_sibling_ = before_new;
+    new_child->next_sibling_ = ref_child;
+
+    if (before_new)
+        before_new->next_sibling_ = new_child;
+    else
+        first_child_ = new_child;
+
+    if (ref_child)
+        ref_child->previous_sibling_ = new_child;
+    else
+        last_child_ = new_child;
+
+    if (child_index_valid_ and not ref_child) {
+        new_child->position_ = child_count_;
+        child_index_->push_back(new_child);
+    } else {
+        child_index_valid_ = false;
+    }
+
+    child_count_++;
+
+    if (auto index = tag_index())
+        index->insert(new_child);
+}
+
+void Node::check_document(const Node *new_child) const
+{
+    // nodes sharing a memory resource belong to the same document, the rest is rare enough for a dynamic_cast
+    if (new_child->resource_ == resource_)
+        return;
+    auto arena = dynamic_cast<const Arena *>(new_child->resource_);
+    if (not arena)
+        return;
+
+    // this node belongs to the document of its own arena, a node created with new to the one of its ancestors
+    for (auto node = this; node; node = node->parent_node_) {
+        const Node *document = nullptr;
+        if (node->type_ == Type::DOCUMENT_NODE)
+            document = node;
+        else if (auto own = dynamic_cast<const Arena *>(node->resource_))
+            document = own->document;
+        if (document) {
+            if (document != arena->document)
+                throw DOMError("Node belongs to another document, use Document::import_node()");
+            return;
+        }
+    }
+}
+
+void Node::unlink_child(Node *old_child)
+{
+    if (auto index = tag_index())
+        index->erase(old_child);
+
+    if (old_child->previous_sibling_)
+        old_child->previous_sibling_->next_sibling_ = old_child->next_sibling_;
+    else
+        first_child_ = old_child->next_sibling_;
+
+    if (old_child->next_sibling_)
+        old_child->next_sibling_->previous_sibling_ = old_child->previous_sibling_;
+    else
+        last_child_ = old_child->previous_sibling_;
+
+    if (child_index_valid_ and old_child->position_ == child_count_ - 1)
+        child_index_->pop_back();
+    else
+        child_index_valid_ = false;
+
+    old_child->parent_node_ = nullptr;
+    old_child->previous_sibling_ = nullptr;
+    old_child->next_sibling_ = nullptr;
+    child_count_--;
+}
+
+void Node::load_lazy() const
+{
+    LazyParser::load(static_cast<Element *>(const_cast<Node *>(this)));
+}
+
+TagIndex *Node::tag_index() const
+{
+    // updating the index walks up the tree as well, so looking for the document costs no more than the update
+    if (not indexed_)
+        return nullptr;
+
+    auto root = this;
+    while (root->parent_node_)
+        root = root->parent_node_;
+    if (root->type_ != Type::DOCUMENT_NODE)
+        return nullptr;
+    return static_cast<const Document *>(root)->tag_index_.get();
+}
+
+void Node::build_child_index()
+{
+    if (not child_index_)
+        child_index_ = std::make_unique<std::vector<Node*>>();
+
+    child_index_->clear();
+    child_index_->reserve(child_count_);
+    for (auto node = first_child_; node; node = node->next_sibling_) {
+        node->position_ = child_index_->size();
+        child_index_->push_back(node);
+    }
+    child_index_valid_ = true;
+}
+
+void Node::destroy_children()
+{
+    // the index is updated once here, the children are deleted without their own children below,
+    // so their destructors return early (~Node of a document runs after the index is gone, too)
+    if (not first_child_)
+        return;
+
+    if (auto index = tag_index()) {
+        if (type_ == Type::DOCUMENT_NODE)
+            index->clear();
+        else
+            for (auto child = first_child_; child; child = child->next_sibling_)
+                index->erase(child);
+    }
+
+    NodeDeleter deleter;
+    while (first_child_) {
+        auto child = first_child_;
+
+        // move grandchildren to the end of this list, so deleting child does not recurse
+        if (child->first_child_) {
+            // child is deleted before them
+            for (auto node = child->first_child_; node; node = node->next_sibling_)
+                node->parent_node_ = this;
+            last_child_->next_sibling_ = child->first_child_;
+            child->first_child_->previous_sibling_ = last_child_;
+            last_child_ = child->last_child_;
+            child->first_child_ = nullptr;
+            child->last_child_ = nullptr;
+        }
+
+        first_child_ = child->next_sibling_;
+        deleter(child);
+    }
+    last_child_ = nullptr;
+    child_count_ = 0;
+    child_index_valid_ = false;
+}
 
 void Node::append_child(Node *new_child)
 {
-    if (new_child and not is_ancestor(new_child)) {
+    if (new_child) {
         if (new_child->type_ == Type::INVALID_NODE or new_child->type_ == Type::DOCUMENT_NODE)
             throw DOMError("Cannot append nodes of this type");
-        new_child->parent_node_ = this;
-        if (has_child_nodes()) {
-            new_child->previous_sibling_ = child_nodes_.back().get();
-            new_child->next_sibling_ = nullptr;
-        }
-        child_nodes_.emplace_back(new_child);
+        if (new_child->parent_node_)
+            throw DOMError("Node already has a parent");
+        // only a node with children can be an ancestor, which keeps appending leaves O(1)
+        if (new_child == this or (new_child->first_child_ and new_child->is_ancestor(this)))
+            throw DOMError("Cannot append an ancestor of this node");
+        check_document(new_child);
+        link_child(new_child, nullptr);
     } else {
         throw DOMError("Cannot append a null node");
     }
@@ -55,7 +242,7 @@ void Node::append_child(Node *new_child)
 
 bool Node::has_child_nodes()
 {
-    return !child_nodes_.empty();
+    return first_child() != nullptr;
 }
 
 bool Node::is_ancestor(Node *other)
@@ -63,51 +250,92 @@ bool Node::is_ancestor(Node *other)
     if (other == nullptr)
         return false;
 
-    auto curr = other->parent_node_;
-    while (curr)
+    for (auto curr = other->parent_node_; curr; curr = curr->parent_node_)
         if (curr == this)
             return true;
 
     return false;
 }
 
-std::list<Element *> Node::get_elements_by_tag_name(const std::string &tag_name)
+bool Node::precedes(Node *other)
+{
+    if (other == this)
+        return false;
+
+    size_t depth = 0;
+    size_t other_depth = 0;
+    for (auto curr = parent_node_; curr; curr = curr->parent_node_)
+        depth++;
+    for (auto curr = other->parent_node_; curr; curr = curr->parent_node_)
+        other_depth++;
+
+    auto up = this;
+    auto other_up = other;
+    for (; depth > other_depth; depth--)
+        up = up->parent_node_;
+    for (; other_depth > depth; other_depth--)
+        other_up = other_up->parent_node_;
+    // an ancestor goes before its descendants
+    if (up == other_up)
+        return up == this;
+
+    while (up->parent_node_ != other_up->parent_node_) {
+        up = up->parent_node_;
+        other_up = other_up->parent_node_;
+    }
+    return up->child_num() < other_up->child_num();
+}
+
+std::list<Element *> Node::get_elements_by_tag_name(std::string_view tag_name)
 {
     std::list<Element *> elements;
-    for (auto&& node : *this)
-        if (node->type_ == Type::ELEMENT_NODE and (node->name_ == tag_name or tag_name == "*"))
-            elements.push_back(dynamic_cast<Element *>(node));
+    bool any = tag_name == "*";
+
+    auto index = any ? nullptr : tag_index();
+    if (index) {
+        // besides the document only elements are indexed
+        if (type_ != Type::DOCUMENT_NODE)
+            index->find(tag_name, static_cast<Element *>(this), elements);
+        else if (auto indexed = index->find(tag_name))
+            elements.assign(indexed->begin(), indexed->end());
+        return elements;
+    }
+
+    // tag_name interned in the table of the last visited element, nodes of one document share it
+    NameTable *table = nullptr;
+    std::optional<Name> wanted;
+    for (auto node : pre_order(Type::ELEMENT_NODE)) {
+        if (not any and node->names_ != table) {
+            table = node->names_;
+            wanted = table->find(tag_name);
+        }
+        if (any or (wanted and node->name_ == *wanted))
+            elements.push_back(static_cast<Element *>(node));
+    }
     return elements;
 }
 
-const std::list<std::unique_ptr<Node> > &Node::siblings() const
+NodeList Node::siblings() const
 {
-    return parent_node_->child_nodes_;
+    return NodeList(parent_node_);
 }
 
 void Node::insert_before(Node *new_child, Node *ref_child)
 {
-    if (new_child and ref_child and not is_ancestor(new_child)) {
+    if (new_child and ref_child) {
         if (ref_child->parent_node_ != this)
             throw DOMError("ref_child is not a child of this node");
 
         if (new_child->type_ == Type::INVALID_NODE or new_child->type_ == Type::DOCUMENT_NODE)
             throw DOMError("Cannot append nodes of this type");
-
-        for (auto it = child_nodes_.begin(); it != child_nodes_.end(); it++) {
-            auto &node = *it;
-            if (node.get() == ref_child) {
-                auto before_new = node->previous_sibling_;
-                new_child->parent_node_ = this;
-                new_child->previous_sibling_ = before_new;
-                new_child->next_sibling_ = ref_child;
-                if (before_new)
-                    before_new->next_sibling_ = new_child;
-                node->previous_sibling_ = new_child;
-                child_nodes_.emplace(it, new_child);
-                return;
-            }
-        }
+        if (new_child->parent_node_)
+            throw DOMError("Node already has a parent");
+        // only a node with children can be an ancestor, which keeps appending leaves O(1)
+        if (new_child == this or (new_child->first_child_ and new_child->is_ancestor(this)))
+            throw DOMError("Cannot insert an ancestor of this node");
+        check_document(new_child);
+
+        link_child(new_child, ref_child);
     } else if (!new_child) {
         throw DOMError("Cannot insert a null node");
     } else {
@@ -121,45 +349,114 @@ void Node::remove_child(Node *old_child)
         if (old_child->parent_node_ != this)
             throw DOMError("old_child is not a child of this node");
 
-        for (auto it = child_nodes_.begin(); it != child_nodes_.end(); it++) {
-            auto &node = *it;
-            if (node.get() == old_child) {
-                if (old_child->previous_sibling_)
-                    old_child->previous_sibling_->next_sibling_ = old_child->next_sibling_;
-                if (old_child->next_sibling_)
-                    old_child->next_sibling_->previous_sibling_ = old_child->previous_sibling_;
-                child_nodes_.erase(it);
-                return;
-            }
-        }
+        unlink_child(old_child);
+        NodeDeleter()(old_child);
     } else {
         throw DOMError("Cannot remove a null node");
     }
 }
 
-Element::Element(const std::string &tag_name) : Node(Type::ELEMENT_NODE, tag_name, "") {}
-Text::Text(const std::string &text) : Node(Type::TEXT_NODE, "", text) { set_text_content(text); }
+void Node::append_children_of(Node *other)
+{
+    if (other == nullptr)
+        throw DOMError("Cannot move children of a null node");
+    if (type_ != Type::ELEMENT_NODE)
+        throw DOMError("Children can only be moved to an element");
+    if (other == this or other->is_ancestor(this))
+        throw DOMError("Cannot move children of an ancestor of this node");
+
+    other->load();
+    for (auto child = other->first_child_; child; child = child->next_sibling_)
+        check_document(child);
+    while (auto child = other->first_child_) {
+        other->unlink_child(child);
+        link_child(child, nullptr);
+    }
+}
+
+Element::Element(std::string_view tag_name, std::pmr::memory_resource *resource)
+        : Node(Type::ELEMENT_NODE, tag_name, resource), attributes_(resource_) {}
+
+Element::Element(std::string_view tag_name, NameTable &names, std::pmr::memory_resource *resource)
+        : Node(Type::ELEMENT_NODE, tag_name, resource, &names), attributes_(resource_) {}
+
+CharacterData::CharacterData(Type type, std::string_view value, std::pmr::memory_resource *resource)
+        : Node(type, {}, resource)
+{
+    assign(value);
+}
+
+CharacterData::~CharacterData()
+{
+    assign({});
+}
+
+CharacterData::CharacterData(CharacterData &&other) noexcept : Node(std::move(other)), value_(other.value_)
+{
+    other.value_ = {};
+}
+
+CharacterData &CharacterData::operator=(CharacterData &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    // Node::operator= keeps this nodes resource, the value has to be copied to it unless they share one
+    if (resource_ == other.resource_) {
+        assign({});
+        value_ = other.value_;
+        other.value_ = {};
+    } else {
+        assign(other.value_);
+        other.assign({});
+    }
+    Node::operator=(std::move(other));
+    return *this;
+}
+
+void CharacterData::set_text_content(std::string_view text)
+{
+    assign(text);
+}
+
+void CharacterData::assign(std::string_view value)
+{
+    std::string_view copy;
+    if (not value.empty()) {
+        auto memory = static_cast<char *>(resource_->allocate(value.size(), 1));
+        std::memcpy(memory, value.data(), value.size());
+        copy = std::string_view(memory, value.size());
+    }
+    if (not value_.empty())
+        resource_->deallocate(const_cast<char *>(value_.data()), value_.size(), 1);
+    value_ = copy;
+}
+
+Text::Text(std::string_view text, std::pmr::memory_resource *resource)
+        : CharacterData(Type::TEXT_NODE, text, resource) {}
 
 void Text::append_child(Node *new_child)
 {
     throw DOMError("Text node cannot have child nodes");
 }
 
-CDATASection::CDATASection(const std::string &text) : Node(Type::CDATA_SECTION_NODE, "", text) {}
+CDATASection::CDATASection(std::string_view text, std::pmr::memory_resource *resource)
+        : CharacterData(Type::CDATA_SECTION_NODE, text, resource) {}
 
 void CDATASection::append_child(Node *new_child)
 {
     throw DOMError("CDATASection node cannot have child nodes");
 }
 
-Comment::Comment(const std::string &text) : Node(Type::COMMENT_NODE, "", text) { set_text_content(text); }
+Comment::Comment(std::string_view text, std::pmr::memory_resource *resource)
+        : CharacterData(Type::COMMENT_NODE, {}, resource) { set_text_content(text); }
 
-void Comment::set_text_content(const std::string &text)
+void Comment::set_text_content(std::string_view text)
 {
-    if (text.find("--") != std::string::npos)
+    if (text.find("--") != std::string_view::npos)
         throw SyntaxError("Double hyphen in comments is forbidden");
 
-    value_ = text;
+    assign(text);
 }
 
 void Comment::append_child(Node *new_child)
@@ -167,7 +464,404 @@ void Comment::append_child(Node *new_child)
     throw DOMError("Comment node cannot have child nodes");
 }
 
-Document::Document() : Node(Type::DOCUMENT_NODE), root_element_(nullptr) {}
+Arena::Arena(std::pmr::memory_resource *upstream, Document *document)
+        : std::pmr::monotonic_buffer_resource(upstream), document(document) {}
+
+Document::Document(std::pmr::memory_resource *upstream)
+        : Node(Type::DOCUMENT_NODE),
+          root_element_(nullptr),
+          arena_(std::make_unique<Arena>(upstream, this)),
+          // not the arena: while parse_parallel() fragments intern into this table, this document's parser
+          // allocates nodes from the arena, which has no lock
+          name_table_(std::make_unique<NameTable>(upstream))
+{
+    names_ = name_table_.get();
+}
+
+Document::Document(NameTable &names, std::pmr::memory_resource *upstream)
+        : Node(Type::DOCUMENT_NODE),
+          root_element_(nullptr),
+          arena_(std::make_unique<Arena>(upstream, this)),
+          name_table_(std::make_unique<NameTable>(names, arena_.get()))
+{
+    names_ = name_table_.get();
+}
+
+Document::~Document()
+{
+    // nodes live in the arena, so they have to go before it
+    destroy_children();
+}
+
+std::pmr::memory_resource *Document::arena() const
+{
+    return arena_.get();
+}
+
+NameTable &Document::name_table() const
+{
+    return *name_table_;
+}
+
+void Document::adopt(Document &&other)
+{
+    // a moved-from document has nothing to adopt
+    if (&other == this or not other.arena_)
+        return;
+
+    other.destroy_children();
+    other.root_element_ = nullptr;
+    auto upstream = other.arena_->upstream_resource();
+    adopted_arenas_.push_back(std::move(other.arena_));
+    adopted_tables_.push_back(std::move(other.name_table_));
+    for (auto &arena : other.adopted_arenas_)
+        adopted_arenas_.push_back(std::move(arena));
+    for (auto &table : other.adopted_tables_)
+        adopted_tables_.push_back(std::move(table));
+    other.adopted_arenas_.clear();
+    other.adopted_tables_.clear();
+    for (auto &arena : adopted_arenas_)
+        arena->document = this;
+
+    // leave other empty but usable
+    other.arena_ = std::make_unique<Arena>(upstream, &other);
+    other.name_table_ = std::make_unique<NameTable>(upstream);
+    other.names_ = other.name_table_.get();
+}
+
+void Document::enable_tag_index()
+{
+    if (tag_index_)
+        return;
+
+    // the index is set only after the walk, so loading lazy elements doesn't index their children on its own
+    auto index = std::make_unique<TagIndex>(*this);
+    index->rebuild();
+
+    tag_index_ = std::move(index);
+    indexed_ = true;
+}
+
+void Document::disable_tag_index()
+{
+    if (not tag_index_)
+        return;
+
+    tag_index_.reset();
+    // lazy elements have no children yet, so nothing is loaded
+    Node *node = this;
+    while (node) {
+        node->indexed_ = false;
+
+        if (auto child = node->first_child_) {
+            node = child;
+            continue;
+        }
+        while (node != this and not node->next_sibling_)
+            node = node->parent_node_;
+        node = node == this ? nullptr : node->next_sibling_;
+    }
+}
+
+bool Document::has_tag_index() const
+{
+    return tag_index_ != nullptr;
+}
+
+TagIndex::TagIndex(Document &document) : document_(&document) {}
+
+void TagIndex::insert(Node *subtree)
+{
+    // loading an element indexes its children as they are linked, they are skipped here then.
+    // Nothing is marked before the walk is done, so the loads it makes don't index anything on their own
+    if (subtree->indexed_)
+        return;
+    std::vector<Element *> elements;
+    for (auto node : subtree->pre_order(Node::Type::ELEMENT_NODE))
+        elements.push_back(static_cast<Element *>(node));
+    label(subtree);
+
+    // the elements of a subtree are next to each other in every list, so each name gets one insert
+    std::stable_sort(elements.begin(), elements.end(),
+                     [](Element *a, Element *b) { return a->name() < b->name(); });
+    for (auto first = elements.begin(); first != elements.end();) {
+        auto last = std::find_if(first, elements.end(), [&](Element *e) { return e->name() != (*first)->name(); });
+        auto &list = elements_[(*first)->name()];
+        list.insert(lower_bound(list, labels_.at(*first).begin), first, last);
+        first = last;
+    }
+}
+
+void TagIndex::erase(Node *subtree)
+{
+    // elements still in the source were never indexed, so there is nothing to load
+    auto labels = labels_.find(subtree);
+    if (labels == labels_.end())
+        return;
+    auto [begin, end] = labels->second;
+
+    auto walk = [subtree](auto visit) {
+        auto node = subtree;
+        while (node) {
+            visit(node);
+            if (auto child = node->first_child_) {
+                node = child;
+                continue;
+            }
+            while (node != subtree and not node->next_sibling_)
+                node = node->parent_node_;
+            node = node == subtree ? nullptr : node->next_sibling_;
+        }
+    };
+
+    // the elements of the subtree are the ones starting between its labels in the list of every name in it
+    std::vector<std::string_view> names;
+    walk([&](Node *node) {
+        if (node->type_ == Node::Type::ELEMENT_NODE and
+            std::find(names.begin(), names.end(), node->name()) == names.end())
+            names.push_back(node->name());
+    });
+    for (auto name : names) {
+        auto bucket = elements_.find(name);
+        auto &list = bucket->second;
+        auto first = lower_bound(list, begin);
+        list.erase(first, lower_bound(list, end));
+        if (list.empty())
+            elements_.erase(bucket);
+    }
+
+    walk([&](Node *node) {
+        labels_.erase(node);
+        node->indexed_ = false;
+    });
+}
+
+void TagIndex::clear()
+{
+    elements_.clear();
+    labels_.clear();
+}
+
+const std::vector<Element *> *TagIndex::find(std::string_view tag_name) const
+{
+    auto it = elements_.find(tag_name);
+    return it == elements_.end() ? nullptr : &it->second;
+}
+
+void TagIndex::find(std::string_view tag_name, Element *subtree, std::list<Element *> &elements) const
+{
+    elements.clear();
+    auto indexed = find(tag_name);
+    if (not indexed)
+        return;
+
+    auto [begin, end] = labels_.at(subtree);
+    elements.assign(lower_bound(*indexed, begin), lower_bound(*indexed, end));
+}
+
+void TagIndex::rebuild()
+{
+    elements_.clear();
+    labels_.clear();
+    for (auto node : document_->pre_order()) {
+        if (node->type_ == Node::Type::ELEMENT_NODE)
+            elements_[node->name()].push_back(static_cast<Element *>(node));
+        node->indexed_ = true;
+    }
+    label_all();
+}
+
+TagIndex::Bound TagIndex::next(Bound bound)
+{
+    auto node = bound.node;
+    if (not bound.end)
+        return node->first_child_ ? Bound{node->first_child_, false} : Bound{node, true};
+    if (node->next_sibling_)
+        return {node->next_sibling_, false};
+    auto parent = node->parent_node_;
+    return {parent and parent->type_ != Node::Type::DOCUMENT_NODE ? parent : nullptr, true};
+}
+
+TagIndex::Bound TagIndex::previous(Bound bound)
+{
+    auto node = bound.node;
+    if (bound.end)
+        return node->last_child_ ? Bound{node->last_child_, true} : Bound{node, false};
+    if (node->previous_sibling_)
+        return {node->previous_sibling_, true};
+    auto parent = node->parent_node_;
+    return {parent and parent->type_ != Node::Type::DOCUMENT_NODE ? parent : nullptr, false};
+}
+
+uint64_t &TagIndex::label(Bound bound)
+{
+    auto &labels = labels_[bound.node];
+    return bound.end ? labels.end : labels.begin;
+}
+
+void TagIndex::label(Node *subtree)
+{
+    // spreads bounds evenly over the labels between low and high, both excluded
+    auto spread = [this](auto begin, auto end, uint64_t low, uint64_t high) {
+        auto gap = (high - low) / static_cast<uint64_t>(end - begin + 1);
+        for (auto it = begin; it != end; it++)
+            label(*it) = low += gap;
+    };
+
+    std::vector<Bound> bounds;
+    for (Bound bound{subtree, false};; bound = next(bound)) {
+        bounds.push_back(bound);
+        bound.node->indexed_ = true;
+        if (bound.node == subtree and bound.end)
+            break;
+    }
+
+    // the neighbours are the previous sibling or the parent and the next sibling or the parent
+    auto previous_bound = previous(Bound{subtree, false});
+    auto next_bound = next(Bound{subtree, true});
+    uint64_t low = previous_bound.node ? label(previous_bound) : 0;
+    uint64_t high = next_bound.node ? label(next_bound) : label_limit;
+    if (high - low > bounds.size()) {
+        spread(bounds.begin(), bounds.end(), low, high);
+        return;
+    }
+
+    // the labels from begin to end of a range of size 2^level may be taken by (2 / 1.3)^level bounds at most,
+    // so the range found holds few enough that it is searched again only after as many inserts into it
+    std::vector<Bound> preceding, following;
+    for (unsigned level = 1; (uint64_t(1) << level) <= label_limit; level++) {
+        auto size = uint64_t(1) << level;
+        auto begin = low & ~(size - 1);
+        auto end = begin + size;
+        for (; previous_bound.node and label(previous_bound) >= begin; previous_bound = previous(previous_bound))
+            preceding.push_back(previous_bound);
+        for (; next_bound.node and label(next_bound) < end; next_bound = next(next_bound))
+            following.push_back(next_bound);
+
+        auto count = preceding.size() + bounds.size() + following.size();
+        if (static_cast<double>(count + 1) > std::pow(2 / 1.3, level))
+            continue;
+
+        std::vector<Bound> range(preceding.rbegin(), preceding.rend());
+        range.insert(range.end(), bounds.begin(), bounds.end());
+        range.insert(range.end(), following.begin(), following.end());
+        // label 0 stays free, so a node can always be labeled before the first one
+        spread(range.begin(), range.end(), begin, end);
+        return;
+    }
+
+    // the new nodes are in the tree already, so they are labeled along with the others
+    label_all();
+}
+
+void TagIndex::label_all()
+{
+    Bound first{document_->first_child_, false};
+    size_t count = 0;
+    for (auto bound = first; bound.node; bound = next(bound))
+        count++;
+
+    auto gap = label_limit / (count + 1);
+    uint64_t order = 0;
+    for (auto bound = first; bound.node; bound = next(bound))
+        label(bound) = order += gap;
+}
+
+std::vector<Element *>::const_iterator TagIndex::lower_bound(const std::vector<Element *> &list, uint64_t order) const
+{
+    return std::lower_bound(list.begin(), list.end(), order,
+                            [this](Element *e, uint64_t order) { return labels_.at(e).begin < order; });
+}
+
+void TagIndex::insert_element(Element *element)
+{
+    auto &list = elements_[element->name()];
+    list.insert(lower_bound(list, labels_.at(element).begin), element);
+}
+
+void TagIndex::erase_element(Element *element)
+{
+    auto bucket = elements_.find(element->name());
+    auto &list = bucket->second;
+    list.erase(lower_bound(list, labels_.at(element).begin));
+    if (list.empty())
+        elements_.erase(bucket);
+}
+
+Node *Document::import_node(const Node *node)
+{
+    if (node == nullptr)
+        throw DOMError("Cannot import a null node");
+    if (node->type_ == Type::INVALID_NODE or node->type_ == Type::DOCUMENT_NODE)
+        throw DOMError("Cannot import nodes of this type");
+
+    auto copy = [this](const Node *source) -> Node * {
+        switch (source->type_) {
+            case Type::ELEMENT_NODE: {
+                auto element = create_element(source->name());
+                for (auto &attribute : static_cast<const Element *>(source)->attributes())
+                    element->set_attribute(attribute.name.view(), attribute.value);
+                return element;
+            }
+            case Type::TEXT_NODE:
+                return create_text_node(source->value());
+            case Type::CDATA_SECTION_NODE:
+                return create_cdata_section(source->value());
+            default:
+                return create_comment(source->value());
+        }
+    };
+
+    auto root = copy(node);
+    try {
+        // walks the source without recursion, target is the copy of source
+        auto source = node;
+        auto target = root;
+        auto child = node->first_child();
+        while (true) {
+            if (child) {
+                auto child_copy = copy(child);
+                target->link_child(child_copy, nullptr);
+                if (child->first_child()) {
+                    source = child;
+                    target = child_copy;
+                    child = child->first_child();
+                } else {
+                    child = child->next_sibling_;
+                }
+            } else if (source != node) {
+                child = source->next_sibling_;
+                source = source->parent_node_;
+                target = target->parent_node_;
+            } else {
+                return root;
+            }
+        }
+    } catch (...) {
+        NodeDeleter()(root);
+        throw;
+    }
+}
+
+Element *Document::create_element(std::string_view tag_name)
+{
+    return allocate_node<Element>(arena_.get(), tag_name, *name_table_);
+}
+
+Text *Document::create_text_node(std::string_view text)
+{
+    return allocate_node<Text>(arena_.get(), text);
+}
+
+CDATASection *Document::create_cdata_section(std::string_view text)
+{
+    return allocate_node<CDATASection>(arena_.get(), text);
+}
+
+Comment *Document::create_comment(std::string_view text)
+{
+    return allocate_node<Comment>(arena_.get(), text);
+}
 
 void Document::append_child(Node *new_child)
 {
@@ -179,115 +873,265 @@ void Document::append_child(Node *new_child)
 
     if (new_child->type() == Type::ELEMENT_NODE) {
         int root_count = 0;
-        for (auto&& node : child_nodes_)
+        for (auto node : child_nodes())
             if (node->type() == Type::ELEMENT_NODE)
                 root_count++;
         if (root_count != 0)
             throw DOMError("Document node can't have more than one root element");
-        root_element_ = dynamic_cast<Element*>(new_child);
     }
 
+    // the base call can still reject the node, the root changes only once it is linked
     Node::append_child(new_child);
+    if (new_child->type() == Type::ELEMENT_NODE)
+        root_element_ = static_cast<Element*>(new_child);
 }
 
-void Element::set_attribute(const std::string &name, const std::string &value)
+void Element::set_attribute(std::string_view name, std::string_view value)
 {
+    load();
     Lexer::validate_name(name);
-    for (auto &&ch : value)
-        if (ch == '"')
-            throw SyntaxError("Attribute value cannot have quotation marks");
-    attributes_[name] = value;
+    attributes_.set(names_->intern(name), value);
 }
 
-bool Element::has_attribute(const std::string &name)
+bool Element::has_attribute(std::string_view name)
 {
-    return attributes_.find(name) != attributes_.end();
+    return find_attribute(name).has_value();
 }
 
-std::string Element::attribute(const std::string &name)
+std::string Element::attribute(std::string_view name)
 {
-    if (has_attribute(name))
-        return attributes_[name];
-    else
-        return std::string();
+    return std::string(find_attribute(name).value_or(std::string_view()));
+}
+
+std::optional<std::string_view> Element::find_attribute(std::string_view name) const
+{
+    load();
+    // a name the table has never seen cannot be an attribute
+    auto interned = names_->find(name);
+    if (not interned)
+        return std::nullopt;
+
+    auto attr = attributes_.find(*interned);
+    if (not attr)
+        return std::nullopt;
+    return attr->value;
 }
 
-std::map<std::string, std::string> &Element::attributes()
+const AttributeList &Element::attributes() const
 {
+    load();
     return attributes_;
 }
 
-void Element::remove_attribute(const std::string &name)
+void Element::remove_attribute(std::string_view name)
+{
+    load();
+    auto interned = names_->find(name);
+    if (interned)
+        attributes_.erase(*interned);
+}
+
+AttributeList::AttributeList(std::pmr::memory_resource *resource)
+        : data_(inline_), size_(0), capacity_(inline_capacity), resource_(resource) {}
+
+AttributeList::~AttributeList()
+{
+    clear();
+}
+
+AttributeList::AttributeList(AttributeList &&other) noexcept
+        : data_(inline_), size_(0), capacity_(inline_capacity), resource_(other.resource_)
+{
+    *this = std::move(other);
+}
+
+AttributeList &AttributeList::operator=(AttributeList &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+
+    clear();
+    resource_ = other.resource_;
+    if (other.data_ == other.inline_) {
+        std::copy(other.inline_, other.inline_ + other.size_, inline_);
+    } else {
+        data_ = other.data_;
+        capacity_ = other.capacity_;
+    }
+    size_ = other.size_;
+
+    // values now belong to this list
+    other.data_ = other.inline_;
+    other.size_ = 0;
+    other.capacity_ = inline_capacity;
+    return *this;
+}
+
+const Attribute *AttributeList::find(Name name) const
+{
+    for (auto attr = begin(); attr != end(); attr++)
+        if (attr->name == name)
+            return attr;
+    return nullptr;
+}
+
+void AttributeList::set(Name name, std::string_view value)
+{
+    std::string_view copy;
+    if (not value.empty()) {
+        auto memory = static_cast<char *>(resource_->allocate(value.size(), 1));
+        std::memcpy(memory, value.data(), value.size());
+        copy = std::string_view(memory, value.size());
+    }
+
+    auto attr = const_cast<Attribute *>(find(name));
+    if (attr) {
+        if (not attr->value.empty())
+            resource_->deallocate(const_cast<char *>(attr->value.data()), attr->value.size(), 1);
+        attr->value = copy;
+        return;
+    }
+
+    if (size_ == capacity_) {
+        auto capacity = capacity_ * 2;
+        auto block = static_cast<Attribute *>(resource_->allocate(capacity * sizeof(Attribute), alignof(Attribute)));
+        std::copy(data_, data_ + size_, block);
+        if (data_ != inline_)
+            resource_->deallocate(data_, capacity_ * sizeof(Attribute), alignof(Attribute));
+        data_ = block;
+        capacity_ = capacity;
+    }
+    data_[size_++] = Attribute{name, copy};
+}
+
+bool AttributeList::erase(Name name)
 {
-    attributes_.erase(name);
+    auto attr = const_cast<Attribute *>(find(name));
+    if (not attr)
+        return false;
+
+    if (not attr->value.empty())
+        resource_->deallocate(const_cast<char *>(attr->value.data()), attr->value.size(), 1);
+    std::copy(attr + 1, data_ + size_, attr);
+    size_--;
+    return true;
+}
+
+void AttributeList::clear()
+{
+    for (auto attr = begin(); attr != end(); attr++)
+        if (not attr->value.empty())
+            resource_->deallocate(const_cast<char *>(attr->value.data()), attr->value.size(), 1);
+    if (data_ != inline_)
+        resource_->deallocate(data_, capacity_ * sizeof(Attribute), alignof(Attribute));
+    data_ = inline_;
+    size_ = 0;
+    capacity_ = inline_capacity;
 }
 
 std::string Node::serialize(size_t tab_size, size_t level)
 {
-    return std::__cxx11::string();
+    std::string out;
+    StringSink sink(out);
+    Serializer(sink, tab_size).write(*this, level);
+    return out;
 }
 
 Node *Node::child_at(size_t index)
 {
-    if (child_nodes_.size() <= index)
+    load();
+    if (child_count_ <= index)
         return nullptr;
 
-    auto it = child_nodes_.begin();
-    std::advance(it, index);
-    return it->get();
+    if (not child_index_valid_)
+        build_child_index();
+    return (*child_index_)[index];
 }
 
 size_t Node::child_num()
 {
-    size_t i = 0;
-    for (auto&& node : siblings()) {
-        if (node.get() == this)
-            return i;
-        i++;
-    }
-    return i;
+    if (not parent_node_)
+        return 0;
+
+    if (not parent_node_->child_index_valid_)
+        parent_node_->build_child_index();
+    return position_;
 }
 
 std::string Node::text_content()
 {
-    return value_;
+    return std::string(value());
 }
 
-Node::Node(Node&& other) noexcept : type_(other.type_), name_(std::move(other.name_)), value_(std::move(other.value_)),
-                                    child_nodes_(std::move(other.child_nodes_)),
-                                    parent_node_(other.parent_node_), previous_sibling_(other.previous_sibling_),
-                                    next_sibling_(other.next_sibling_)
+Node::Node(Node&& other) noexcept : type_(other.type_), child_index_valid_(false), lazy_(other.lazy_),
+                                    indexed_(other.indexed_), allocation_size_(0), resource_(other.resource_),
+                                    names_(other.names_), name_(other.name_), parent_node_(other.parent_node_),
+                                    previous_sibling_(other.previous_sibling_), next_sibling_(other.next_sibling_),
+                                    first_child_(other.first_child_), last_child_(other.last_child_),
+                                    child_count_(other.child_count_), position_(other.position_)
 {
-    for (auto&& node : child_nodes_)
+    for (auto node = first_child_; node; node = node->next_sibling_)
         node->parent_node_ = this;
 
+    other.first_child_ = nullptr;
+    other.last_child_ = nullptr;
+    other.child_count_ = 0;
+    other.child_index_valid_ = false;
     other.type_ = Type::INVALID_NODE;
+    other.lazy_ = false;
+    other.indexed_ = false;
     other.parent_node_ = nullptr;
     other.previous_sibling_ = nullptr;
     other.next_sibling_ = nullptr;
 }
 
-void Node::set_text_content(const std::string &text)
+void Node::set_text_content(std::string_view text) {}
+
+NodeList Node::child_nodes() const
+{
+    load();
+    return NodeList(this);
+}
+
+Node *Node::first_child() const
 {
-    value_ = text;
+    load();
+    return first_child_;
 }
 
-const std::list<std::unique_ptr<Node>> &Node::child_nodes() const
+Node *Node::last_child() const
 {
-    return child_nodes_;
+    load();
+    return last_child_;
 }
 
 Node& Node::operator=(Node &&other) noexcept
 {
+    destroy_children();
+
     type_ = other.type_;
-    name_ = std::move(other.name_);
-    value_ = std::move(other.value_);
-    child_nodes_ = std::move(other.child_nodes_);
+    names_ = other.names_;
+    name_ = other.name_;
     parent_node_ = other.parent_node_;
     previous_sibling_ = other.previous_sibling_;
     next_sibling_ = other.next_sibling_;
+    first_child_ = other.first_child_;
+    last_child_ = other.last_child_;
+    child_count_ = other.child_count_;
+    child_index_valid_ = false;
+    position_ = other.position_;
+    lazy_ = other.lazy_;
+    indexed_ = other.indexed_;
+    for (auto node = first_child_; node; node = node->next_sibling_)
+        node->parent_node_ = this;
 
+    other.first_child_ = nullptr;
+    other.last_child_ = nullptr;
+    other.child_count_ = 0;
+    other.child_index_valid_ = false;
     other.type_ = Type::INVALID_NODE;
+    other.lazy_ = false;
+    other.indexed_ = false;
     other.parent_node_ = nullptr;
     other.previous_sibling_ = nullptr;
     other.next_sibling_ = nullptr;
@@ -300,14 +1144,36 @@ Node::Type Node::type() const
     return type_;
 }
 
-const std::string &Node::name() const
+std::string_view Node::name() const
 {
     return name_;
 }
 
-const std::string &Node::value() const
+Name Node::name_id() const
+{
+    return name_;
+}
+
+NameTable *Node::names() const
+{
+    return names_;
+}
+
+std::string_view Node::value() const
+{
+    switch (type_) {
+    case Type::TEXT_NODE:
+    case Type::CDATA_SECTION_NODE:
+    case Type::COMMENT_NODE:
+        return static_cast<const CharacterData *>(this)->value_;
+    default:
+        return {};
+    }
+}
+
+std::pmr::memory_resource *Node::resource() const
 {
-    return value_;
+    return resource_;
 }
 
 Node *Node::parent_node() const
@@ -325,164 +1191,78 @@ Node *Node::next_sibling() const
     return next_sibling_;
 }
 
-void Node::set_name(const std::string &name)
+void Node::set_name(std::string_view name)
 {
     Lexer::validate_name(name);
-    Node::name_ = name;
-}
 
-void Node::set_value(const std::string &value)
-{
-    for (auto &&ch : value)
-        if (ch == '>' or ch == '<')
-            throw SyntaxError("Unexpected symbol in node value");
-    Node::value_ = value;
+    // the element moves to the list of its new name, its place in document order and so its label stay
+    auto index = type_ == Type::ELEMENT_NODE ? tag_index() : nullptr;
+    if (index)
+        index->erase_element(static_cast<Element *>(this));
+    Node::name_ = names_->intern(name);
+    if (index)
+        index->insert_element(static_cast<Element *>(this));
 }
 
-std::string Element::serialize(size_t tab_size, size_t level)
+void Node::set_value(std::string_view value)
 {
-    std::string out;
-    std::string tab(tab_size * level, ' ');
-    out += tab + '<' + name_;
-    for (auto &kv : attributes_)
-        out += ' ' + kv.first + "=\"" + kv.second + '"';
-    if (has_child_nodes()) {
-        out += '>';
-        if (child_nodes_.size() == 1 and child_nodes_.front()->type() == Type::TEXT_NODE) {
-            out += text_content();
-            out += "</" + name_ + ">\n";
-        } else {
-            out += '\n';
-            for (auto &node : child_nodes_)
-                out += node->serialize(tab_size, level + 1);
-            out += tab + "</" + name_ + ">\n";
-        }
-    } else {
-        out += "/>\n";
+    switch (type_) {
+    case Type::TEXT_NODE:
+    case Type::CDATA_SECTION_NODE:
+    case Type::COMMENT_NODE:
+        static_cast<CharacterData *>(this)->assign(value);
+        break;
+    default:
+        throw DOMError("Node of this type has no value");
     }
-    return out;
 }
 
 std::string Element::text_content()
 {
+    load();
     std::string buffer;
-    if (child_nodes_.size() == 1 and child_nodes_.front()->type() == Type::TEXT_NODE) {
-        buffer = child_nodes_.front()->value();
+    if (child_count_ == 1 and first_child_->type() == Type::TEXT_NODE) {
+        buffer = first_child_->value();
     } else {
-        for (auto&& node : *this)
-            if (node->type() == Type::TEXT_NODE)
-                buffer += node->value() + " ";
+        for (auto node : pre_order(Type::TEXT_NODE)) {
+            buffer += node->value();
+            buffer += ' ';
+        }
     }
     return buffer;
 }
 
-void Element::set_text_content(const std::string &text)
+void Element::set_text_content(std::string_view text)
 {
-    auto text_node = new Text;
-    text_node->set_text_content(text);
-    child_nodes_.clear();
+    auto text_node = allocate_node<Text>(allocation_size_ ? resource_ : nullptr, text);
+    load();
+    destroy_children();
     append_child(text_node);
 }
 
-Element::Element(Element &&other) noexcept : attributes_(std::move(other.attributes_)), Node(std::move(other)) {}
+Element::Element(Element &&other) noexcept
+        : Node(std::move(other)), attributes_(std::move(other.attributes_)), span_(other.span_),
+          lazy_depth_(other.lazy_depth_) {}
 
 Element &Element::operator=(Element &&other) noexcept
 {
     Node::operator=(std::move(other));
     attributes_ = std::move(other.attributes_);
+    span_ = other.span_;
+    lazy_depth_ = other.lazy_depth_;
     return *this;
 }
 
-std::string Text::serialize(size_t tab_size, size_t level)
-{
-    std::string out;
-    std::string tab(tab_size * level, ' ');
-    std::istringstream ss(value_);
-    while (ss) {
-        std::string temp;
-        std::getline(ss, temp, '\n');
-        size_t first = temp.find_first_not_of(" \t\n\r");
-        if (first == std::string::npos)
-            continue;
-        temp = temp.substr(first, temp.size());
-        if (!temp.empty())
-            out += tab + temp + "\n";
-    }
-    return out;
-}
-
-void Text::set_text_content(const std::string &text)
-{
-    for (auto &&ch : text)
-        if (ch == '>' or ch == '<')
-            throw SyntaxError("Unexpected symbol in text content");
-    Node::set_text_content(text);
-}
-
 void Text::insert_before(Node *new_child, Node *ref_child)
 {
     throw DOMError("Text node cannot have child nodes");
 }
 
-std::string Comment::serialize(size_t tab_size, size_t level)
-{
-    std::string out;
-    std::string tab(tab_size * level, ' ');
-    out += tab + "<!--";
-    std::istringstream ss(value_);
-    std::string temp;
-    std::getline(ss, temp, '\n');
-    size_t first = temp.find_first_not_of(" \t\n\r");
-    if (first != std::string::npos)
-        out += temp.substr(first, temp.size());
-    while (ss) {
-        std::string temp;
-        std::getline(ss, temp, '\n');
-        size_t first = temp.find_first_not_of(" \t\n\r");
-        if (first == std::string::npos)
-            continue;
-        temp = temp.substr(first, temp.size());
-        if (!temp.empty()) {
-            out += '\n';
-            out += tab + temp;
-        }
-    }
-    out += "-->\n";
-    return out;
-}
-
 void Comment::insert_before(Node *new_child, Node *ref_child)
 {
     throw DOMError("Comment node cannot have child nodes");
 }
 
-std::string CDATASection::serialize(size_t tab_size, size_t level)
-{
-    std::string out;
-    std::string tab(tab_size * level, ' ');
-    out += tab + "<![CDATA[";
-    std::istringstream ss(value_);
-    std::string temp;
-    std::getline(ss, temp, '\n');
-    size_t first = temp.find_first_not_of(" \t\n\r");
-    if (first != std::string::npos)
-        out += temp.substr(first, temp.size());
-    while (ss) {
-        std::string temp;
-        std::getline(ss, temp, '\n');
-        size_t first = temp.find_first_not_of(" \t\n\r");
-        if (first == std::string::npos)
-            continue;
-        temp = temp.substr(first, temp.size());
-        if (!temp.empty()) {
-            out += '\n';
-            out += tab + temp;
-        }
-    }
-    out += "]]>\n";
-    return out;
-}
-
 void CDATASection::insert_before(Node *new_child, Node *ref_child)
 {
     throw DOMError("CDATA Section node cannot have child nodes");
@@ -492,26 +1272,54 @@ void CDATASection::insert_before(Node *new_child, Node *ref_child)
 std::string Document::serialize(size_t tab_size)
 {
     std::string out;
-    if (!xml_prolog_.empty())
-        out += xml_prolog_ + "\n";
-    if (!doctype_.empty())
-        out += doctype_ + "\n";
-    for (auto&& child : child_nodes_)
-        out += child->serialize(tab_size, 0);
+    StringSink sink(out);
+    Serializer(sink, tab_size).write(*this);
     return out;
 }
 
-Document::Document(Document &&other) noexcept : xml_prolog_(std::move(other.xml_prolog_)),
+Document::Document(Document &&other) noexcept : Node(std::move(other)),
+                                                xml_prolog_(std::move(other.xml_prolog_)),
                                                 doctype_(std::move(other.doctype_)),
-                                                Node(std::move(other)) {}
+                                                root_element_(other.root_element_),
+                                                arena_(std::move(other.arena_)),
+                                                name_table_(std::move(other.name_table_)),
+                                                adopted_arenas_(std::move(other.adopted_arenas_)),
+                                                adopted_tables_(std::move(other.adopted_tables_)),
+                                                tag_index_(std::move(other.tag_index_))
+{
+    if (tag_index_)
+        tag_index_->document_ = this;
+    if (arena_)
+        arena_->document = this;
+    for (auto &arena : adopted_arenas_)
+        arena->document = this;
+    other.root_element_ = nullptr;
+    other.names_ = &NameTable::shared();
+}
 
 Document &Document::operator=(Document &&other) noexcept
 {
+    // release current nodes while their arena is still alive
+    destroy_children();
+    disable_tag_index();
     Node::operator=(std::move(other));
     xml_prolog_ = std::move(other.xml_prolog_);
     doctype_ = std::move(other.doctype_);
     root_element_ = other.root_element_;
     other.root_element_ = nullptr;
+    // the old tables live in the old arenas
+    name_table_ = std::move(other.name_table_);
+    adopted_tables_ = std::move(other.adopted_tables_);
+    arena_ = std::move(other.arena_);
+    adopted_arenas_ = std::move(other.adopted_arenas_);
+    tag_index_ = std::move(other.tag_index_);
+    if (tag_index_)
+        tag_index_->document_ = this;
+    if (arena_)
+        arena_->document = this;
+    for (auto &arena : adopted_arenas_)
+        arena->document = this;
+    other.names_ = &NameTable::shared();
     return *this;
 }
 
@@ -520,7 +1328,7 @@ const std::string &Document::xml_prolog() const
     return xml_prolog_;
 }
 
-void Document::set_xml_prolog(const std::string &xml_prolog)
+void Document::set_xml_prolog(std::string_view xml_prolog)
 {
     Document::xml_prolog_ = xml_prolog;
 }
@@ -530,7 +1338,7 @@ const std::string &Document::doctype() const
     return doctype_;
 }
 
-void Document::set_doctype(const std::string &doctype)
+void Document::set_doctype(std::string_view doctype)
 {
     Document::doctype_ = doctype;
 }
@@ -550,15 +1358,17 @@ void Document::insert_before(Node *new_child, Node *ref_child)
 
     if (new_child->type() == Type::ELEMENT_NODE) {
         int root_count = 0;
-        for (auto&& node : child_nodes_)
+        for (auto node : child_nodes())
             if (node->type() == Type::ELEMENT_NODE)
                 root_count++;
         if (root_count != 0)
             throw DOMError("Document node can't have more than one root element");
-        root_element_ = dynamic_cast<Element*>(new_child);
     }
 
+    // the base call can still reject the node, the root changes only once it is linked
     Node::insert_before(new_child, ref_child);
+    if (new_child->type() == Type::ELEMENT_NODE)
+        root_element_ = static_cast<Element*>(new_child);
 }
 
 }
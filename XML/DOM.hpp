@@ -5,21 +5,115 @@
 #ifndef XML_DOM_HPP
 #define XML_DOM_HPP
 
+#include <cstdint>
 #include <memory>
+#include <memory_resource>
 #include <list>
-#include <map>
-#include <stack>
-#include <sstream>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include "Errors.hpp"
 #include "Lexer.hpp"
+#include "NameTable.hpp"
 
 namespace XML
 {
+
+class LazyParser;
+
 namespace DOM
 {
 
+class Node;
+class NodeList;
+class Element;
+class Document;
+class TagIndex;
+template<class T> class PreOrderIterator;
+template<class T> class PostOrderIterator;
+template<class Iterator> class FilteredIterator;
+template<class Iterator> class NodeRange;
+
+/// Deletes nodes created with new as well as nodes allocated from a memory resource (see Document::create_element)
+struct NodeDeleter
+{
+    void operator()(Node *node) const;
+};
+
+/// Attribute of an element. The value is owned by the AttributeList it belongs to
+struct Attribute
+{
+    Name name;
+    std::string_view value;
+};
+
+/// Attributes of an element in source order. The first few live inline in the element, the rest in one
+/// contiguous block, and lookups are linear scans comparing interned names
+class AttributeList
+{
+public:
+    static constexpr size_t inline_capacity = 2;
+
+    using iterator = const Attribute*;
+
+    /// AttributeList constructor
+    /// \param resource Memory resource for values and the spilled block
+    explicit AttributeList(std::pmr::memory_resource *resource);
+
+    ~AttributeList();
+
+    AttributeList(const AttributeList&) = delete;
+    AttributeList& operator=(const AttributeList&) = delete;
+
+    /// Move constructor
+    /// \param other List to move
+    AttributeList(AttributeList&& other) noexcept;
+
+    /// Move operator=
+    /// \param other List to move
+    /// \return Ref to *this
+    AttributeList& operator=(AttributeList&& other) noexcept;
+
+    iterator begin() const { return data_; }
+    iterator end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    /// Returns attribute by interned name
+    /// \param name Name of the attribute
+    /// \return Pointer to attribute or nullptr if there is none
+    const Attribute *find(Name name) const;
+
+    /// Replaces value of attribute or appends a new one
+    /// \param name Name of the attribute
+    /// \param value Value, copied to the memory resource
+    void set(Name name, std::string_view value);
+
+    /// Removes attribute keeping the order of the rest
+    /// \param name Name of the attribute
+    /// \return True if there was such attribute
+    bool erase(Name name);
+
+    /// Removes all attributes
+    void clear();
+
+private:
+    Attribute *data_;
+    uint32_t size_;
+    uint32_t capacity_;
+    std::pmr::memory_resource *resource_;
+    Attribute inline_[inline_capacity];
+};
+
 class Node
 {
+    friend struct NodeDeleter;
+    friend class NodeList;
+    friend class XML::LazyParser;
+    friend class TagIndex;
+    friend class Document;
+
 public:
     virtual ~Node() = 0;
 
@@ -32,7 +126,7 @@ public:
     /// \return Ref to *this
     Node& operator=(Node&& other) noexcept;
 
-    enum class Type
+    enum class Type : uint8_t
     {
         INVALID_NODE,
         ELEMENT_NODE,
@@ -45,19 +139,27 @@ public:
     /// Node constructor
     /// \param type Node type
     /// \param name Node name
-    /// \param value Node value
-    explicit Node(Type type = Type::INVALID_NODE, const std::string &name = "", const std::string &value = "");
+    /// \param resource Memory resource for strings and child list (default resource if nullptr)
+    /// \param names Table the name is interned in (NameTable::shared() if nullptr)
+    explicit Node(Type type = Type::INVALID_NODE, std::string_view name = {},
+                  std::pmr::memory_resource *resource = nullptr, NameTable *names = nullptr);
 
-    /// Append a child to this node
+    /// Append a child to this node. Nodes allocated from the arena of another document are rejected with DOMError,
+    /// they are freed with that document (see Document::import_node())
     /// \param new_child Child to append
     virtual void append_child(Node *new_child);
 
-    /// Insert a child before ref_child
+    /// Insert a child before ref_child. Nodes of another documents arena are rejected like by append_child()
     /// \param new_child Child to insert
     /// \param ref_child Insert before this child
     virtual void insert_before(Node *new_child, Node *ref_child);
 
-    /// Remove a child of this node
+    /// Move all children of other to the end of this nodes children. Children of another documents arena are
+    /// rejected like by append_child(), before any child is moved
+    /// \param other Node whose children are moved
+    void append_children_of(Node *other);
+
+    /// Remove a child of this node and delete it
     /// \param old_child Pointer to child
     void remove_child(Node *old_child);
 
@@ -70,23 +172,31 @@ public:
     /// \return True if this is an ancestor of other node
     bool is_ancestor(Node *other);
 
-    /// Search descendant elements by tag name
+    /// Check whether this node comes before other node in document order (an ancestor comes before its descendants)
+    /// \param other Pointer to node in the same tree
+    /// \return True if this node precedes other node
+    bool precedes(Node *other);
+
+    /// Search descendant elements by tag name (this node included). With a tag index (see Document::enable_tag_index())
+    /// the document copies its matches without a walk and elements binary search them by order label, both in
+    /// O(log n + matches) however the tree was changed before
     /// \param tag_name Tag name (Wildcard "*" to get every single element)
     /// \return List of elements
-    std::list<class Element*> get_elements_by_tag_name(const std::string &tag_name);
+    std::list<class Element*> get_elements_by_tag_name(std::string_view tag_name);
 
-    /// Serialize this node and descendants
+    /// Serialize this node and descendants (see Serializer to write to a stream or file instead)
     /// \param tab_size Size of one tab in spaces
     /// \param level Current level of indent
     /// \return String representation of this node and descendants
     virtual std::string serialize(size_t tab_size, size_t level);
 
-    /// Returns pointer to child by index
+    /// Returns pointer to child by index. O(1) after the first call since the last mutation
     /// \param index Index
     /// \return Pointer to child
     Node* child_at(size_t index);
 
-    /// Returns this nodes position in the list of siblings (i.e. 0 if it's the parents first child)
+    /// Returns this nodes position in the list of siblings (i.e. 0 if it's the parents first child).
+    /// O(1) after the first call since the last mutation of the parent
     /// \return Position
     size_t child_num();
 
@@ -106,19 +216,39 @@ public:
 
     /// Returns this nodes name
     /// \return Node name
-    const std::string &name() const;
+    std::string_view name() const;
+
+    /// Returns this nodes interned name, equal to other names from the same table only if they are the same string
+    /// \return Interned name
+    Name name_id() const;
+
+    /// Returns table this nodes name and attribute names are interned in
+    /// \return Name table
+    NameTable *names() const;
 
     /// Returns this nodes value
-    /// \return Node value
-    const std::string &value() const;
+    /// \return Node value (empty for elements and documents)
+    std::string_view value() const;
+
+    /// Returns memory resource used for this nodes strings and children
+    /// \return Memory resource
+    std::pmr::memory_resource *resource() const;
 
     /// Returns a list of this nodes children
     /// \return List of children
-    const std::list<std::unique_ptr<Node>> &child_nodes() const;
+    NodeList child_nodes() const;
 
     /// Returns a list of this nodes siblings (including itself)
     /// \return List of sibling
-    const std::list<std::unique_ptr<Node>> &siblings() const;
+    NodeList siblings() const;
+
+    /// Returns a pointer to nodes first child
+    /// \return Pointer to first child
+    Node *first_child() const;
+
+    /// Returns a pointer to nodes last child
+    /// \return Pointer to last child
+    Node *last_child() const;
 
     /// Returns a pointer to nodes parent
     /// \return Pointer to parent
@@ -136,73 +266,456 @@ public:
 
     /// Sets text content of this node
     /// \param text New text content
-    virtual void set_text_content(const std::string& text);
+    virtual void set_text_content(std::string_view text);
 
     /// Sets nodes name
     /// \param name New node name
-    void set_name(const std::string &name);
+    void set_name(std::string_view name);
+
+    /// Sets nodes value, throws DOMError if this is not a text, CDATA section or comment node
+    /// \param value New node value, unescaped (Serializer escapes text)
+    void set_value(std::string_view value);
+
+    using iterator = PreOrderIterator<Node>;
+    using const_iterator = PreOrderIterator<const Node>;
+
+    /// Pre-order (tree order) iterator to this node
+    /// \return Begin iterator
+    iterator begin();
+    const_iterator begin() const;
+
+    /// Pre-order (tree order) iterator past the last descendant
+    /// \return End iterator
+    iterator end();
+    const_iterator end() const;
+
+    /// Walks this node and its descendants in tree order (see PreOrderIterator)
+    /// \return Range of nodes
+    NodeRange<PreOrderIterator<Node>> pre_order();
+    NodeRange<PreOrderIterator<const Node>> pre_order() const;
+
+    /// Walks nodes of one type (and name) among this node and its descendants in tree order
+    /// \param type Node type
+    /// \param name Node name, any name if empty
+    /// \return Range of nodes
+    NodeRange<FilteredIterator<PreOrderIterator<Node>>> pre_order(Type type, std::string_view name = {});
+    NodeRange<FilteredIterator<PreOrderIterator<const Node>>> pre_order(Type type, std::string_view name = {}) const;
+
+    /// Walks descendants of this node and then this node, children before their parent (see PostOrderIterator)
+    /// \return Range of nodes
+    NodeRange<PostOrderIterator<Node>> post_order();
+    NodeRange<PostOrderIterator<const Node>> post_order() const;
+
+protected:
+    /// Links new_child into the child list before ref_child (at the end if ref_child is nullptr)
+    /// \param new_child Child to link
+    /// \param ref_child Next sibling of new_child
+    void link_child(Node *new_child, Node *ref_child);
+
+    /// Throws DOMError if new_child is allocated from the arena of another document than the one this node belongs to
+    /// \param new_child Child to link
+    void check_document(const Node *new_child) const;
+
+    /// Unlinks old_child from the child list without deleting it
+    /// \param old_child Child to unlink
+    void unlink_child(Node *old_child);
+
+    /// Deletes all descendants, iteratively so deep trees cannot overflow the stack
+    void destroy_children();
+
+    /// Makes child_index_ list children in order and updates their positions
+    void build_child_index();
 
-    /// Sets nodes value
-    /// \param value New node value
-    void set_value(const std::string &value);
+    /// Parses children and attributes of an element left unparsed by Parser::parse_lazy().
+    /// Loading doesn't change what the node represents, so const accessors call it too
+    void load() const
+    {
+        if (lazy_)
+            load_lazy();
+    }
+
+    void load_lazy() const;
+
+    /// Returns tag index of the document this node is attached to. Only nodes the index holds look for
+    /// the document, other nodes get nullptr without walking up the tree
+    /// \return Pointer to tag index or nullptr if the node is detached or the document has none
+    TagIndex *tag_index() const;
+
+    /// Allocates a node from resource, or with new if resource is nullptr.
+    /// Such nodes are released by NodeDeleter when removed from their parent
+    /// \param resource Memory resource
+    /// \param args Node constructor arguments (without the memory resource)
+    /// \return Pointer to new node
+    template<class T, class... Args>
+    static T *allocate_node(std::pmr::memory_resource *resource, Args&&... args)
+    {
+        if (not resource)
+            return new T(std::forward<Args>(args)...);
+
+        auto memory = resource->allocate(sizeof(T), alignof(std::max_align_t));
+        T *node;
+        try {
+            node = new (memory) T(std::forward<Args>(args)..., resource);
+        } catch (...) {
+            resource->deallocate(memory, sizeof(T), alignof(std::max_align_t));
+            throw;
+        }
+        node->allocation_size_ = sizeof(T);
+        return node;
+    }
+
+    // type, flags and allocation size share the first word
+    Type type_;
+    bool child_index_valid_;
+    // children and attributes are still in the source (see Element::span_)
+    bool lazy_;
+    // the document or an element in the tag index of the document it is attached to
+    bool indexed_;
+    // size of this node if it was allocated from resource_, 0 if it was created with new
+    uint32_t allocation_size_;
+    std::pmr::memory_resource *resource_;
+    NameTable *names_;
+    Name name_;
+    Node* parent_node_;
+    Node* previous_sibling_;
+    Node* next_sibling_;
+    Node* first_child_;
+    Node* last_child_;
+    // children by position, built on demand by child_at() and child_num(),
+    // kept up to date by appends and removals of the last child, dropped by other mutations
+    std::unique_ptr<std::vector<Node*>> child_index_;
+    // 32 bits share a word, a node with more children would not fit in memory anyway
+    uint32_t child_count_;
+    // position among siblings, valid while parents child index is
+    uint32_t position_;
+};
 
-    // pre-order (tree order) iterator
+/// Lightweight view of a nodes children, walks the intrusive sibling list
+class NodeList
+{
+public:
     class iterator
     {
-        Node* node;
-        std::stack<Node*> stack;
+        Node *node;
+        const Node *parent;
     public:
-        using difference_type = size_t;
+        using difference_type = std::ptrdiff_t;
         using value_type = Node*;
-        using pointer = Node**;
-        using reference = Node*&;
-        using iterator_category = std::forward_iterator_tag;
-
-        explicit iterator(Node* node) : node(node) { stack.push(node); }
-        iterator& operator++()
-        {
-            if (stack.empty()) {
-                node = nullptr;
-            } else {
-                node = stack.top();
-                stack.pop();
-                auto &children = node->child_nodes_;
-                for (auto it = children.rbegin(); it != children.rend(); it++)
-                    stack.push(it->get());
-            }
+        using pointer = Node* const*;
+        using reference = Node*;
+        // operator* returns the pointer by value, which only input iterators may do. It still goes both ways
+        using iterator_category = std::input_iterator_tag;
+
+        iterator(Node *node, const Node *parent) : node(node), parent(parent) {}
+        iterator& operator++() { node = node->next_sibling(); return *this; }
+        iterator& operator--() { node = node ? node->previous_sibling() : parent->last_child(); return *this; }
+        iterator operator++(int) { iterator retval = *this; ++(*this); return retval; }
+        iterator operator--(int) { iterator retval = *this; --(*this); return retval; }
+        bool operator==(iterator other) const { return node == other.node; }
+        bool operator!=(iterator other) const { return !(*this == other); }
+        reference operator*() const { return node; }
+    };
+
+    /// NodeList constructor
+    /// \param parent Node whose children are listed
+    explicit NodeList(const Node *parent) : parent(parent) {}
+
+    iterator begin() const { return iterator(parent ? parent->first_child() : nullptr, parent); }
+    iterator end() const { return iterator(nullptr, parent); }
+
+    /// Returns number of children, O(1)
+    /// \return Number of children
+    size_t size() const { return parent ? parent->child_count_ : 0; }
+
+    /// Check whether list is empty
+    /// \return True if there are no children
+    bool empty() const { return begin() == end(); }
+
+    /// \return Pointer to first child
+    Node *front() const { return parent->first_child(); }
+
+    /// \return Pointer to last child
+    Node *back() const { return parent->last_child(); }
+
+private:
+    const Node *parent;
+};
+
+/// Pair of iterators for range-for and algorithms
+template<class Iterator>
+class NodeRange
+{
+public:
+    NodeRange(Iterator first, Iterator last) : first(first), last(last) {}
+
+    Iterator begin() const { return first; }
+    Iterator end() const { return last; }
+
+    /// Check whether range is empty
+    /// \return True if there are no nodes
+    bool empty() const { return first == last; }
+
+private:
+    Iterator first;
+    Iterator last;
+};
+
+/// Pre-order (tree order) iterator over a subtree. Follows parent and sibling links, so it holds two pointers and
+/// never allocates. Nodes already visited may be changed, the current node and the ones after it may not be removed
+/// \tparam T Node or const Node
+template<class T>
+class PreOrderIterator
+{
+    T *node;
+    T *root;
+public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = T*;
+    using pointer = T* const*;
+    using reference = T*;
+    // operator* returns the pointer by value, which only input iterators may do. Copies walk independently
+    using iterator_category = std::input_iterator_tag;
+
+    PreOrderIterator() : node(nullptr), root(nullptr) {}
+
+    /// PreOrderIterator constructor
+    /// \param node Current node, nullptr for the end
+    /// \param root Root of the subtree, the walk ends when it has to leave it
+    PreOrderIterator(T *node, T *root) : node(node), root(root) {}
+
+    PreOrderIterator& operator++()
+    {
+        if (auto child = node->first_child()) {
+            node = child;
             return *this;
         }
+        skip_children();
+        return *this;
+    }
 
-        iterator operator++(int) { iterator retval = *this; ++(*this); return retval; }
+    /// Moves to the node after the current one and its descendants
+    void skip_children()
+    {
+        while (node != root and not node->next_sibling())
+            node = node->parent_node();
+        node = node == root ? nullptr : node->next_sibling();
+    }
+
+    PreOrderIterator operator++(int) { PreOrderIterator retval = *this; ++(*this); return retval; }
+    bool operator==(PreOrderIterator other) const { return node == other.node; }
+    bool operator!=(PreOrderIterator other) const { return !(*this == other); }
+    reference operator*() const { return node; }
+};
+
+/// Post-order iterator over a subtree, every node comes after its descendants (for bottom-up computations).
+/// Stackless like PreOrderIterator. The current node may be changed, but not removed
+/// \tparam T Node or const Node
+template<class T>
+class PostOrderIterator
+{
+    T *node;
+    T *root;
+
+    static T *first_leaf(T *node)
+    {
+        while (auto child = node->first_child())
+            node = child;
+        return node;
+    }
+public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = T*;
+    using pointer = T* const*;
+    using reference = T*;
+    // input iterator for the same reason as PreOrderIterator
+    using iterator_category = std::input_iterator_tag;
+
+    PostOrderIterator() : node(nullptr), root(nullptr) {}
+
+    /// PostOrderIterator constructor
+    /// \param root Root of the subtree, the walk starts at its first leaf, nullptr for the end
+    explicit PostOrderIterator(T *root) : node(root ? first_leaf(root) : nullptr), root(root) {}
+
+    PostOrderIterator& operator++()
+    {
+        if (node == root)
+            node = nullptr;
+        else if (auto next = node->next_sibling())
+            node = first_leaf(next);
+        else
+            node = node->parent_node();
+        return *this;
+    }
+
+    PostOrderIterator operator++(int) { PostOrderIterator retval = *this; ++(*this); return retval; }
+    bool operator==(PostOrderIterator other) const { return node == other.node; }
+    bool operator!=(PostOrderIterator other) const { return !(*this == other); }
+    reference operator*() const { return node; }
+};
+
+/// Iterator that skips nodes of other types (and names)
+/// \tparam Iterator Underlying iterator
+template<class Iterator>
+class FilteredIterator
+{
+    Iterator it;
+    Iterator last;
+    Node::Type type;
+    std::string_view name;
+
+    void skip()
+    {
+        while (it != last and ((*it)->type() != type or (not name.empty() and (*it)->name() != name)))
+            ++it;
+    }
+public:
+    using difference_type = typename Iterator::difference_type;
+    using value_type = typename Iterator::value_type;
+    using pointer = typename Iterator::pointer;
+    using reference = typename Iterator::reference;
+    using iterator_category = typename Iterator::iterator_category;
+
+    FilteredIterator() : type(Node::Type::INVALID_NODE) {}
+
+    /// FilteredIterator constructor
+    /// \param it Underlying iterator, moved to the first matching node
+    /// \param last End of the underlying range
+    /// \param type Node type
+    /// \param name Node name, any name if empty. The view has to outlive the iterator
+    FilteredIterator(Iterator it, Iterator last, Node::Type type, std::string_view name)
+            : it(it), last(last), type(type), name(name) { skip(); }
+
+    FilteredIterator& operator++() { ++it; skip(); return *this; }
+    FilteredIterator operator++(int) { FilteredIterator retval = *this; ++(*this); return retval; }
+    bool operator==(const FilteredIterator &other) const { return it == other.it; }
+    bool operator!=(const FilteredIterator &other) const { return !(*this == other); }
+    reference operator*() const { return *it; }
+};
+
+/// Breadth-first (level order) traversal of a subtree. The queue is kept between walks, so walking
+/// with the same object again doesn't allocate
+/// \tparam T Node or const Node
+template<class T>
+class BasicLevelOrder
+{
+public:
+    /// Single pass iterator, advancing it advances the traversal
+    class iterator
+    {
+        BasicLevelOrder *owner;
+        T *node;
+    public:
+        using difference_type = std::ptrdiff_t;
+        using value_type = T*;
+        using pointer = T* const*;
+        using reference = T*;
+        using iterator_category = std::input_iterator_tag;
+
+        iterator(BasicLevelOrder *owner, T *node) : owner(owner), node(node) {}
+        iterator& operator++() { node = owner->next(node); return *this; }
         bool operator==(iterator other) const { return node == other.node; }
         bool operator!=(iterator other) const { return !(*this == other); }
-        reference operator*() { return node; }
+        reference operator*() const { return node; }
     };
 
-    /// Pre-order (tree order) iterator to this node
-    /// \return Begin iterator
-    iterator begin() { return iterator(this); }
+    /// Starts a walk of root and its descendants, iterators of the previous walk become invalid
+    /// \param root Root of the subtree
+    /// \return Range of nodes
+    NodeRange<iterator> operator()(T *root)
+    {
+        queue.clear();
+        head = 0;
+        return NodeRange<iterator>(iterator(this, root), iterator(this, nullptr));
+    }
+
+private:
+    /// Queues children of node and takes the next node from the queue
+    T *next(T *node)
+    {
+        for (T *child = node->first_child(); child; child = child->next_sibling())
+            queue.push_back(child);
+        if (head == queue.size())
+            return nullptr;
+
+        auto front = queue[head++];
+        // drop the taken half, so the queue is as long as the widest level at most twice
+        if (head >= 64 and head * 2 >= queue.size()) {
+            queue.erase(queue.begin(), queue.begin() + head);
+            head = 0;
+        }
+        return front;
+    }
 
-    /// Pre-order (tree order) iterator to nullptr
-    /// \return End iterator
-    iterator end()   { return iterator(nullptr); }
+    std::vector<T*> queue;
+    size_t head = 0;
+};
 
-protected:
-    Type type_;
-    std::string name_;
-    std::string value_;
-    std::list<std::unique_ptr<Node>> child_nodes_;
-    Node* parent_node_;
-    Node* previous_sibling_;
-    Node* next_sibling_;
+using LevelOrder = BasicLevelOrder<Node>;
+using ConstLevelOrder = BasicLevelOrder<const Node>;
+
+inline Node::iterator Node::begin() { return iterator(this, this); }
+inline Node::const_iterator Node::begin() const { return const_iterator(this, this); }
+inline Node::iterator Node::end() { return iterator(nullptr, this); }
+inline Node::const_iterator Node::end() const { return const_iterator(nullptr, this); }
+
+inline NodeRange<PreOrderIterator<Node>> Node::pre_order()
+{
+    return NodeRange<iterator>(begin(), end());
+}
+
+inline NodeRange<PreOrderIterator<const Node>> Node::pre_order() const
+{
+    return NodeRange<const_iterator>(begin(), end());
+}
+
+inline NodeRange<FilteredIterator<PreOrderIterator<Node>>> Node::pre_order(Type type, std::string_view name)
+{
+    using Filtered = FilteredIterator<iterator>;
+    return NodeRange<Filtered>(Filtered(begin(), end(), type, name), Filtered(end(), end(), type, name));
+}
+
+inline NodeRange<FilteredIterator<PreOrderIterator<const Node>>> Node::pre_order(Type type, std::string_view name) const
+{
+    using Filtered = FilteredIterator<const_iterator>;
+    return NodeRange<Filtered>(Filtered(begin(), end(), type, name), Filtered(end(), end(), type, name));
+}
+
+inline NodeRange<PostOrderIterator<Node>> Node::post_order()
+{
+    return NodeRange<PostOrderIterator<Node>>(PostOrderIterator<Node>(this), PostOrderIterator<Node>());
+}
+
+inline NodeRange<PostOrderIterator<const Node>> Node::post_order() const
+{
+    return NodeRange<PostOrderIterator<const Node>>(PostOrderIterator<const Node>(this),
+                                                    PostOrderIterator<const Node>());
+}
+
+/// Markup of an element of a lazy document (see Parser::parse_lazy()). The spans of its descendants follow it
+/// in document order, all found by one scan of the input, so loading an element doesn't scan its markup again
+struct ElementSpan
+{
+    /// From the start tag to the end tag
+    std::string_view markup;
+    /// Number of spans of descendants that follow this one
+    size_t descendants;
 };
 
 class Element : public Node
 {
+    friend class XML::LazyParser;
+
 public:
     /// Element constructor
     /// \param tag_name Tag name
-    explicit Element(const std::string &tag_name);
+    /// \param resource Memory resource for strings, attributes and child list
+    explicit Element(std::string_view tag_name, std::pmr::memory_resource *resource = nullptr);
+
+    /// Element constructor
+    /// \param tag_name Tag name
+    /// \param names Table tag and attribute names are interned in
+    /// \param resource Memory resource for strings, attributes and child list
+    Element(std::string_view tag_name, NameTable &names, std::pmr::memory_resource *resource = nullptr);
 
     /// Element move constructor
     /// \param other Element to move
@@ -211,26 +724,25 @@ public:
     /// Check whether this element has attribute
     /// \param name Name of the attribute
     /// \return True if it has this attribute
-    bool has_attribute(const std::string &name);
+    bool has_attribute(std::string_view name);
 
     /// Remove attribute of this element by name
     /// \param name Name of the attribute to remove
-    void remove_attribute(const std::string &name);
-
-    /// Serialize this node and descendants
-    /// \param tab_size Size of one tab in spaces
-    /// \param level Current level of indent
-    /// \return String representation of this node and descendants
-    std::string serialize(size_t tab_size, size_t level) override;
+    void remove_attribute(std::string_view name);
 
     /// Returns attribute value by name
     /// \param name Name of the attribute
-    /// \return Attribute value
-    std::string attribute(const std::string &name);
+    /// \return Attribute value (empty string if there is no such attribute)
+    std::string attribute(std::string_view name);
 
-    /// Get ref to attributes map
-    /// \return Ref to attributes map
-    std::map<std::string, std::string> &attributes();
+    /// Returns attribute value by name without copying it
+    /// \param name Name of the attribute
+    /// \return View of the value, valid until the attribute changes, or nullopt if there is no such attribute
+    std::optional<std::string_view> find_attribute(std::string_view name) const;
+
+    /// Get ref to attributes in source order
+    /// \return Ref to attributes list
+    const AttributeList &attributes() const;
 
     /// Returns concatenation of every text node descendant of this element
     /// \return Text content
@@ -238,12 +750,12 @@ public:
 
     /// Create new attribute
     /// \param name Name of the attribute
-    /// \param value Value of the attribute
-    void set_attribute(const std::string &name, const std::string &value);
+    /// \param value Value of the attribute, unescaped (Serializer escapes it)
+    void set_attribute(std::string_view name, std::string_view value);
 
     /// Delete all descendants and replace them with one Text node
     /// \param text Text node value
-    void set_text_content(const std::string &text) override;
+    void set_text_content(std::string_view text) override;
 
     /// Move operator=
     /// \param other Element to move
@@ -251,15 +763,56 @@ public:
     Element &operator=(Element &&other) noexcept;
 
 protected:
-    std::map<std::string, std::string> attributes_;
+    AttributeList attributes_;
+    // markup of a lazy element, parsed on first access
+    const ElementSpan *span_{nullptr};
+    // levels of elements a lazy element may still hold below it, Parser::max_depth less its own depth
+    uint32_t lazy_depth_{0};
+};
+
+/// Base of the nodes that hold a value instead of children. The value is copied to the memory resource
+/// of the node, like attribute values
+class CharacterData : public Node
+{
+    friend class Node;
+
+public:
+    ~CharacterData() override;
+
+    /// CharacterData move constructor
+    /// \param other Node to move
+    CharacterData(CharacterData &&other) noexcept;
+
+    /// Move operator=
+    /// \param other Node to move
+    /// \return Ref to *this
+    CharacterData &operator=(CharacterData &&other) noexcept;
+
+    /// Set new value
+    /// \param text New value
+    void set_text_content(std::string_view text) override;
+
+protected:
+    /// CharacterData constructor
+    /// \param type Node type
+    /// \param value Node value
+    /// \param resource Memory resource for the value
+    CharacterData(Type type, std::string_view value, std::pmr::memory_resource *resource);
+
+    /// Replaces the value with a copy of value and releases the old one
+    /// \param value New value
+    void assign(std::string_view value);
+
+    std::string_view value_;
 };
 
-class Text : public Node
+class Text : public CharacterData
 {
 public:
     /// Text constructor
     /// \param text Text value
-    explicit Text(const std::string &text = "");
+    /// \param resource Memory resource for the value
+    explicit Text(std::string_view text = {}, std::pmr::memory_resource *resource = nullptr);
 
     /// Always throws DOMError
     /// \param new_child Child to append
@@ -269,24 +822,15 @@ public:
     /// \param new_child
     /// \param ref_child
     void insert_before(Node *new_child, Node *ref_child) override;
-
-    /// Set new text content
-    /// \param text New text
-    void set_text_content(const std::string &text) override;
-
-    /// Serialize this node and descendants
-    /// \param tab_size Size of one tab in spaces
-    /// \param level Current level of indent
-    /// \return String representation of this node and descendants
-    std::string serialize(size_t tab_size, size_t level) override;
 };
 
-class CDATASection : public Node
+class CDATASection : public CharacterData
 {
 public:
     /// CDATASection constructor
     /// \param text Text content
-    explicit CDATASection(const std::string &text = "");
+    /// \param resource Memory resource for the value
+    explicit CDATASection(std::string_view text = {}, std::pmr::memory_resource *resource = nullptr);
 
     /// Always throws DOMError
     /// \param new_child Child to append
@@ -296,24 +840,19 @@ public:
     /// \param new_child
     /// \param ref_child
     void insert_before(Node *new_child, Node *ref_child) override;
-
-    /// Serialize this node and descendants
-    /// \param tab_size Size of one tab in spaces
-    /// \param level Current level of indent
-    /// \return String representation of this node and descendants
-    std::string serialize(size_t tab_size, size_t level) override;
 };
 
-class Comment : public Node
+class Comment : public CharacterData
 {
 public:
     /// Comment constructor
     /// \param text Text content
-    explicit Comment(const std::string &text = "");
+    /// \param resource Memory resource for the value
+    explicit Comment(std::string_view text = {}, std::pmr::memory_resource *resource = nullptr);
 
     /// Set new text content
     /// \param text New text
-    void set_text_content(const std::string &text) override;
+    void set_text_content(std::string_view text) override;
 
     /// Always throws DOMError
     /// \param new_child Text content
@@ -323,18 +862,126 @@ public:
     /// \param new_child
     /// \param ref_child
     void insert_before(Node *new_child, Node *ref_child) override;
+};
 
-    /// Serialize this node and descendants
-    /// \param tab_size Size of one tab in spaces
-    /// \param level Current level of indent
-    /// \return String representation of this node and descendants
-    std::string serialize(size_t tab_size, size_t level) override;
+/// Elements of a document by tag name, each list in document order (see Document::enable_tag_index()).
+/// Every indexed node has two order labels, where it starts and where it ends after its descendants, which grow
+/// in document order, so the labels of a subtree are the range between those of its root and lists are kept sorted
+/// by binary search on them. Linked nodes take labels from the gap between the labels of their siblings or parent,
+/// which are one link away. When the gap is too small, the smallest aligned range of labels around it that is
+/// sparse enough, the larger the denser, is labeled evenly again, which costs amortized O(log² n) labels per node.
+/// Nothing ever rebuilds the index. The labels are kept in a table of the index, so nodes don't grow by them
+class TagIndex
+{
+    friend class Node;
+    friend class Document;
+
+public:
+    /// TagIndex constructor
+    /// \param document Document the index belongs to
+    explicit TagIndex(Document &document);
+
+    /// Adds every node of subtree, loading lazy elements. Nodes already in the index are skipped
+    /// \param subtree Node attached to the document
+    void insert(Node *subtree);
+
+    /// Removes every node of subtree, call it before the subtree is detached
+    /// \param subtree Node attached to the document
+    void erase(Node *subtree);
+
+    /// Removes all nodes
+    void clear();
+
+    /// Returns elements by tag name
+    /// \param tag_name Tag name
+    /// \return Pointer to elements in document order or nullptr if there are none
+    const std::vector<Element*> *find(std::string_view tag_name) const;
+
+    /// Returns elements by tag name among an element and its descendants, in O(log n + matches)
+    /// \param tag_name Tag name
+    /// \param subtree Indexed element
+    /// \param elements Set to the elements in document order
+    void find(std::string_view tag_name, Element *subtree, std::list<Element*> &elements) const;
+
+private:
+    // labels are in [1, label_limit), 0 and label_limit stand for the start and end of the document
+    static constexpr uint64_t label_limit = uint64_t(1) << 62;
+
+    struct Labels
+    {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    /// Start or end of a node in document order, null node past either end of the document
+    struct Bound
+    {
+        Node *node;
+        bool end;
+    };
+
+    // bounds in document order over the raw links, nothing is loaded
+    static Bound next(Bound bound);
+    static Bound previous(Bound bound);
+
+    /// Returns the label of an indexed bound
+    uint64_t &label(Bound bound);
+
+    /// Lists and labels every node of the document, loading lazy elements
+    void rebuild();
+
+    /// Labels the nodes of subtree, which are not in the index yet
+    /// \param subtree Node attached to the document
+    void label(Node *subtree);
+
+    /// Labels every node of the document evenly, keeping their order
+    void label_all();
+
+    /// Returns the first element of list whose start label is not less than order
+    std::vector<Element*>::const_iterator lower_bound(const std::vector<Element*> &list, uint64_t order) const;
+
+    void insert_element(Element *element);
+    void erase_element(Element *element);
+
+    Document *document_;
+    // keys are views of names of the elements in the list, empty lists are removed so they cannot dangle
+    std::unordered_map<std::string_view, std::vector<Element*>> elements_;
+    std::unordered_map<const Node*, Labels> labels_;
 };
 
+/// Monotonic arena of a document. It knows the document, so nodes allocated from it are not linked into another
+/// document, which would keep them after their memory is released
+class Arena : public std::pmr::monotonic_buffer_resource
+{
+public:
+    /// Arena constructor
+    /// \param upstream Memory resource the arena requests its blocks from
+    /// \param document Document that releases the arena
+    Arena(std::pmr::memory_resource *upstream, Document *document);
+
+    // kept up to date when the document is moved or adopts the arena
+    Document *document;
+};
+
+/// Document node. Owns a monotonic arena that nodes created with create_element(),
+/// create_text_node(), create_cdata_section() and create_comment() (and therefore by Parser)
+/// are allocated from, so destroying a document releases them all at once
 class Document : public Node
 {
+    friend class Node;
+
 public:
-    explicit Document();
+    /// Document constructor
+    /// \param upstream Memory resource the arena requests its blocks from
+    explicit Document(std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+    /// Document that interns its names in another table (through a local cache), so they compare equal
+    /// to names of the document owning it
+    /// \param names Name table, must outlive this document and be synchronized while documents share it concurrently
+    /// \param upstream Memory resource the arena requests its blocks from
+    explicit Document(NameTable &names, std::pmr::memory_resource *upstream = std::pmr::get_default_resource());
+
+    ~Document() override;
 
     /// Move constructor
     /// \param other Document to move
@@ -351,7 +998,7 @@ public:
 
     /// Sets new XML prolog
     /// \param xml_prolog New XML prolog
-    void set_xml_prolog(const std::string &xml_prolog);
+    void set_xml_prolog(std::string_view xml_prolog);
 
     /// Returns doctype of this document
     /// \return Doctype
@@ -359,12 +1006,63 @@ public:
 
     /// Sets new doctype
     /// \param doctype New Doctype
-    void set_doctype(const std::string &doctype);
+    void set_doctype(std::string_view doctype);
 
     /// Returns pointer to root element
     /// \return Pointer to root element
     Element *root_element() const;
 
+    /// Returns the arena nodes of this document are allocated from
+    /// \return Memory resource
+    std::pmr::memory_resource *arena() const;
+
+    /// Returns the table names of elements and attributes created by this document are interned in
+    /// \return Name table
+    NameTable &name_table() const;
+
+    /// Creates element allocated from this documents arena, not yet attached to the tree
+    /// \param tag_name Tag name
+    /// \return Pointer to new element
+    Element *create_element(std::string_view tag_name);
+
+    /// Creates text node allocated from this documents arena, not yet attached to the tree
+    /// \param text Text value
+    /// \return Pointer to new text node
+    Text *create_text_node(std::string_view text);
+
+    /// Creates CDATA section allocated from this documents arena, not yet attached to the tree
+    /// \param text Text content
+    /// \return Pointer to new CDATA section
+    CDATASection *create_cdata_section(std::string_view text);
+
+    /// Creates comment allocated from this documents arena, not yet attached to the tree
+    /// \param text Text content
+    /// \return Pointer to new comment
+    Comment *create_comment(std::string_view text);
+
+    /// Takes over the arena and name table of other, so nodes other created can be moved into this document.
+    /// Nodes still attached to other are deleted
+    /// \param other Document to take storage from
+    void adopt(Document &&other);
+
+    /// Copies node and its descendants into this documents arena, loading lazy elements. Nodes of another
+    /// document can't be linked into this one as they are released with their document, their copies can
+    /// \param node Node of any document or created with new, not a document
+    /// \return Pointer to the copy, not yet attached to the tree
+    Node *import_node(const Node *node);
+
+    /// Builds an index of elements by tag name that later mutations of the tree keep up to date, so that
+    /// get_elements_by_tag_name() doesn't walk the tree. Lazy elements are loaded.
+    /// The index costs memory and makes mutations walk up to the document, so it is off by default
+    void enable_tag_index();
+
+    /// Drops the tag index
+    void disable_tag_index();
+
+    /// Check whether this document has a tag index
+    /// \return True if tag index is enabled
+    bool has_tag_index() const;
+
     /// Appends new child
     /// \param new_child Child to append
     void append_child(Node *new_child) override;
@@ -376,6 +1074,12 @@ protected:
     std::string xml_prolog_;
     std::string doctype_;
     Element* root_element_;
+    std::unique_ptr<Arena> arena_;
+    std::unique_ptr<NameTable> name_table_;
+    // storage of adopted documents, tables go first as they live in the arenas
+    std::vector<std::unique_ptr<Arena>> adopted_arenas_;
+    std::vector<std::unique_ptr<NameTable>> adopted_tables_;
+    std::unique_ptr<TagIndex> tag_index_;
 };
 
 }
@@ -0,0 +1,177 @@
+#include <cstdint>
+#include "Entities.hpp"
+#include "Scanner.hpp"
+
+namespace XML
+{
+namespace Entities
+{
+
+namespace
+{
+
+/// Check whether code point is a Char of the XML grammar
+bool is_char(uint32_t code)
+{
+    return code == 0x9 or code == 0xA or code == 0xD or
+           (code >= 0x20 and code <= 0xD7FF) or
+           (code >= 0xE000 and code <= 0xFFFD) or
+           (code >= 0x10000 and code <= 0x10FFFF);
+}
+
+/// Check whether c can be a part of an entity name or a character reference
+bool is_reference_char(char c)
+{
+    return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or
+           c == '#' or c == '_' or c == ':' or c == '-' or c == '.' or static_cast<unsigned char>(c) >= 0x80;
+}
+
+void append_utf8(uint32_t code, std::string &out)
+{
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (code >> 18));
+        out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+/// Decodes the numeric part of a character reference
+/// \param digits Digits between "&#" (or "&#x") and ';'
+/// \param hex Whether digits are hexadecimal
+/// \param code Code point
+/// \param error Set if digits are not a valid reference, its offset is left to the caller
+/// \return False on error
+bool parse_code(std::string_view digits, bool hex, uint32_t &code, ParseError &error)
+{
+    using Code = ParseError::Code;
+    error.name = digits;
+    if (digits.empty()) {
+        error.code = Code::EMPTY_CHARACTER_REFERENCE;
+        return false;
+    }
+
+    code = 0;
+    for (auto ch : digits) {
+        uint32_t digit;
+        if (ch >= '0' and ch <= '9')
+            digit = ch - '0';
+        else if (hex and ch >= 'a' and ch <= 'f')
+            digit = ch - 'a' + 10;
+        else if (hex and ch >= 'A' and ch <= 'F')
+            digit = ch - 'A' + 10;
+        else {
+            error.code = Code::INVALID_REFERENCE_DIGIT;
+            return false;
+        }
+
+        code = code * (hex ? 16 : 10) + digit;
+        // anything past the last code point is invalid, stop before it overflows
+        if (code > 0x10FFFF) {
+            error.code = Code::REFERENCE_OUT_OF_RANGE;
+            return false;
+        }
+    }
+    if (not is_char(code)) {
+        error.code = Code::FORBIDDEN_CHARACTER_REFERENCE;
+        return false;
+    }
+    return true;
+}
+
+}
+
+bool has_references(std::string_view raw)
+{
+    return Scanner::find(raw, 0, '&') != raw.size();
+}
+
+std::string_view decode(std::string_view raw, std::string &buffer)
+{
+    std::string_view decoded;
+    ParseError error;
+    if (not try_decode(raw, buffer, decoded, error))
+        error.raise();
+    return decoded;
+}
+
+void decode_append(std::string_view raw, std::string &out)
+{
+    ParseError error;
+    if (not try_decode_append(raw, out, error))
+        error.raise();
+}
+
+bool try_decode(std::string_view raw, std::string &buffer, std::string_view &decoded, ParseError &error)
+{
+    if (not has_references(raw)) {
+        decoded = raw;
+        return true;
+    }
+
+    buffer.clear();
+    if (not try_decode_append(raw, buffer, error))
+        return false;
+    decoded = buffer;
+    return true;
+}
+
+bool try_decode_append(std::string_view raw, std::string &out, ParseError &error)
+{
+    size_t pos = 0;
+    while (true) {
+        auto amp = Scanner::find(raw, pos, '&');
+        out.append(raw, pos, amp - pos);
+        if (amp == raw.size())
+            return true;
+
+        error.offset = amp;
+        auto semicolon = amp + 1;
+        while (semicolon < raw.size() and is_reference_char(raw[semicolon]))
+            semicolon++;
+        if (semicolon == raw.size() or raw[semicolon] != ';') {
+            error.code = ParseError::Code::UNTERMINATED_REFERENCE;
+            return false;
+        }
+        auto name = raw.substr(amp + 1, semicolon - amp - 1);
+
+        uint32_t code;
+        if (name == "lt")
+            out += '<';
+        else if (name == "gt")
+            out += '>';
+        else if (name == "amp")
+            out += '&';
+        else if (name == "apos")
+            out += '\'';
+        else if (name == "quot")
+            out += '"';
+        else if (name.size() > 1 and name[0] == '#' and name[1] == 'x') {
+            if (not parse_code(name.substr(2), true, code, error))
+                return false;
+            append_utf8(code, out);
+        } else if (not name.empty() and name[0] == '#') {
+            if (not parse_code(name.substr(1), false, code, error))
+                return false;
+            append_utf8(code, out);
+        } else {
+            error.code = ParseError::Code::UNDEFINED_ENTITY;
+            error.name = name;
+            return false;
+        }
+
+        pos = semicolon + 1;
+    }
+}
+
+}
+} // namespace XML::Entities
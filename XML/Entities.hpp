@@ -0,0 +1,50 @@
+#ifndef XML_ENTITIES_HPP
+#define XML_ENTITIES_HPP
+
+#include <string>
+#include <string_view>
+#include "Errors.hpp"
+#include "ParseError.hpp"
+
+namespace XML
+{
+namespace Entities
+{
+
+/// Check whether text has references (a vectorized scan for '&')
+/// \param raw Text as it appears in the markup
+/// \return True if there is at least one '&'
+bool has_references(std::string_view raw);
+
+/// Decodes character references (&#60; and &#x3C;) and the predefined entities (&lt; &gt; &amp; &apos; &quot;).
+/// Throws SyntaxError on malformed references, undefined entities and references to characters XML doesn't allow.
+/// Text without references is returned as is, so nothing is copied or allocated for it
+/// \param raw Text as it appears in the markup
+/// \param buffer Storage for the decoded text, only used if raw has references
+/// \return raw if it has no references, otherwise a view of buffer
+std::string_view decode(std::string_view raw, std::string &buffer);
+
+/// Appends decoded raw to out (see decode())
+/// \param raw Text as it appears in the markup
+/// \param out String to append to
+void decode_append(std::string_view raw, std::string &out);
+
+/// decode() that doesn't throw
+/// \param raw Text as it appears in the markup
+/// \param buffer Storage for the decoded text, only used if raw has references
+/// \param decoded raw if it has no references, otherwise a view of buffer
+/// \param error Set on failure, its offset is relative to raw and its views point into raw
+/// \return False if raw has an invalid reference
+bool try_decode(std::string_view raw, std::string &buffer, std::string_view &decoded, ParseError &error);
+
+/// decode_append() that doesn't throw, see try_decode()
+/// \param raw Text as it appears in the markup
+/// \param out String to append to
+/// \param error Set on failure
+/// \return False if raw has an invalid reference
+bool try_decode_append(std::string_view raw, std::string &out, ParseError &error);
+
+}
+} // namespace XML::Entities
+
+#endif //XML_ENTITIES_HPP
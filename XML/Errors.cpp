@@ -17,4 +17,6 @@ SyntaxError::SyntaxError(const std::string &message) : Error(message) {}
 
 DOMError::DOMError(const std::string &message) : Error(message) {}
 
+IOError::IOError(const std::string &message) : Error(message) {}
+
 }
\ No newline at end of file
@@ -32,6 +32,12 @@ public:
     explicit DOMError(const std::string &message);
 };
 
+class IOError : public Error
+{
+public:
+    explicit IOError(const std::string &message);
+};
+
 } // namespace XML
 
 
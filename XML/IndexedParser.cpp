@@ -0,0 +1,333 @@
+#include <algorithm>
+#include "IndexedParser.hpp"
+#include "Entities.hpp"
+#include "Scanner.hpp"
+
+namespace XML
+{
+
+namespace
+{
+
+// returned by the walk helpers to give up
+const size_t give_up = std::string_view::npos;
+
+bool is_whitespace(char c)
+{
+    return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+}
+
+bool is_name_start(char c)
+{
+    return ('a' <= c and c <= 'z') or ('A' <= c and c <= 'Z') or c == '_';
+}
+
+bool is_name_char(char c)
+{
+    return is_name_start(c) or ('0' <= c and c <= '9') or c == ':';
+}
+
+size_t skip_whitespace(std::string_view input, size_t pos)
+{
+    while (pos < input.size() and is_whitespace(input[pos]))
+        pos++;
+    return pos;
+}
+
+/// \return Offset after the name starting at pos
+size_t skip_name(std::string_view input, size_t pos)
+{
+    while (pos < input.size() and is_name_char(input[pos]))
+        pos++;
+    return pos;
+}
+
+/// Builds a Document the way Parser does
+class DocumentBuilder
+{
+public:
+    explicit DocumentBuilder(DOM::Document &document) : document(document) {}
+
+    void prolog(std::string_view value) { document.set_xml_prolog(value); }
+
+    void doctype(std::string_view value) { document.set_doctype(value); }
+
+    void start(std::string_view name)
+    {
+        auto elem = document.create_element(name);
+        append(elem);
+        open.push_back(elem);
+    }
+
+    bool attribute(std::string_view name, std::string_view value)
+    {
+        auto elem = open.back();
+        std::string_view text;
+        if (elem->has_attribute(name) or not Entities::try_decode(value, decoded, text, error))
+            return false;
+        elem->set_attribute(name, text);
+        return true;
+    }
+
+    void end() { open.pop_back(); }
+
+    bool text(std::string_view value)
+    {
+        std::string_view text;
+        if (not Entities::try_decode(value, decoded, text, error))
+            return false;
+        open.back()->append_child(document.create_text_node(text));
+        return true;
+    }
+
+    void cdata(std::string_view value) { open.back()->append_child(document.create_cdata_section(value)); }
+
+    void comment(std::string_view value) { append(document.create_comment(value)); }
+
+private:
+    void append(DOM::Node *node)
+    {
+        if (open.empty())
+            document.append_child(node);
+        else
+            open.back()->append_child(node);
+    }
+
+    DOM::Document &document;
+    std::vector<DOM::Element*> open;
+    // values with references are decoded here
+    std::string decoded;
+    // invalid references are left to the Lexer based parser to report
+    ParseError error;
+};
+
+/// Only looks for what DocumentBuilder would reject
+class CheckBuilder
+{
+public:
+    void prolog(std::string_view) {}
+
+    void doctype(std::string_view) {}
+
+    void start(std::string_view) { attributes.clear(); }
+
+    bool attribute(std::string_view name, std::string_view value)
+    {
+        if (std::find(attributes.begin(), attributes.end(), name) != attributes.end() or
+            not Entities::try_decode(value, decoded, decoded_value, error))
+            return false;
+        attributes.push_back(name);
+        return true;
+    }
+
+    void end() {}
+
+    bool text(std::string_view value) { return Entities::try_decode(value, decoded, decoded_value, error); }
+
+    void cdata(std::string_view) {}
+
+    void comment(std::string_view) {}
+
+private:
+    // attribute names of the current start tag
+    std::vector<std::string_view> attributes;
+    // invalid references are found by decoding
+    std::string decoded;
+    std::string_view decoded_value;
+    ParseError error;
+};
+
+}
+
+IndexedParser::IndexedParser(size_t max_depth) : max_depth(max_depth) {}
+
+bool IndexedParser::parse(std::string_view input, DOM::Document &document)
+{
+    try {
+        DocumentBuilder builder(document);
+        return walk(input, builder);
+    } catch (Error&) {
+        return false;
+    }
+}
+
+bool IndexedParser::check(std::string_view input)
+{
+    CheckBuilder builder;
+    return walk(input, builder);
+}
+
+template<class Builder>
+bool IndexedParser::walk(std::string_view input, Builder &builder)
+{
+    StructuralIndex index(input);
+    open_names.clear();
+
+    // offset of the first a or b at or after pos, both have to be structural characters
+    auto find = [&](size_t pos, char a, char b) {
+        index.skip_to(pos);
+        while (true) {
+            auto next = index.next();
+            if (next >= input.size() or input[next] == a or input[next] == b)
+                return next;
+        }
+    };
+
+    // comment at pos, its value starts after whitespace and ends at the first "--", which has to end it
+    auto comment = [&](size_t pos) {
+        auto begin = skip_whitespace(input, pos + 4);
+        auto end = Scanner::find(input, begin, "--");
+        if (end + 2 >= input.size() or input[end + 2] != '>')
+            return give_up;
+        builder.comment(input.substr(begin, end - begin));
+        return end + 3;
+    };
+
+    // start tag at pos, opens the element unless the tag is self-closing
+    auto start_tag = [&](size_t pos) {
+        if (open_names.size() >= max_depth)
+            return give_up;
+
+        auto name_end = skip_name(input, pos + 1);
+        auto name = input.substr(pos + 1, name_end - pos - 1);
+        builder.start(name);
+
+        pos = name_end;
+        while (true) {
+            pos = skip_whitespace(input, pos);
+            if (pos >= input.size())
+                return give_up;
+
+            if (input[pos] == '>') {
+                open_names.push_back(name);
+                return pos + 1;
+            }
+            if (input[pos] == '/') {
+                if (pos + 1 >= input.size() or input[pos + 1] != '>')
+                    return give_up;
+                builder.end();
+                return pos + 2;
+            }
+            if (not is_name_start(input[pos]))
+                return give_up;
+
+            auto attr_end = skip_name(input, pos);
+            auto attr_name = input.substr(pos, attr_end - pos);
+            pos = skip_whitespace(input, attr_end);
+            if (pos >= input.size() or input[pos] != '=')
+                return give_up;
+            pos = skip_whitespace(input, pos + 1);
+            if (pos >= input.size() or (input[pos] != '"' and input[pos] != '\''))
+                return give_up;
+
+            auto quote = input[pos];
+            auto value_end = find(pos + 1, quote, quote);
+            if (value_end >= input.size())
+                return give_up;
+            if (not builder.attribute(attr_name, input.substr(pos + 1, value_end - pos - 1)))
+                return give_up;
+            pos = value_end + 1;
+        }
+    };
+
+    // content of open elements until the outermost one is closed
+    auto content = [&](size_t pos) {
+        while (not open_names.empty()) {
+            pos = skip_whitespace(input, pos);
+            if (pos + 1 >= input.size())
+                return give_up;
+
+            if (input[pos] != '<') {
+                auto end = find(pos, '<', '>');
+                if (end >= input.size() or input[end] == '>')
+                    return give_up;
+                if (not builder.text(input.substr(pos, end - pos)))
+                    return give_up;
+                pos = end;
+                continue;
+            }
+
+            auto next = input[pos + 1];
+            if (next == '/') {
+                auto name_end = skip_name(input, pos + 2);
+                if (input.substr(pos + 2, name_end - pos - 2) != open_names.back() or
+                    name_end >= input.size() or input[name_end] != '>')
+                    return give_up;
+                builder.end();
+                open_names.pop_back();
+                pos = name_end + 1;
+            } else if (is_name_start(next)) {
+                pos = start_tag(pos);
+            } else if (input.compare(pos, 4, "<!--") == 0) {
+                pos = comment(pos);
+            } else if (input.compare(pos, 9, "<![CDATA[") == 0) {
+                auto begin = skip_whitespace(input, pos + 9);
+                auto end = Scanner::find(input, begin, "]]>");
+                if (end == begin or end >= input.size())
+                    return give_up;
+                builder.cdata(input.substr(begin, end - begin));
+                pos = end + 3;
+            } else {
+                return give_up;
+            }
+
+            if (pos == give_up)
+                return give_up;
+        }
+        return pos;
+    };
+
+    bool first = true;
+    bool has_doctype = false;
+    bool has_root = false;
+    size_t pos = 0;
+    while (true) {
+        pos = skip_whitespace(input, pos);
+        if (pos >= input.size())
+            break;
+        if (input[pos] != '<' or pos + 1 >= input.size())
+            return false;
+
+        auto next = input[pos + 1];
+        if (next == '?' or (next == '!' and input.compare(pos, 4, "<!--") != 0 and
+                            input.compare(pos, 9, "<![CDATA[") != 0)) {
+            // prolog or doctype, up to the first '>'
+            auto end = find(pos + 2, '>', '>');
+            if (end >= input.size())
+                return false;
+            auto value = input.substr(pos, end + 1 - pos);
+            if (next == '?') {
+                if (not first)
+                    return false;
+                builder.prolog(value);
+            } else {
+                if (has_doctype)
+                    return false;
+                builder.doctype(value);
+                has_doctype = true;
+            }
+            pos = end + 1;
+        } else if (input.compare(pos, 4, "<!--") == 0) {
+            pos = comment(pos);
+        } else if (is_name_start(next)) {
+            if (has_root)
+                return false;
+            has_root = true;
+            pos = start_tag(pos);
+            if (pos != give_up)
+                pos = content(pos);
+        } else {
+            return false;
+        }
+
+        if (pos == give_up)
+            return false;
+        first = false;
+    }
+
+    // the Lexer stops at a NUL byte, leave such input to it
+    index.skip_to(input.size());
+    return not index.saw_nul();
+}
+
+} // namespace XML
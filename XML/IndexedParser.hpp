@@ -0,0 +1,48 @@
+#ifndef XML_INDEXEDPARSER_HPP
+#define XML_INDEXEDPARSER_HPP
+
+#include <string_view>
+#include <vector>
+#include "DOM.hpp"
+#include "StructuralIndex.hpp"
+
+namespace XML
+{
+
+/// Stage 2 of the structural index parser. Walks the StructuralIndex of the input from one markup character
+/// to the next instead of lexing it byte by byte, and builds the same Document as the Lexer based parser.
+/// It only handles input the Lexer would accept: on anything else (errors included) it gives up
+/// and the caller parses the input with the Lexer, which reports the error
+class IndexedParser
+{
+public:
+    /// IndexedParser constructor
+    /// \param max_depth Maximum element nesting, deeper input is given up on
+    explicit IndexedParser(size_t max_depth);
+
+    /// Parses XML content into document. Input is not copied
+    /// \param input XML string
+    /// \param document Empty document
+    /// \return False if the input has to be parsed by the Lexer based parser, document then holds the nodes built
+    /// before giving up and has to be replaced
+    bool parse(std::string_view input, DOM::Document &document);
+
+    /// Checks that XML content is well-formed without building a document
+    /// \param input XML string
+    /// \return True if the input is well-formed, false if it has to be checked by the Lexer based parser
+    bool check(std::string_view input);
+
+private:
+    /// Walks the input, calling builder for every node
+    /// \return False to give up
+    template<class Builder>
+    bool walk(std::string_view input, Builder &builder);
+
+    size_t max_depth;
+    // names of elements whose end tag hasn't been read yet
+    std::vector<std::string_view> open_names;
+};
+
+} // namespace XML
+
+#endif //XML_INDEXEDPARSER_HPP
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "LazyParser.hpp"
+#include "Entities.hpp"
+#include "Scanner.hpp"
+
+namespace XML
+{
+
+LazyParser::LazyParser(std::string_view input, std::pmr::memory_resource *arena)
+        : input(input), cursor(input), arena(arena) {}
+
+void LazyParser::check(bool ok)
+{
+    if (not ok)
+        cursor.error.raise();
+}
+
+DOM::Document LazyParser::parse(std::string_view input, size_t max_depth)
+{
+    DOM::Document document;
+
+    // lazy elements keep views of their markup
+    std::string_view source;
+    if (not input.empty()) {
+        auto copy = static_cast<char *>(document.arena()->allocate(input.size(), 1));
+        std::memcpy(copy, input.data(), input.size());
+        source = std::string_view(copy, input.size());
+    }
+
+    LazyParser parser(source, document.arena());
+    parser.check(parser.cursor.advance() and parser.cursor.advance());
+
+    auto &curr_token = parser.cursor.curr_token;
+    if (curr_token.type == Token::Type::PI) {
+        document.set_xml_prolog(curr_token.value);
+        parser.check(parser.cursor.advance());
+    }
+
+    while (curr_token.type != Token::Type::END_OF_FILE) {
+        if (curr_token.type == Token::Type::TAG_BEGIN) {
+            if (max_depth == 0)
+                throw SyntaxError("Element " + std::string(curr_token.value) + " is nested deeper than max_depth");
+            auto depth = static_cast<uint32_t>(std::min<size_t>(max_depth - 1, UINT32_MAX));
+            document.append_child(parser.skip_element(document.arena(), document.name_table(), depth));
+        } else if (curr_token.type == Token::Type::DOCTYPE) {
+            if (not document.doctype().empty())
+                parser.check(parser.cursor.fail(ParseError::Code::MORE_THAN_ONE_DOCTYPE, curr_token));
+            document.set_doctype(curr_token.value);
+        } else if (curr_token.type == Token::Type::COMMENT_BEGIN) {
+            std::string_view comment;
+            parser.check(parser.cursor.read_comment(comment));
+            document.append_child(document.create_comment(comment));
+        } else {
+            parser.check(parser.cursor.fail(ParseError::Code::UNEXPECTED_TOKEN_AT_TOP_LEVEL, curr_token));
+        }
+        parser.check(parser.cursor.advance());
+    }
+    return document;
+}
+
+void LazyParser::load(DOM::Element *element)
+{
+    // appending children must not load the element again
+    element->lazy_ = false;
+    try {
+        auto span = element->span_;
+        // the spans of its descendants follow, the children come first in each subtree
+        LazyParser parser(span->markup, element->resource_);
+        parser.next_span = span + 1;
+        parser.spans_end = span + 1 + span->descendants;
+        parser.check(parser.cursor.advance() and parser.cursor.advance());
+        if (not parser.parse_attributes(element))
+            parser.parse_content(element);
+    } catch (...) {
+        element->destroy_children();
+        element->attributes_.clear();
+        element->lazy_ = true;
+        throw;
+    }
+    element->span_ = nullptr;
+}
+
+DOM::Element *LazyParser::skip_element(std::pmr::memory_resource *resource, DOM::NameTable &names, uint32_t depth)
+{
+    auto &curr_token = cursor.curr_token;
+    auto begin = curr_token.value.data() - 1;
+    auto span = next_span;
+    if (span != spans_end and span->markup.data() == begin) {
+        next_span = span + 1 + span->descendants;
+    } else {
+        // top level elements have no span yet, and one the Lexer reads differently than the scan gets its own
+        span = scan_spans(input, begin - input.data(), arena);
+        if (not span)
+            throw SyntaxError("Element " + std::string(curr_token.value) + " is not closed");
+    }
+
+    auto elem = DOM::Node::allocate_node<DOM::Element>(resource, curr_token.value, names);
+    elem->span_ = span;
+    elem->lazy_ = true;
+    elem->lazy_depth_ = depth;
+
+    check(cursor.skip_to(span->markup.data() + span->markup.size() - input.data()));
+    return elem;
+}
+
+const DOM::ElementSpan *LazyParser::scan_spans(std::string_view input, size_t pos, std::pmr::memory_resource *arena)
+{
+    // spans in document order, and those of elements whose end tag is still ahead
+    std::vector<DOM::ElementSpan> spans;
+    std::vector<size_t> open;
+    while (true) {
+        bool self_closing = false;
+        auto tag_end = Scanner::skip_start_tag(input, pos, self_closing);
+        if (tag_end == std::string_view::npos)
+            return nullptr;
+        spans.push_back({input.substr(pos, tag_end - pos), 0});
+        if (not self_closing)
+            open.push_back(spans.size() - 1);
+        pos = tag_end;
+
+        // content up to the next start tag, closing elements on the way like Scanner::skip_element()
+        while (not open.empty()) {
+            auto markup = Scanner::find(input, pos, '<');
+            if (markup + 1 >= input.size())
+                return nullptr;
+
+            auto next = input[markup + 1];
+            if (next == '/') {
+                pos = Scanner::skip_end_tag(input, markup);
+                auto &span = spans[open.back()];
+                span.markup = std::string_view(span.markup.data(), input.data() + pos - span.markup.data());
+                span.descendants = spans.size() - open.back() - 1;
+                open.pop_back();
+            } else if (next == '!' or next == '?') {
+                pos = Scanner::skip_special_tag(input, markup);
+                if (pos == std::string_view::npos)
+                    return nullptr;
+            } else {
+                pos = markup;
+                break;
+            }
+        }
+        if (open.empty())
+            break;
+    }
+
+    auto table = static_cast<DOM::ElementSpan *>(
+            arena->allocate(spans.size() * sizeof(DOM::ElementSpan), alignof(DOM::ElementSpan)));
+    std::uninitialized_copy(spans.begin(), spans.end(), table);
+    return table;
+}
+
+bool LazyParser::parse_attributes(DOM::Element *elem)
+{
+    bool self_closing = false;
+    check(cursor.read_attributes(self_closing,
+        [elem](std::string_view name) { return elem->has_attribute(name); },
+        [this, elem](std::string_view name, const Token &value) {
+            elem->set_attribute(name, Entities::decode(value.value, decoded));
+            return true;
+        }));
+    return self_closing;
+}
+
+void LazyParser::parse_content(DOM::Element *elem)
+{
+    // children go where the element is
+    auto resource = elem->allocation_size_ ? elem->resource_ : nullptr;
+    auto &names = *elem->names_;
+    auto &curr_token = cursor.curr_token;
+    std::string_view text;
+
+    while (true) {
+        check(cursor.advance());
+
+        switch (curr_token.type) {
+            case Token::Type::TAG_CLOSE: {
+                check(cursor.check_end_tag(elem->name()));
+                // the markup ends with the end tag
+                if (cursor.peek_token.type != Token::Type::END_OF_FILE)
+                    check(cursor.fail(ParseError::Code::UNEXPECTED_TOKEN, cursor.peek_token));
+                return;
+            }
+            case Token::Type::CONTENT: {
+                elem->append_child(DOM::Node::allocate_node<DOM::Text>(resource, Entities::decode(curr_token.value, decoded)));
+                break;
+            }
+            case Token::Type::TAG_BEGIN: {
+                if (elem->lazy_depth_ == 0)
+                    throw SyntaxError("Element " + std::string(curr_token.value) + " is nested deeper than max_depth");
+                elem->append_child(skip_element(resource, names, elem->lazy_depth_ - 1));
+                break;
+            }
+            case Token::Type::CDATA_BEGIN: {
+                check(cursor.read_cdata(text));
+                elem->append_child(DOM::Node::allocate_node<DOM::CDATASection>(resource, text));
+                break;
+            }
+            case Token::Type::COMMENT_BEGIN: {
+                check(cursor.read_comment(text));
+                elem->append_child(DOM::Node::allocate_node<DOM::Comment>(resource, text));
+                break;
+            }
+            default:
+                check(cursor.fail(ParseError::Code::UNEXPECTED_TOKEN, curr_token));
+        }
+    }
+}
+
+} // namespace XML
@@ -0,0 +1,81 @@
+#ifndef XML_LAZYPARSER_HPP
+#define XML_LAZYPARSER_HPP
+
+#include <memory_resource>
+#include <string>
+#include "DOM.hpp"
+#include "Errors.hpp"
+#include "TokenCursor.hpp"
+
+namespace XML
+{
+
+/// Parser of lazy documents (see Parser::parse_lazy). An element is created from its start tag name and the span
+/// of its markup. Its attributes and children are parsed from the span when they are first accessed, and its child
+/// elements are left unparsed the same way. The spans of a top level element and all its descendants are found by
+/// one scan that matches end tags to start tags, so a load lexes the markup of its element up to the first child
+/// and continues after the span of each child. Loading all elements of a document costs O(input size), like
+/// Parser::parse()
+class LazyParser
+{
+public:
+    /// Parses prolog, doctype and top level comments, the root element is left unparsed.
+    /// Input is copied to the document, so it doesn't have to outlive it
+    /// \param input XML string
+    /// \param max_depth Maximal nesting depth of elements, deeper ones make the load that reaches them throw
+    /// \return DOM Document node
+    static DOM::Document parse(std::string_view input, size_t max_depth);
+
+    /// Parses attributes and children of a lazy element. Throws SyntaxError if its markup is invalid
+    /// or it has child elements nested deeper than max_depth given to parse(), the element is then left unparsed
+    /// \param element Lazy element
+    static void load(DOM::Element *element);
+
+private:
+    /// LazyParser constructor
+    /// \param input Markup, lexing starts at its beginning
+    /// \param arena Memory resource of the document, spans are allocated from it
+    LazyParser(std::string_view input, std::pmr::memory_resource *arena);
+
+    /// Finds the spans of the element whose start tag begins at pos and of its descendants
+    /// \param input Markup
+    /// \param pos Offset of '<' of the start tag
+    /// \param arena Memory resource the spans are allocated from
+    /// \return Span of the element followed by the spans of its descendants, nullptr if input ends inside it
+    static const DOM::ElementSpan *scan_spans(std::string_view input, size_t pos, std::pmr::memory_resource *arena);
+
+    /// Raises the error of a failed step of the cursor
+    /// \param ok Result of the step
+    void check(bool ok);
+
+    /// Creates a lazy element for the start tag in curr_token and moves the lexer past its end tag. Its span is
+    /// next_span, unless that starts elsewhere or there is none, then its markup is scanned
+    /// \param resource Memory resource the element is allocated from (with new if nullptr)
+    /// \param names Table the element name is interned in
+    /// \param depth Levels of elements the element may hold below it
+    /// \return Element
+    DOM::Element *skip_element(std::pmr::memory_resource *resource, DOM::NameTable &names, uint32_t depth);
+
+    /// Reads attributes of the start tag of elem
+    /// \param elem Element
+    /// \return True if the tag is self-closing
+    bool parse_attributes(DOM::Element *elem);
+
+    /// Reads content of elem up to its end tag
+    /// \param elem Element
+    void parse_content(DOM::Element *elem);
+
+    // markup being parsed
+    std::string_view input;
+    TokenCursor cursor;
+    std::pmr::memory_resource *arena;
+    // spans of the children of the element being loaded, next_span is the one of the next child
+    const DOM::ElementSpan *next_span{nullptr};
+    const DOM::ElementSpan *spans_end{nullptr};
+    // text and attribute values with references are decoded here
+    std::string decoded;
+};
+
+} // namespace XML
+
+#endif //XML_LAZYPARSER_HPP
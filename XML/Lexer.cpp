@@ -2,33 +2,51 @@
 // Created by cyborg on 11/10/17.
 //
 
+#include <algorithm>
 #include "Lexer.hpp"
+#include "Scanner.hpp"
 
 
 namespace XML
 {
 
 
-Lexer::Lexer(const std::string &input) : input(input), ch(), offset(), read_offset()
+Lexer::Lexer(std::string_view input) : input(input), ch(), offset(), read_offset()
 {
     advance();
 }
 
 void Lexer::advance()
 {
-    if (read_offset >= input.length())
+    if (read_offset >= input.length()) {
         ch = 0;
-    else
+        hit_end = true;
+    } else
         ch = input[read_offset];
 
     offset = read_offset;
     read_offset++;
 }
 
+void Lexer::seek(size_t pos)
+{
+    read_offset = pos;
+    advance();
+}
+
+std::string_view Lexer::slice(size_t begin, size_t end) const
+{
+    if (begin >= input.size())
+        return {};
+    return input.substr(begin, end - begin);
+}
+
 char Lexer::peek()
 {
-    if (read_offset >= input.length())
+    if (read_offset >= input.length()) {
+        hit_end = true;
         return 0;
+    }
     return input[read_offset];
 }
 
@@ -37,13 +55,56 @@ bool Lexer::eof()
     return ch == 0;
 }
 
-void Lexer::validate_name(const std::string &name)
+bool Lexer::hit_end_of_input() const
+{
+    return hit_end;
+}
+
+bool Lexer::unexpected_symbol() const
+{
+    return unexpected_symbol_;
+}
+
+size_t Lexer::position() const
+{
+    return offset;
+}
+
+void Lexer::resume(std::string_view input, size_t discarded)
+{
+    auto pos = std::min(offset, this->input.length()) - discarded;
+    this->input = input;
+    seek(pos);
+
+    if (scan_begin != std::string_view::npos and scan_begin >= discarded) {
+        scan_begin -= discarded;
+        scan_end -= discarded;
+    } else {
+        scan_begin = std::string_view::npos;
+    }
+}
+
+void Lexer::keep_scan_progress(const Lexer &ahead)
+{
+    scan_begin = ahead.scan_begin;
+    scan_end = ahead.scan_end;
+    scan_mode = ahead.scan_mode;
+}
+
+void Lexer::skip_to(size_t pos)
+{
+    mode = Mode::CONTENT;
+    unexpected_symbol_ = false;
+    scan_begin = std::string_view::npos;
+    seek(pos);
+}
+
+void Lexer::validate_name(std::string_view name)
 {
     if (name.empty())
         throw SyntaxError("Empty tag name");
 
     Lexer l(name);
-    l.advance();
     auto &ch = l.ch;
     if (not l.is_letter(ch) or l.is_digit(ch) or ch == '-' or ch == '.')
         throw SyntaxError("Invalid tag name");
@@ -63,9 +124,17 @@ void Lexer::consume_whitespace()
 
 Token Lexer::next_token()
 {
-    consume_whitespace();
+    auto token = try_next_token();
+    if (unexpected_symbol_)
+        throw SyntaxError("Unexpected symbol >");
+    return token;
+}
 
-    Token token;
+Token Lexer::try_next_token()
+{
+    unexpected_symbol_ = false;
+    hit_end = offset >= input.length();
+    consume_whitespace();
 
     switch (mode) {
         case Mode::CONTENT:
@@ -77,15 +146,16 @@ Token Lexer::next_token()
         case Mode::COMMENT:
             return comment_mode();
     }
+    return Token(Token::Type::INVALID);
 }
 
 Token Lexer::content_mode()
 {
     Token token;
+    auto begin = offset;
 
     switch (ch) {
         case 0: {
-            token.value = "";
             token.type = Token::Type::END_OF_FILE;
             break;
         }
@@ -93,49 +163,48 @@ Token Lexer::content_mode()
             advance();
 
             if (is_letter(ch) and not is_digit(ch) and ch != '-' and ch != '.') {
-                token.value = "<" + read_name();
+                token.value = read_name();
                 token.type = Token::Type::TAG_BEGIN;
                 mode = Mode::TAG;
                 return token;
             } else if (ch == '/') {
                 advance();
-                token.value = "</" + read_name() + ">";
+                token.value = read_name();
                 token.type = Token::Type::TAG_CLOSE;
             } else if (ch == '!') {
-                std::string tag = read_special_tag();
+                auto tag = read_special_tag();
+                token.value = slice(begin, offset);
 
                 if (tag == "!--") {
-                    token.value = "<!--";
                     token.type = Token::Type::COMMENT_BEGIN;
                     mode = Mode::COMMENT;
                 } else if (tag == "![CDATA[") {
-                    token.value = "<![CDATA[";
                     token.type  = Token::Type::CDATA_BEGIN;
                     mode = Mode::CDATA;
                 } else {
-                    token.value = "<" + tag;
                     token.type = Token::Type::DOCTYPE;
                 }
 
                 return token;
             } else if (ch == '?') {
-                token.value = "<" + read_special_tag();
+                read_special_tag();
+                token.value = slice(begin, offset);
                 token.type = Token::Type::PI;
                 return token;
             } else {
-                token.value = ch;
+                token.value = slice(offset, offset + 1);
                 token.type = Token::Type::INVALID;
             }
             break;
         }
         default: {
-            token.value = read_until('<');
-            for (auto &&ch : token.value) {
-                if (ch == '>')
-                    throw SyntaxError("Unexpected symbol >");
+            token.value = read_until_any("<>");
+            if (ch == '>') {
+                unexpected_symbol_ = true;
+                return Token(Token::Type::INVALID, slice(offset, offset + 1));
             }
             token.type = Token::Type::CONTENT;
-            break;
+            return token;
         }
     }
 
@@ -149,12 +218,11 @@ Token Lexer::tag_mode()
 
     switch (ch) {
         case 0: {
-            token.value = "";
             token.type = Token::Type::END_OF_FILE;
             break;
         }
         case '>': {
-            token.value = ">";
+            token.value = slice(offset, offset + 1);
             token.type = Token::Type::TAG_END;
             mode = Mode::CONTENT;
             break;
@@ -162,17 +230,17 @@ Token Lexer::tag_mode()
         case '/': {
             if (peek() == '>') {
                 advance();
-                token.value = "/>";
+                token.value = slice(offset - 1, offset + 1);
                 token.type = Token::Type::TAG_END_AND_CLOSE;
                 mode = Mode::CONTENT;
             } else {
-                token.value = "/";
+                token.value = slice(offset, offset + 1);
                 token.type = Token::Type::INVALID;
             }
             break;
         }
         case '=': {
-            token.value = "=";
+            token.value = slice(offset, offset + 1);
             token.type  = Token::Type::EQUAL_SIGN;
             break;
         }
@@ -180,14 +248,12 @@ Token Lexer::tag_mode()
             advance();
             token.value = read_until('\'');
             token.type = Token::Type::ATTRIBUTE_VALUE;
-            advance();
             break;
         }
         case '"': {
             advance();
             token.value = read_until('"');
             token.type = Token::Type::ATTRIBUTE_VALUE;
-            advance();
             break;
         }
         default: {
@@ -196,7 +262,7 @@ Token Lexer::tag_mode()
                 token.type = Token::Type::ATTRIBUTE_NAME;
                 return token;
             } else {
-                token.value = ch;
+                token.value = slice(offset, offset + 1);
                 token.type = Token::Type::INVALID;
             }
             break;
@@ -210,10 +276,10 @@ Token Lexer::tag_mode()
 Token Lexer::cdata_mode()
 {
     Token token;
+    auto begin = offset;
 
     switch (ch) {
         case 0: {
-            token.value = "";
             token.type = Token::Type::END_OF_FILE;
             break;
         }
@@ -221,19 +287,21 @@ Token Lexer::cdata_mode()
             advance();
             if (ch == ']' and peek() == '>') {
                 advance();
-                token.value = "]]>";
+                token.value = slice(begin, offset + 1);
                 token.type = Token::Type::CDATA_END;
                 mode = Mode::CONTENT;
             } else {
-                token.value = "]" + read_until("]]>");
+                read_until("]]>");
+                token.value = slice(begin, offset);
                 token.type = Token::Type::CDATA;
+                return token;
             }
             break;
         }
         default: {
             token.value = read_until("]]>");
             token.type = Token::Type::CDATA;
-            break;
+            return token;
         }
     }
 
@@ -244,10 +312,10 @@ Token Lexer::cdata_mode()
 Token Lexer::comment_mode()
 {
     Token token;
+    auto begin = offset;
 
     switch (ch) {
         case 0: {
-            token.value = "";
             token.type = Token::Type::END_OF_FILE;
             break;
         }
@@ -255,22 +323,25 @@ Token Lexer::comment_mode()
             advance();
             if (ch == '-' and peek() == '>') {
                 advance();
-                token.value = "-->";
+                token.value = slice(begin, offset + 1);
                 token.type = Token::Type::COMMENT_END;
                 mode = Mode::CONTENT;
             } else if (ch == '-') {
-                token.value = "--";
+                token.value = slice(begin, offset + 1);
                 token.type = Token::Type::INVALID;
             } else {
-                token.value = '-' + read_until('-');
+                read_until("--");
+                token.value = slice(begin, offset);
                 token.type = Token::Type::COMMENT;
+                return token;
             }
             break;
         }
         default: {
-            token.value = read_until('-');
+            // a single hyphen is text, "--" either ends the comment or is an error
+            token.value = read_until("--");
             token.type = Token::Type::COMMENT;
-            break;
+            return token;
         }
     }
 
@@ -278,19 +349,17 @@ Token Lexer::comment_mode()
     return token;
 }
 
-std::string Lexer::read_name()
+std::string_view Lexer::read_name()
 {
-    std::string name;
-    while (!eof() and (is_letter(ch) or ch == ':' or is_digit(ch))) {
-        name.push_back(ch);
+    auto begin = offset;
+    while (!eof() and (is_letter(ch) or ch == ':' or is_digit(ch)))
         advance();
-    }
-    return name;
+    return slice(begin, offset);
 }
 
 bool Lexer::is_letter(char c)
 {
-    return ('a' <= c and c <= 'z') or ('A' <= c and c <= 'Z') or ch == '_';
+    return ('a' <= c and c <= 'z') or ('A' <= c and c <= 'Z') or c == '_';
 }
 
 bool Lexer::is_digit(char c)
@@ -298,54 +367,64 @@ bool Lexer::is_digit(char c)
     return '0' <= c and c <= '9';
 }
 
-std::string Lexer::read_special_tag()
+std::string_view Lexer::read_special_tag()
 {
-    std::string tag;
+    auto begin = offset;
     while (ch != '>' and !eof()) {
-        tag.push_back(ch);
         advance();
+        auto tag = slice(begin, offset);
         if (tag == "!--" or tag == "![CDATA[")
             return tag;
     }
-    if (ch == '>') {
-        tag.push_back(ch);
+    if (ch == '>')
         advance();
-    }
-    return tag;
+    return slice(begin, offset);
 }
 
-std::string Lexer::read_until(char c)
+std::string_view Lexer::read_until(char c)
 {
-    std::string buffer;
-    while (!eof()) {
-        buffer.push_back(ch);
-        if (peek() == c)
-            return buffer;
-        advance();
-    }
-    return buffer;
+    return read_until_any(std::string_view(&c, 1));
 }
 
-std::string Lexer::read_until(const std::string &substr)
+std::string_view Lexer::read_until_any(std::string_view set)
 {
-    std::string buffer;
-    while (!eof()) {
-        buffer.push_back(ch);
-        bool match = true;
-
-        for (auto i = 0; read_offset + i < input.size() and i < substr.size(); i++) {
-            if (input[read_offset + i] != substr[i]) {
-                match = false;
-                continue;
-            }
-        }
+    auto begin = offset;
+    if (eof())
+        return {};
+
+    auto pos = Scanner::find_first_of(input, resume_scan(begin, 1), set);
+    end_scan(begin, pos);
+    seek(pos);
+    return slice(begin, pos);
+}
+
+std::string_view Lexer::read_until(std::string_view substr)
+{
+    auto begin = offset;
+    if (eof())
+        return {};
+
+    auto pos = Scanner::find(input, resume_scan(begin, substr.size()), substr);
+    end_scan(begin, pos);
+    seek(pos);
+    return slice(begin, pos);
+}
 
-        if (match)
-            return buffer;
+size_t Lexer::resume_scan(size_t begin, size_t match_size) const
+{
+    // a match can start in the last match_size - 1 bytes of what was scanned
+    if (begin != scan_begin or mode != scan_mode)
+        return begin;
+    return std::max(begin, scan_end - std::min(scan_end, match_size - 1));
+}
 
-        advance();
-    }
-    return buffer;
+void Lexer::end_scan(size_t begin, size_t pos)
+{
+    if (pos < input.size())
+        return;
+    scan_begin = begin;
+    scan_end = pos;
+    scan_mode = mode;
 }
 
 } // namespace XML
@@ -14,19 +14,54 @@ namespace XML
 class Lexer
 {
 public:
-    /// Constructor from std::string
-    /// \param input std::string with XML content
-    explicit Lexer(const std::string& input = "");
+    /// Constructor from string view. Input is not copied, so the buffer
+    /// must outlive both the lexer and every token it returns
+    /// \param input View of XML content
+    explicit Lexer(std::string_view input = {});
 
-    /// Generates next token
+    /// Generates next token, throws SyntaxError on '>' in content
     /// \return next token
     Token next_token();
 
+    /// Generates next token without throwing: '>' in content is returned as an INVALID token
+    /// and unexpected_symbol() is set until the next call
+    /// \return next token
+    Token try_next_token();
+
+    /// Check whether the last token is INVALID because of a '>' in content
+    /// \return True if the content had an unexpected '>'
+    bool unexpected_symbol() const;
+
     /// Check whether lexer has reached end of file
     /// \return True if eof is reached
     bool eof();
 
-    static void validate_name(const std::string &name);
+    /// Check whether the last token touched the end of input, i.e. appending
+    /// more input could have changed it. Used for incremental lexing
+    /// \return True if end of input was reached while reading the last token
+    bool hit_end_of_input() const;
+
+    /// Returns offset of the current symbol in input
+    /// \return Offset
+    size_t position() const;
+
+    /// Continues lexing from the same position and mode on a new input buffer,
+    /// which starts with the old one without its first discarded bytes
+    /// \param input New input
+    /// \param discarded Number of bytes dropped from the beginning of old input
+    void resume(std::string_view input, size_t discarded);
+
+    /// Takes over how far a copy of this lexer that ran ahead got in a value cut by the end of input,
+    /// so after rolling back to this lexer and resuming, the value is scanned from there instead of its
+    /// first byte, and reading a long token in n chunks stays linear
+    /// \param ahead Copy of this lexer that hit the end of input
+    void keep_scan_progress(const Lexer &ahead);
+
+    /// Continues lexing in content mode at offset pos, e.g. after markup that was skipped without lexing it
+    /// \param pos Offset in input
+    void skip_to(size_t pos);
+
+    static void validate_name(std::string_view name);
 
     enum class Mode {
         CONTENT,
@@ -37,6 +72,13 @@ public:
 private:
     void advance();
 
+    /// Moves current symbol to position pos
+    /// \param pos Offset in input
+    void seek(size_t pos);
+
+    /// \return View of input between begin and end offsets
+    std::string_view slice(size_t begin, size_t end) const;
+
     /// \return Next symbol after the current one
     char peek();
 
@@ -44,21 +86,33 @@ private:
 
     /// reads <! and <? tags until >, ends earlier if its CDATA or Comment begin
     /// \return Value for token
-    std::string read_special_tag();
+    std::string_view read_special_tag();
 
     /// Reads tag name or attribute name
     /// \return Name
-    std::string read_name();
+    std::string_view read_name();
 
-    /// Reads until first occurrence of character c or eof
+    /// Reads until first occurrence of character c or eof, stops on c
     /// \param c Character to read until
     /// \return Value for token
-    std::string read_until(char c);
+    std::string_view read_until(char c);
+
+    /// Reads until first occurrence of any character from set or eof, stops on it
+    /// \param set Characters to read until (see Scanner::max_set_size)
+    /// \return Value for token
+    std::string_view read_until_any(std::string_view set);
 
-    /// Reads until first occurrence of substring or eof
+    /// Reads until first occurrence of substring or eof, stops on its first character
     /// \param substr Substring to read until
     /// \return Value for token
-    std::string read_until(const std::string& substr);
+    std::string_view read_until(std::string_view substr);
+
+    /// Returns where a scan for a match of match_size bytes from begin has to start, which is after
+    /// the part an earlier scan from begin in this mode already searched
+    size_t resume_scan(size_t begin, size_t match_size) const;
+
+    /// Records a scan from begin that ran into the end of input at pos
+    void end_scan(size_t begin, size_t pos);
 
     /// Checks whether c is a latin letter
     /// \param c Character to check
@@ -75,11 +129,18 @@ private:
     Token cdata_mode();
     Token comment_mode();
 
-    std::string input;
+    std::string_view input;
     size_t offset;
     size_t read_offset;
     char ch;
+    bool hit_end{false};
+    bool unexpected_symbol_{false};
     Mode mode{Mode::CONTENT};
+
+    // where the last scan that ran into the end of input started, in which mode, and where it stopped
+    size_t scan_begin{std::string_view::npos};
+    size_t scan_end{0};
+    Mode scan_mode{Mode::CONTENT};
 };
 
 } // namespace XML
@@ -0,0 +1,124 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#include <fstream>
+#include <sstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace XML
+{
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string &path) : data_(nullptr), size_(0)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        throw IOError("Cannot open file " + path);
+    std::ostringstream ss;
+    ss << file.rdbuf();
+    buffer_ = ss.str();
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+}
+
+void MappedFile::unmap()
+{
+    buffer_.clear();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#else
+
+MappedFile::MappedFile(const std::string &path) : data_(nullptr), size_(0)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw IOError("Cannot open file " + path);
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw IOError("Cannot stat file " + path);
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ != 0) {
+        void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            throw IOError("Cannot map file " + path);
+        }
+        ::madvise(addr, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char *>(addr);
+    }
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+}
+
+void MappedFile::unmap()
+{
+    if (data_)
+        ::munmap(const_cast<char *>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept : data_(other.data_), size_(other.size_)
+{
+#ifdef _WIN32
+    buffer_ = std::move(other.buffer_);
+    data_ = buffer_.data();
+#endif
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        data_ = other.data_;
+        size_ = other.size_;
+#ifdef _WIN32
+        buffer_ = std::move(other.buffer_);
+        data_ = buffer_.data();
+#endif
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+const char *MappedFile::data() const
+{
+    return data_;
+}
+
+size_t MappedFile::size() const
+{
+    return size_;
+}
+
+std::string_view MappedFile::view() const
+{
+    if (!data_)
+        return {};
+    return std::string_view(data_, size_);
+}
+
+} // namespace XML
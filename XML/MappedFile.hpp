@@ -0,0 +1,57 @@
+#ifndef XML_MAPPEDFILE_HPP
+#define XML_MAPPEDFILE_HPP
+
+#include <string>
+#include <string_view>
+#include "Errors.hpp"
+
+namespace XML
+{
+
+/// Read-only memory mapping of a file, used to lex files without reading them into a std::string
+class MappedFile
+{
+public:
+    /// Maps the whole file read-only and hints the kernel for sequential access
+    /// \param path Path to the file
+    explicit MappedFile(const std::string &path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// Move constructor
+    /// \param other Mapping to move
+    MappedFile(MappedFile&& other) noexcept;
+
+    /// Move operator=
+    /// \param other Mapping to move
+    /// \return Ref to *this
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    /// Returns pointer to the first byte of the file
+    /// \return Pointer to data
+    const char *data() const;
+
+    /// Returns size of the file in bytes
+    /// \return Size
+    size_t size() const;
+
+    /// Returns view of the whole file, valid while the mapping is alive
+    /// \return View of file content
+    std::string_view view() const;
+
+private:
+    void unmap();
+
+    const char *data_;
+    size_t size_;
+#ifdef _WIN32
+    std::string buffer_;
+#endif
+};
+
+} // namespace XML
+
+#endif //XML_MAPPEDFILE_HPP
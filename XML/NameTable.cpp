@@ -0,0 +1,100 @@
+#include <cstring>
+#include "NameTable.hpp"
+
+namespace XML
+{
+namespace DOM
+{
+
+NameTable::NameTable(std::pmr::memory_resource *resource, bool synchronized)
+        : resource_(resource),
+          names_(resource),
+          mutex_(synchronized ? std::make_unique<std::mutex>() : nullptr),
+          parent_(nullptr),
+          cache_(resource) {}
+
+NameTable::NameTable(NameTable &parent, std::pmr::memory_resource *resource)
+        : resource_(resource),
+          names_(resource),
+          parent_(&parent),
+          cache_(resource) {}
+
+NameTable::~NameTable()
+{
+    for (auto name : names_)
+        resource_->deallocate(const_cast<char *>(name.data()), name.size(), 1);
+}
+
+Name NameTable::intern(std::string_view name)
+{
+    if (name.empty())
+        return Name();
+
+    if (parent_) {
+        auto cached = cache_.find(name);
+        if (cached != cache_.end())
+            return cached->second;
+
+        auto interned = parent_->intern(name);
+        cache_.emplace(interned.view(), interned);
+        return interned;
+    }
+
+    std::unique_lock<std::mutex> lock;
+    if (mutex_)
+        lock = std::unique_lock<std::mutex>(*mutex_);
+
+    auto it = names_.find(name);
+    if (it == names_.end()) {
+        auto copy = static_cast<char *>(resource_->allocate(name.size(), 1));
+        std::memcpy(copy, name.data(), name.size());
+        it = names_.emplace(copy, name.size()).first;
+    }
+    return Name(&*it);
+}
+
+std::optional<Name> NameTable::find(std::string_view name) const
+{
+    if (name.empty())
+        return Name();
+
+    // find() doesn't fill the cache, so documents adopting parse_parallel() fragments, whose nodes still
+    // point to front caches, can be queried from several threads like any other document
+    if (parent_) {
+        auto cached = cache_.find(name);
+        if (cached != cache_.end())
+            return cached->second;
+        return parent_->find(name);
+    }
+
+    std::unique_lock<std::mutex> lock;
+    if (mutex_)
+        lock = std::unique_lock<std::mutex>(*mutex_);
+
+    auto it = names_.find(name);
+    if (it == names_.end())
+        return std::nullopt;
+    return Name(&*it);
+}
+
+size_t NameTable::size() const
+{
+    return parent_ ? cache_.size() : names_.size();
+}
+
+void NameTable::set_synchronized(bool synchronized)
+{
+    if (synchronized and not mutex_)
+        mutex_ = std::make_unique<std::mutex>();
+    else if (not synchronized)
+        mutex_.reset();
+}
+
+NameTable &NameTable::shared()
+{
+    static NameTable table(std::pmr::new_delete_resource(), true);
+    return table;
+}
+
+}
+} // namespace XML::DOM
@@ -0,0 +1,104 @@
+#ifndef XML_NAMETABLE_HPP
+#define XML_NAMETABLE_HPP
+
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace XML
+{
+namespace DOM
+{
+
+/// Handle to a name interned by a NameTable. Names interned by the same table are equal
+/// if and only if their handles are, so comparing them is a pointer compare
+class Name
+{
+public:
+    /// Empty name
+    Name() : interned(nullptr) {}
+
+    /// Returns the name as a string view, valid while its table is alive
+    /// \return Name
+    std::string_view view() const { return interned ? *interned : std::string_view(); }
+    operator std::string_view() const { return view(); }
+
+    const char *data() const { return view().data(); }
+    size_t size() const { return view().size(); }
+    bool empty() const { return interned == nullptr; }
+
+    bool operator==(Name other) const { return interned == other.interned; }
+    bool operator!=(Name other) const { return interned != other.interned; }
+
+private:
+    friend class NameTable;
+
+    explicit Name(const std::string_view *interned) : interned(interned) {}
+
+    const std::string_view *interned;
+};
+
+/// Set of element and attribute names. Every Document has one, so each distinct name is stored once
+/// per document no matter how many elements or attributes use it
+class NameTable
+{
+public:
+    /// NameTable constructor
+    /// \param resource Memory resource for the names and the set
+    /// \param synchronized Whether intern() and find() may be called from several threads at once
+    explicit NameTable(std::pmr::memory_resource *resource = std::pmr::get_default_resource(),
+                       bool synchronized = false);
+
+    /// Constructs a front cache for parent. It hands out names of parent, so they compare equal to names
+    /// interned by parent directly, and only goes to parent (locking it if it's synchronized) for names
+    /// it hasn't seen yet. Lets several threads intern into one table without contending on every name
+    /// \param parent Table names are interned in, must outlive this one
+    /// \param resource Memory resource for the cache
+    NameTable(NameTable &parent, std::pmr::memory_resource *resource);
+
+    ~NameTable();
+
+    NameTable(const NameTable&) = delete;
+    NameTable& operator=(const NameTable&) = delete;
+
+    /// Returns the handle of name, adding it to the table if it's not there yet
+    /// \param name Name
+    /// \return Interned name (empty if name is empty)
+    Name intern(std::string_view name);
+
+    /// Returns the handle of name without adding it. Doesn't change the table, so concurrent calls are safe
+    /// while nobody calls intern() even if the table isn't synchronized
+    /// \param name Name
+    /// \return Interned name or nullopt if this table has never seen name
+    std::optional<Name> find(std::string_view name) const;
+
+    /// Returns number of distinct names
+    /// \return Number of names
+    size_t size() const;
+
+    /// Turns locking on or off. Must not be called while other threads use the table
+    /// \param synchronized Whether intern() and find() may be called from several threads at once
+    void set_synchronized(bool synchronized);
+
+    /// Table of nodes that do not belong to any document (i.e. created with new). Names in it are never released
+    /// \return Shared synchronized table
+    static NameTable &shared();
+
+private:
+    std::pmr::memory_resource *resource_;
+    // strings are copied to resource_, set nodes never move so pointers to elements stay valid
+    std::pmr::unordered_set<std::string_view> names_;
+    std::unique_ptr<std::mutex> mutex_;
+    // set for front caches, names_ is unused then
+    NameTable *parent_;
+    std::pmr::unordered_map<std::string_view, Name> cache_;
+};
+
+}
+} // namespace XML::DOM
+
+#endif //XML_NAMETABLE_HPP
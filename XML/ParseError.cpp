@@ -0,0 +1,60 @@
+#include "ParseError.hpp"
+#include "Errors.hpp"
+
+namespace XML
+{
+
+ParseError::operator bool() const
+{
+    return code != Code::NONE;
+}
+
+std::string ParseError::message() const
+{
+    switch (code) {
+        case Code::NONE:
+            return {};
+        case Code::EXPECTED_TOKEN:
+            return "Expected type " + Token::type_name(expected) + ", got " + Token::type_name(found);
+        case Code::UNEXPECTED_TOKEN:
+            return "Unexpected token: " + Token::type_name(found);
+        case Code::UNEXPECTED_TOKEN_AT_TOP_LEVEL:
+            return "Unexpected token " + Token::type_name(found) + " at top level";
+        case Code::UNEXPECTED_SYMBOL:
+            return "Unexpected symbol >";
+        case Code::UNEXPECTED_TAG_CLOSE:
+            return "Unexpected tag close";
+        case Code::NO_ROOT_ELEMENT:
+            return "Input has no root element";
+        case Code::MORE_THAN_ONE_ROOT:
+            return "Document node can't have more than one root element";
+        case Code::MORE_THAN_ONE_DOCTYPE:
+            return "Document node cannot have more than one Doctype";
+        case Code::REPEATED_ATTRIBUTE:
+            return "Element " + std::string(name) + " has repeated attribute " + std::string(attribute);
+        case Code::NESTED_TOO_DEEP:
+            return "Elements are nested deeper than " + std::to_string(limit) + " levels";
+        case Code::UNTERMINATED_REFERENCE:
+            return "Reference is not terminated by ';'";
+        case Code::UNDEFINED_ENTITY:
+            return "Undefined entity: &" + std::string(name.substr(0, 32)) + ";";
+        case Code::EMPTY_CHARACTER_REFERENCE:
+            return "Character reference has no digits";
+        case Code::INVALID_REFERENCE_DIGIT:
+            return "Invalid digit in character reference: " + std::string(name);
+        case Code::REFERENCE_OUT_OF_RANGE:
+            return "Character reference out of range: " + std::string(name);
+        case Code::FORBIDDEN_CHARACTER_REFERENCE:
+            return "Character reference to a character XML doesn't allow: " + std::string(name);
+    }
+    return {};
+}
+
+void ParseError::raise() const
+{
+    if (code == Code::MORE_THAN_ONE_ROOT or code == Code::MORE_THAN_ONE_DOCTYPE)
+        throw DOMError(message());
+    throw SyntaxError(message());
+}
+
+} // namespace XML
@@ -0,0 +1,62 @@
+#ifndef XML_PARSEERROR_HPP
+#define XML_PARSEERROR_HPP
+
+#include <string>
+#include <string_view>
+#include "Token.hpp"
+
+namespace XML
+{
+
+/// Reason the parser rejected its input, returned by Parser::try_parse() and Parser::try_check().
+/// Returning it costs no allocation: the details are a code, a token type or two and views into the input,
+/// the message is only formatted by message(), so the input has to be alive when it's called
+struct ParseError
+{
+    enum class Code
+    {
+        NONE,
+        EXPECTED_TOKEN,                 // expected, found
+        UNEXPECTED_TOKEN,               // found
+        UNEXPECTED_TOKEN_AT_TOP_LEVEL,  // found
+        UNEXPECTED_SYMBOL,              // '>' in content
+        UNEXPECTED_TAG_CLOSE,
+        NO_ROOT_ELEMENT,
+        MORE_THAN_ONE_ROOT,
+        MORE_THAN_ONE_DOCTYPE,
+        REPEATED_ATTRIBUTE,             // name of the element, attribute
+        NESTED_TOO_DEEP,                // limit
+        UNTERMINATED_REFERENCE,
+        UNDEFINED_ENTITY,               // name of the entity
+        EMPTY_CHARACTER_REFERENCE,
+        INVALID_REFERENCE_DIGIT,        // name is the digits
+        REFERENCE_OUT_OF_RANGE,         // name is the digits
+        FORBIDDEN_CHARACTER_REFERENCE   // name is the digits
+    };
+
+    /// Check whether there is an error
+    /// \return True unless code is NONE
+    explicit operator bool() const;
+
+    /// Formats the message parse() throws for this error
+    /// \return Message
+    std::string message() const;
+
+    /// Throws the exception parse() throws for this error: DOMError for a second root element or doctype,
+    /// SyntaxError for everything else
+    [[noreturn]] void raise() const;
+
+    Code code = Code::NONE;
+    /// Offset of the byte in the input the error was found at
+    size_t offset = 0;
+    Token::Type expected = Token::Type::END_OF_FILE;
+    Token::Type found = Token::Type::END_OF_FILE;
+    /// Views into the input
+    std::string_view name;
+    std::string_view attribute;
+    size_t limit = 0;
+};
+
+} // namespace XML
+
+#endif //XML_PARSEERROR_HPP
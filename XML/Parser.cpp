@@ -2,146 +2,426 @@
 // Created by cyborg on 12/8/17.
 //
 
-#include <iostream>
+#include <algorithm>
+#include <thread>
 #include "Parser.hpp"
+#include "Entities.hpp"
+#include "IndexedParser.hpp"
+#include "LazyParser.hpp"
+#include "MappedFile.hpp"
+#include "Scanner.hpp"
 
 namespace XML
 {
 
-void Parser::advance()
+namespace
 {
-    curr_token = peek_token;
-    peek_token = lexer->next_token();
+
+// parse_parallel() doesn't cut the input into pieces smaller than this
+const size_t min_chunk_size = 1 << 20;
+
+/// Where parse_parallel() cuts the content of the root element
+struct RootLayout
+{
+    std::string_view root_name;
+    // offsets of the start tags of root children the content is cut at
+    std::vector<size_t> splits;
+    // offset of the end tag of the root
+    size_t root_close = 0;
+};
+
+/// Pre-scans input for up to parts - 1 start tags of root children spread evenly over the input.
+/// Only tracks nesting, the input is validated by the parser
+/// \return False if the root can't be cut
+bool scan_root(std::string_view input, size_t parts, RootLayout &layout)
+{
+    // prolog, doctype and comments before the root
+    size_t pos = 0;
+    while (true) {
+        pos = Scanner::find(input, pos, '<');
+        if (pos + 1 >= input.size())
+            return false;
+        if (input[pos + 1] != '!' and input[pos + 1] != '?')
+            break;
+        pos = Scanner::skip_special_tag(input, pos);
+    }
+
+    auto name_end = std::min(input.find_first_of(" \t\r\n/>", pos + 1), input.size());
+    layout.root_name = input.substr(pos + 1, name_end - pos - 1);
+
+    bool self_closing = false;
+    pos = Scanner::skip_start_tag(input, pos, self_closing);
+    if (pos >= input.size() or self_closing)
+        return false;
+
+    auto content_begin = pos;
+    auto target = [&](size_t i) { return content_begin + i * (input.size() - content_begin) / parts; };
+
+    size_t depth = 0;
+    while (true) {
+        pos = Scanner::find(input, pos, '<');
+        if (pos + 1 >= input.size())
+            return false;
+
+        auto next = input[pos + 1];
+        if (next == '/') {
+            if (depth == 0) {
+                layout.root_close = pos;
+                return not layout.splits.empty();
+            }
+            depth--;
+            pos = std::min(Scanner::find(input, pos + 2, '>') + 1, input.size());
+        } else if (next == '!' or next == '?') {
+            pos = Scanner::skip_special_tag(input, pos);
+        } else {
+            if (depth == 0 and layout.splits.size() + 1 < parts and pos >= target(layout.splits.size() + 1))
+                layout.splits.push_back(pos);
+            pos = Scanner::skip_start_tag(input, pos, self_closing);
+            if (not self_closing)
+                depth++;
+        }
+    }
+}
+
 }
 
-void Parser::advance(Token::Type expected_type)
+ParseResult::operator bool() const
 {
-    if (peek_token.type == expected_type)
-        advance();
-    else
-        throw SyntaxError("Expected type " + Token::type_name(expected_type) + ", got " + peek_token.name());
+    return not error;
 }
 
+Parser::Parser(size_t max_depth)
+        : document(nullptr), max_depth_(max_depth), engine_(Engine::LEXER), skip_from(nullptr), skip_rest(0),
+          skipped(false) {}
+
 bool Parser::eof()
 {
-    return curr_token.type == Token::Type::END_OF_FILE;
+    return cursor.curr_token.type == Token::Type::END_OF_FILE;
+}
+
+bool Parser::decode(const Token &token, std::string_view &value)
+{
+    if (Entities::try_decode(token.value, decoded, value, cursor.error))
+        return true;
+    cursor.error.offset += token.value.data() - cursor.input.data();
+    return false;
+}
+
+DOM::Document Parser::parse(std::string_view input)
+{
+    auto result = try_parse(input);
+    if (result.error)
+        result.error.raise();
+    return std::move(result.document);
+}
+
+ParseResult Parser::try_parse(std::string_view input)
+{
+    ParseResult result;
+    if (engine_ == Engine::STRUCTURAL_INDEX) {
+        if (IndexedParser(max_depth_).parse(input, result.document))
+            return result;
+        result.document = DOM::Document();
+    }
+
+    // the element being parsed is dropped on error, the top level nodes before it are dropped here
+    if (not parse_document(input, result.document)) {
+        result.error = cursor.error;
+        result.document = DOM::Document();
+    }
+    return result;
+}
+
+DOM::Document Parser::parse_parallel(std::string_view input, size_t threads)
+{
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // the Lexer stops at a NUL byte, in a piece that would only end the piece and the rest would be parsed,
+    // so such input is parsed sequentially like parse_lazy() does
+    RootLayout layout;
+    auto parts = std::min(threads, input.size() / min_chunk_size);
+    if (parts < 2 or input.find('\0') != std::string_view::npos or not scan_root(input, parts, layout))
+        return parse(input);
+
+    DOM::Document document;
+    auto &names = document.name_table();
+    names.set_synchronized(true);
+
+    // every piece after the first goes to its own thread and document, interning into this documents names
+    auto pieces = layout.splits.size();
+    std::vector<DOM::Document> fragments;
+    fragments.reserve(pieces);
+    for (size_t i = 0; i < pieces; i++)
+        fragments.emplace_back(names);
+    std::vector<DOM::Element*> parents(pieces);
+    // not vector<bool>, the threads write their own elements concurrently
+    std::vector<char> parsed(pieces, false);
+
+    bool failed = false;
+    std::vector<std::thread> workers;
+    try {
+        for (size_t i = 0; i < pieces; i++) {
+            auto end = i + 1 < pieces ? layout.splits[i + 1] : layout.root_close;
+            auto piece = input.substr(layout.splits[i], end - layout.splits[i]);
+            workers.emplace_back([&, i, piece] {
+                try {
+                    parents[i] = fragments[i].create_element(layout.root_name);
+                    parsed[i] = Parser(max_depth_).parse_fragment(piece, fragments[i], parents[i]);
+                } catch (...) {}
+            });
+        }
+
+        // meanwhile this thread parses the rest: everything up to the first piece and after the roots content
+        skip_from = input.data() + layout.splits[0];
+        skip_rest = layout.root_close;
+        skipped = false;
+        failed = not parse_document(input, document);
+    } catch (...) {
+        failed = true;
+    }
+    skip_from = nullptr;
+
+    for (auto &worker : workers)
+        worker.join();
+    names.set_synchronized(false);
+
+    // on any error (or if the pre-scan cut the input in the wrong place) the sequential parser has the last word
+    if (failed or not skipped or workers.size() != pieces or
+        not std::all_of(parsed.begin(), parsed.end(), [](char ok) { return ok; }))
+        return parse(input);
+
+    auto root = document.root_element();
+    // the arenas of the fragments have to belong to the document before their nodes are moved into it
+    for (size_t i = 0; i < pieces; i++) {
+        document.adopt(std::move(fragments[i]));
+        root->append_children_of(parents[i]);
+    }
+    return document;
+}
+
+DOM::Document Parser::parse_lazy(std::string_view input)
+{
+    // the Lexer stops at a NUL byte where skipping over elements wouldn't, leave such input to it
+    if (input.find('\0') != std::string_view::npos)
+        return parse(input);
+    return LazyParser::parse(input, max_depth_);
+}
+
+void Parser::check(std::string_view input)
+{
+    auto error = try_check(input);
+    if (error)
+        error.raise();
 }
 
-DOM::Document Parser::parse(const std::string &input)
+ParseError Parser::try_check(std::string_view input)
 {
-    lexer = std::make_unique<Lexer>(input);
-    advance();
-    advance();
+    if (engine_ == Engine::STRUCTURAL_INDEX and IndexedParser(max_depth_).check(input))
+        return {};
 
     DOM::Document document;
+    if (not parse_document(input, document))
+        return cursor.error;
+    return {};
+}
+
+bool Parser::parse_document(std::string_view input, DOM::Document &document)
+{
+    cursor.reset(input);
+    if (not cursor.advance() or not cursor.advance())
+        return false;
+
+    this->document = &document;
+    auto &curr_token = cursor.curr_token;
 
     if (curr_token.type == Token::Type::PI) {
         document.set_xml_prolog(curr_token.value);
-        advance();
+        if (not cursor.advance())
+            return false;
     }
 
     while (not eof()) {
         if (curr_token.type == Token::Type::TAG_BEGIN) {
+            auto root_token = curr_token;
             auto root_element = parse_element();
+            if (not root_element)
+                return false;
+            if (document.root_element())
+                return cursor.fail(ParseError::Code::MORE_THAN_ONE_ROOT, root_token);
             document.append_child(root_element);
-            advance();
         } else if (curr_token.type == Token::Type::DOCTYPE) {
             if (not document.doctype().empty())
-                throw DOMError("Document node cannot have more than one Doctype");
+                return cursor.fail(ParseError::Code::MORE_THAN_ONE_DOCTYPE, curr_token);
             document.set_doctype(curr_token.value);
-            advance();
         } else if (curr_token.type == Token::Type::COMMENT_BEGIN) {
-            document.append_child(parse_comment());
-            advance();
+            std::string_view comment;
+            if (not cursor.read_comment(comment))
+                return false;
+            document.append_child(document.create_comment(comment));
         } else {
-            throw SyntaxError("Unexpected token " + curr_token.name() + " at top level");
+            return cursor.fail(ParseError::Code::UNEXPECTED_TOKEN_AT_TOP_LEVEL, curr_token);
         }
+        if (not cursor.advance())
+            return false;
     }
-
-    return document;
+    return true;
 }
 
 DOM::Element *Parser::parse_element()
 {
-    if (curr_token.type != Token::Type::TAG_BEGIN)
-        throw SyntaxError("Input has no root element");
+    if (cursor.curr_token.type != Token::Type::TAG_BEGIN) {
+        cursor.fail(ParseError::Code::NO_ROOT_ELEMENT, cursor.curr_token);
+        return nullptr;
+    }
 
-    auto elem = new DOM::Element(curr_token.value.substr(1));
+    open_elements.clear();
+    auto root = open_element();
+    if (not root or (not open_elements.empty() and not parse_content(false)))
+        return nullptr;
+    return root;
+}
 
-    while (not eof()) {
-        if (peek_token.type == Token::Type::TAG_END) {
-            advance();
-            break;
-        } else if (peek_token.type == Token::Type::TAG_END_AND_CLOSE) {
-            advance();
-            return elem;
-        }
+bool Parser::parse_fragment(std::string_view input, DOM::Document &document, DOM::Element *parent)
+{
+    cursor.reset(input);
+    if (not cursor.advance())
+        return false;
 
-        advance(Token::Type::ATTRIBUTE_NAME);
-        auto attr_name = curr_token.value;
-        if (elem->has_attribute(attr_name))
-            throw SyntaxError("Element " + elem->name() + " has repeated attribute " + attr_name);
+    this->document = &document;
+    open_elements.assign(1, parent);
+    return parse_content(true);
+}
 
-        advance(Token::Type::EQUAL_SIGN);
+DOM::Element *Parser::open_element()
+{
+    if (open_elements.size() >= max_depth_) {
+        cursor.fail(ParseError::Code::NESTED_TOO_DEEP, cursor.curr_token);
+        cursor.error.limit = max_depth_;
+        return nullptr;
+    }
 
-        advance(Token::Type::ATTRIBUTE_VALUE);
-        auto attr_value = curr_token.value;
+    auto elem = document->create_element(cursor.curr_token.value);
+    if (not open_elements.empty())
+        open_elements.back()->append_child(elem);
 
-        elem->set_attribute(attr_name, attr_value);
-    }
+    bool self_closing;
+    if (not parse_attributes(elem, self_closing))
+        return nullptr;
+    if (not self_closing)
+        open_elements.push_back(elem);
+    return elem;
+}
 
-    while (not eof()) {
-        advance();
+bool Parser::parse_content(bool fragment)
+{
+    auto &curr_token = cursor.curr_token;
+    std::string_view text;
+    while (true) {
+        if (not cursor.advance())
+            return false;
 
+        auto parent = open_elements.back();
         switch (curr_token.type) {
             case Token::Type::TAG_CLOSE: {
-                if (curr_token.value.substr(2, curr_token.value.size() - 3) != elem->name())
-                    throw SyntaxError("Unexpected tag close");
-                return elem;
+                if (fragment and open_elements.size() == 1)
+                    return cursor.fail(ParseError::Code::UNEXPECTED_TAG_CLOSE, curr_token);
+                if (not cursor.check_end_tag(parent->name()))
+                    return false;
+                open_elements.pop_back();
+                if (open_elements.empty())
+                    return true;
+                break;
             }
             case Token::Type::CONTENT: {
-                elem->append_child(new DOM::Text(curr_token.value));
+                if (not decode(curr_token, text))
+                    return false;
+                parent->append_child(document->create_text_node(text));
                 break;
             }
             case Token::Type::TAG_BEGIN: {
-                elem->append_child(parse_element());
+                // children of the root from skip_from on are parsed by parse_parallel() workers
+                if (skip_from and open_elements.size() == 1 and curr_token.value.data() - 1 == skip_from) {
+                    if (not cursor.skip_to(skip_rest))
+                        return false;
+                    skipped = true;
+                    break;
+                }
+                if (not open_element())
+                    return false;
                 break;
             }
             case Token::Type::CDATA_BEGIN: {
-                advance(Token::Type::CDATA);
-                elem->append_child(new DOM::CDATASection(curr_token.value));
-                advance(Token::Type::CDATA_END);
+                if (not cursor.read_cdata(text))
+                    return false;
+                parent->append_child(document->create_cdata_section(text));
                 break;
             }
             case Token::Type::COMMENT_BEGIN: {
-                elem->append_child(parse_comment());
+                if (not cursor.read_comment(text))
+                    return false;
+                parent->append_child(document->create_comment(text));
                 break;
             }
+            case Token::Type::END_OF_FILE: {
+                if (fragment and open_elements.size() == 1)
+                    return true;
+                return cursor.fail(ParseError::Code::UNEXPECTED_TOKEN, curr_token);
+            }
             default:
-                throw SyntaxError("Unexpected token: " + curr_token.name());
+                return cursor.fail(ParseError::Code::UNEXPECTED_TOKEN, curr_token);
         }
     }
-    return nullptr;
 }
 
-DOM::Comment *Parser::parse_comment()
+bool Parser::parse_attributes(DOM::Element *elem, bool &self_closing)
 {
-    std::string comment;
-    while (peek_token.type != Token::Type::COMMENT_END and
-           peek_token.type != Token::Type::END_OF_FILE) {
-        advance(Token::Type::COMMENT);
-        comment += curr_token.value;
-    }
-    advance(Token::Type::COMMENT_END);
-    return new DOM::Comment(comment);
+    std::string_view value;
+    return cursor.read_attributes(self_closing,
+        [elem](std::string_view name) { return elem->has_attribute(name); },
+        [this, elem, &value](std::string_view name, const Token &token) {
+            if (not decode(token, value))
+                return false;
+            elem->set_attribute(name, value);
+            return true;
+        });
+}
+
+size_t Parser::max_depth() const
+{
+    return max_depth_;
+}
+
+void Parser::set_max_depth(size_t max_depth)
+{
+    max_depth_ = max_depth;
 }
 
-DOM::Document Parser::from_string(const std::string &str)
+Parser::Engine Parser::engine() const
+{
+    return engine_;
+}
+
+void Parser::set_engine(Engine engine)
+{
+    engine_ = engine;
+}
+
+DOM::Document Parser::from_string(std::string_view str)
 {
     XML::Parser p;
     return p.parse(str);
 }
 
+DOM::Document Parser::from_file(const std::string &path, size_t threads)
+{
+    MappedFile file(path);
+    XML::Parser p;
+    if (threads == 1)
+        return p.parse(file.view());
+    return p.parse_parallel(file.view(), threads);
+}
+
 } // namespace XML
 
 XML::DOM::Document operator "" _xml(const char* str)
@@ -151,5 +431,5 @@ XML::DOM::Document operator "" _xml(const char* str)
 
 XML::DOM::Document operator "" _xml(const char* str, size_t size)
 {
-    return XML::Parser::from_string(str);
+    return XML::Parser::from_string(std::string_view(str, size));
 }
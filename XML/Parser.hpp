@@ -6,41 +6,171 @@
 #define XML_PARSER_HPP
 
 #include <memory>
+#include <string>
+#include <vector>
 #include "Lexer.hpp"
 #include "DOM.hpp"
 #include "Errors.hpp"
+#include "ParseError.hpp"
+#include "TokenCursor.hpp"
 
 namespace XML
 {
 
+/// Result of Parser::try_parse()
+struct ParseResult
+{
+    /// Check whether input was parsed
+    /// \return True if there is no error
+    explicit operator bool() const;
+
+    /// Parsed document, empty if there is an error
+    DOM::Document document;
+    ParseError error;
+};
+
 class Parser
 {
 public:
-    /// Parses std::string with XML content
+    /// Default limit of element nesting
+    static constexpr size_t default_max_depth = 1000000;
+
+    /// How parse() reads the input
+    enum class Engine {
+        /// Lexer tokens, one byte at a time
+        LEXER,
+        /// SIMD structural index (see IndexedParser), input it can't handle is left to the Lexer
+        STRUCTURAL_INDEX
+    };
+
+    /// Parser constructor
+    /// \param max_depth Maximum element nesting, deeper input is rejected with SyntaxError
+    explicit Parser(size_t max_depth = default_max_depth);
+
+    /// Parses XML content. Input is not copied, tokens are views into it
     /// \param input XML string
     /// \return DOM Document node
-    DOM::Document parse(const std::string &input);
+    DOM::Document parse(std::string_view input);
+
+    /// Parses XML content like parse(), but malformed input is reported in the result instead of thrown,
+    /// so rejecting it costs no unwinding and no message formatting. Only failures to allocate still throw
+    /// \param input XML string, error views point into it
+    /// \return Document, or the error parse() would throw
+    ParseResult try_parse(std::string_view input);
+
+    /// Parses XML content on several threads. The content of the root element is cut between its children
+    /// and the pieces are parsed concurrently into subtrees, which are then attached to the root in order.
+    /// The result is the same as parse() gives, including the error if the input is invalid.
+    /// Each piece is at least 1 MiB, so inputs under 2 MiB, input with a NUL byte and documents whose root can't
+    /// be cut are parsed on the calling thread
+    /// \param input XML string
+    /// \param threads Number of threads, 0 for one per core
+    /// \return DOM Document node
+    DOM::Document parse_parallel(std::string_view input, size_t threads = 0);
+
+    /// Parses XML content into a lazy document. Elements are created from their start tag names, their attributes
+    /// and children are parsed when first accessed (child_nodes(), child_at(), attributes(), text_content() etc.),
+    /// so subtrees that are never visited cost one element each. Errors inside an element are thrown by the access
+    /// that loads it, including elements nested deeper than max_depth(). Loading changes the tree, so a lazy document
+    /// can't be read from several threads. The spans of the elements are found by one scan when the input is parsed
+    /// and loads don't scan them again, so visiting every element costs O(input size) like parse() does, with
+    /// a span kept per element on top. Input with a NUL byte is parsed eagerly, like parse() does
+    /// \param input XML string, copied to the document
+    /// \return DOM Document node
+    DOM::Document parse_lazy(std::string_view input);
+
+    /// Checks that XML content is well-formed without keeping the document
+    /// \param input XML string
+    /// \throws SyntaxError or DOMError, the same parse() throws
+    void check(std::string_view input);
+
+    /// Checks that XML content is well-formed like check(), without throwing on malformed input
+    /// \param input XML string, error views point into it
+    /// \return The error check() would throw, or one that converts to false
+    ParseError try_check(std::string_view input);
 
     /// Static function to parse XML
     /// \param str XML string
     /// \return DOM Document node
-    static DOM::Document from_string(const std::string &str);
+    static DOM::Document from_string(std::string_view str);
+
+    /// Static function to parse XML file. File is memory mapped and lexed in place
+    /// \param path Path to XML file
+    /// \param threads Number of threads (see parse_parallel), 0 for one per core
+    /// \return DOM Document node
+    static DOM::Document from_file(const std::string &path, size_t threads = 1);
+
+    /// Returns maximum element nesting
+    /// \return Maximum depth
+    size_t max_depth() const;
+
+    /// Sets maximum element nesting
+    /// \param max_depth Maximum depth
+    void set_max_depth(size_t max_depth);
+
+    /// Returns engine used by parse() and check()
+    /// \return Engine
+    Engine engine() const;
+
+    /// Sets engine used by parse() and check()
+    /// \param engine Engine
+    void set_engine(Engine engine);
 private:
+    /// Parses input into document
+    /// \param input XML string
+    /// \param document Empty document
+    /// \return False on error, which is then stored in cursor.error
+    bool parse_document(std::string_view input, DOM::Document &document);
+
+    /// Builds the element starting at curr_token and its descendants, without recursion
+    /// \return Element, nullptr on error
     DOM::Element *parse_element();
-    DOM::Comment *parse_comment();
 
-    void advance();
-    /// Advance to next token, if token is not expected_type throw exception
-    /// \param expected_type Expected token type
-    void advance(Token::Type expected_type);
+    /// Parses a sequence of sibling nodes (a piece of the roots content) and appends them to parent
+    /// \param input Sibling nodes
+    /// \param document Document the nodes are created by
+    /// \param parent Element standing in for the root
+    /// \return False on error
+    bool parse_fragment(std::string_view input, DOM::Document &document, DOM::Element *parent);
+
+    /// Creates element for the start tag in curr_token, appends it to the innermost open element
+    /// and opens it unless the tag is self-closing
+    /// \return Element, nullptr on error
+    DOM::Element *open_element();
+
+    /// Reads content of open elements until the outermost one is closed
+    /// \param fragment Whether input is a fragment, which ends with END_OF_FILE while only the parent is open
+    /// \return False on error
+    bool parse_content(bool fragment);
+
+    /// Reads attributes of the start tag of elem
+    /// \param elem Element
+    /// \param self_closing Set to true if the tag is self-closing
+    /// \return False on error
+    bool parse_attributes(DOM::Element *elem, bool &self_closing);
+
+    /// Decodes references in token value, see Entities::try_decode()
+    /// \param token CONTENT or ATTRIBUTE_VALUE token
+    /// \param value Decoded value
+    /// \return False on error
+    bool decode(const Token &token, std::string_view &value);
 
     /// Check whether parser has reached end of file
     /// \return True if eof is reached
     bool eof();
 
-    std::unique_ptr<Lexer> lexer;
-    Token curr_token;
-    Token peek_token;
+    TokenCursor cursor;
+    DOM::Document *document;
+    size_t max_depth_;
+    Engine engine_;
+    // elements whose end tag hasn't been read yet, kept between parses to reuse its buffer
+    std::vector<DOM::Element*> open_elements;
+    // parse_parallel(): root children starting at skip_from are left to workers, lexing resumes at offset skip_rest
+    const char *skip_from;
+    size_t skip_rest;
+    bool skipped;
+    // decoded text and attribute values with references, kept between parses to reuse its buffer
+    std::string decoded;
 };
 
 } // namespace XML
@@ -0,0 +1,567 @@
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include "Lexer.hpp"
+#include "PersistentDocument.hpp"
+
+namespace XML
+{
+
+PersistentNode::PersistentNode(DOM::Node::Type type, std::string_view name, std::string_view value)
+        : type_(type), name_(name), value_(value) {}
+
+PersistentNode::~PersistentNode()
+{
+    // children only this node holds are emptied before they are released, so each destructor runs
+    // on a node without children
+    std::vector<std::shared_ptr<PersistentNode>> pending;
+    children_.release(pending);
+    while (not pending.empty()) {
+        auto node = std::move(pending.back());
+        pending.pop_back();
+        if (node.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            node->children_.release(pending);
+        }
+    }
+}
+
+size_t PersistentNode::ChildList::size() const
+{
+    return ends.empty() ? 0 : ends.back();
+}
+
+bool PersistentNode::ChildList::empty() const
+{
+    return ends.empty();
+}
+
+const std::shared_ptr<PersistentNode> &PersistentNode::ChildList::operator[](size_t index) const
+{
+    auto chunk = chunk_of(index);
+    return (*chunks[chunk])[chunk ? index - ends[chunk - 1] : index];
+}
+
+std::shared_ptr<PersistentNode> &PersistentNode::ChildList::writable(size_t index)
+{
+    auto chunk = chunk_of(index);
+    return unshare(chunk)[chunk ? index - ends[chunk - 1] : index];
+}
+
+void PersistentNode::ChildList::push_back(std::shared_ptr<PersistentNode> child)
+{
+    if (chunks.empty() or chunks.back()->size() >= chunk_capacity) {
+        auto count = size();
+        chunks.push_back(std::make_shared<Chunk>());
+        ends.push_back(count);
+    }
+    unshare(chunks.size() - 1).push_back(std::move(child));
+    ends.back()++;
+}
+
+void PersistentNode::ChildList::insert(size_t index, std::shared_ptr<PersistentNode> child)
+{
+    if (index == size())
+        return push_back(std::move(child));
+
+    auto position = chunk_of(index);
+    auto &chunk = unshare(position);
+    chunk.insert(chunk.begin() + static_cast<std::ptrdiff_t>(position ? index - ends[position - 1] : index),
+                 std::move(child));
+    for (auto i = position; i < ends.size(); i++)
+        ends[i]++;
+
+    // full chunks are split in halves, so every chunk keeps between one and chunk_capacity children
+    if (chunk.size() > chunk_capacity) {
+        auto half = static_cast<std::ptrdiff_t>(chunk.size() / 2);
+        auto tail = std::make_shared<Chunk>(chunk.begin() + half, chunk.end());
+        chunk.erase(chunk.begin() + half, chunk.end());
+        auto end = ends[position];
+        ends[position] -= tail->size();
+        chunks.insert(chunks.begin() + static_cast<std::ptrdiff_t>(position + 1), std::move(tail));
+        ends.insert(ends.begin() + static_cast<std::ptrdiff_t>(position + 1), end);
+    }
+}
+
+void PersistentNode::ChildList::erase(size_t index)
+{
+    auto position = chunk_of(index);
+    auto &chunk = unshare(position);
+    chunk.erase(chunk.begin() + static_cast<std::ptrdiff_t>(position ? index - ends[position - 1] : index));
+    for (auto i = position; i < ends.size(); i++)
+        ends[i]--;
+
+    if (chunk.empty()) {
+        chunks.erase(chunks.begin() + static_cast<std::ptrdiff_t>(position));
+        ends.erase(ends.begin() + static_cast<std::ptrdiff_t>(position));
+    }
+}
+
+void PersistentNode::ChildList::clear()
+{
+    chunks.clear();
+    ends.clear();
+}
+
+void PersistentNode::ChildList::release(std::vector<std::shared_ptr<PersistentNode>> &out)
+{
+    for (auto &chunk : chunks) {
+        if (chunk.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            for (auto &child : *chunk)
+                out.push_back(std::move(child));
+        }
+    }
+    clear();
+}
+
+size_t PersistentNode::ChildList::chunk_of(size_t index) const
+{
+    return static_cast<size_t>(std::upper_bound(ends.begin(), ends.end(), index) - ends.begin());
+}
+
+PersistentNode::ChildList::Chunk &PersistentNode::ChildList::unshare(size_t chunk)
+{
+    // see PersistentDocument::writable()
+    if (chunks[chunk].use_count() != 1)
+        chunks[chunk] = std::make_shared<Chunk>(*chunks[chunk]);
+    else
+        std::atomic_thread_fence(std::memory_order_acquire);
+    return *chunks[chunk];
+}
+
+PersistentNode::Ptr PersistentNode::element(std::string_view name, std::vector<PersistentAttribute> attributes)
+{
+    Lexer::validate_name(name);
+    for (size_t i = 0; i < attributes.size(); i++) {
+        Lexer::validate_name(attributes[i].name);
+        for (size_t j = 0; j < i; j++)
+            if (attributes[j].name == attributes[i].name)
+                throw DOMError("Repeated attribute " + attributes[i].name);
+    }
+
+    std::shared_ptr<PersistentNode> node(new PersistentNode(DOM::Node::Type::ELEMENT_NODE, name, {}));
+    node->attributes_ = std::move(attributes);
+    return node;
+}
+
+PersistentNode::Ptr PersistentNode::text(std::string_view value)
+{
+    return std::shared_ptr<PersistentNode>(new PersistentNode(DOM::Node::Type::TEXT_NODE, {}, value));
+}
+
+PersistentNode::Ptr PersistentNode::cdata_section(std::string_view value)
+{
+    return std::shared_ptr<PersistentNode>(new PersistentNode(DOM::Node::Type::CDATA_SECTION_NODE, {}, value));
+}
+
+PersistentNode::Ptr PersistentNode::comment(std::string_view value)
+{
+    if (value.find("--") != std::string_view::npos)
+        throw SyntaxError("Double hyphen in comments is forbidden");
+    return std::shared_ptr<PersistentNode>(new PersistentNode(DOM::Node::Type::COMMENT_NODE, {}, value));
+}
+
+PersistentNode::Ptr PersistentNode::from_dom(const DOM::Node &node)
+{
+    switch (node.type()) {
+        case DOM::Node::Type::ELEMENT_NODE:
+        case DOM::Node::Type::TEXT_NODE:
+        case DOM::Node::Type::CDATA_SECTION_NODE:
+        case DOM::Node::Type::COMMENT_NODE:
+            return copy_tree(node);
+        default:
+            throw DOMError("Cannot copy nodes of this type");
+    }
+}
+
+std::shared_ptr<PersistentNode> PersistentNode::copy_tree(const DOM::Node &top)
+{
+    auto copy = [](const DOM::Node &node) {
+        std::shared_ptr<PersistentNode> result(new PersistentNode(node.type(), node.name(), node.value()));
+        if (node.type() == DOM::Node::Type::ELEMENT_NODE) {
+            auto &attributes = static_cast<const DOM::Element &>(node).attributes();
+            result->attributes_.reserve(attributes.size());
+            for (auto &attr : attributes)
+                result->attributes_.push_back({std::string(attr.name.view()), std::string(attr.value)});
+        }
+        return result;
+    };
+
+    auto result = copy(top);
+
+    // tree order without recursion, parents holds the copies of the ancestors of node
+    std::vector<PersistentNode *> parents;
+    const DOM::Node *node = &top;
+    PersistentNode *current = result.get();
+    while (true) {
+        if (node->first_child()) {
+            parents.push_back(current);
+            node = node->first_child();
+        } else {
+            while (node != &top and not node->next_sibling()) {
+                node = node->parent_node();
+                parents.pop_back();
+            }
+            if (node == &top)
+                break;
+            node = node->next_sibling();
+        }
+        auto child = copy(*node);
+        current = child.get();
+        parents.back()->children_.push_back(std::move(child));
+    }
+    return result;
+}
+
+DOM::Node::Type PersistentNode::type() const
+{
+    return type_;
+}
+
+std::string_view PersistentNode::name() const
+{
+    return name_;
+}
+
+std::string_view PersistentNode::value() const
+{
+    return value_;
+}
+
+size_t PersistentNode::child_count() const
+{
+    return children_.size();
+}
+
+const PersistentNode &PersistentNode::child_at(size_t index) const
+{
+    return *children_[index];
+}
+
+PersistentNode::Ptr PersistentNode::child(size_t index) const
+{
+    return children_[index];
+}
+
+size_t PersistentNode::attribute_count() const
+{
+    return attributes_.size();
+}
+
+const PersistentAttribute &PersistentNode::attribute_at(size_t index) const
+{
+    return attributes_[index];
+}
+
+std::optional<std::string_view> PersistentNode::find_attribute(std::string_view name) const
+{
+    for (auto &attr : attributes_)
+        if (attr.name == name)
+            return attr.value;
+    return std::nullopt;
+}
+
+std::string PersistentNode::text_content() const
+{
+    if (type_ != DOM::Node::Type::ELEMENT_NODE)
+        return value_;
+
+    if (children_.size() == 1 and children_[0]->type_ == DOM::Node::Type::TEXT_NODE)
+        return children_[0]->value_;
+
+    // tree order without recursion, each entry is a node and the position of its next child
+    std::string buffer;
+    std::vector<std::pair<const PersistentNode *, size_t>> stack{{this, 0}};
+    while (not stack.empty()) {
+        auto &[node, next] = stack.back();
+        if (next == node->children_.size()) {
+            stack.pop_back();
+            continue;
+        }
+        auto child = node->children_[next++].get();
+        if (child->type_ == DOM::Node::Type::TEXT_NODE) {
+            buffer += child->value_;
+            buffer += ' ';
+        }
+        if (not child->children_.empty())
+            stack.emplace_back(child, 0);
+    }
+    return buffer;
+}
+
+PersistentDocument::PersistentDocument()
+        : document_(new PersistentNode(DOM::Node::Type::DOCUMENT_NODE, {}, {})),
+          xml_prolog_(std::make_shared<const std::string>()),
+          doctype_(std::make_shared<const std::string>()) {}
+
+PersistentDocument::PersistentDocument(const DOM::Document &document)
+        : document_(PersistentNode::copy_tree(document)),
+          xml_prolog_(std::make_shared<const std::string>(document.xml_prolog())),
+          doctype_(std::make_shared<const std::string>(document.doctype())) {}
+
+DOM::Document PersistentDocument::to_document() const
+{
+    DOM::Document document;
+    document.set_xml_prolog(*xml_prolog_);
+    document.set_doctype(*doctype_);
+
+    auto create = [&document](const PersistentNode &source) -> DOM::Node * {
+        switch (source.type()) {
+            case DOM::Node::Type::ELEMENT_NODE: {
+                auto element = document.create_element(source.name());
+                for (auto &attr : source.attributes_)
+                    element->set_attribute(attr.name, attr.value);
+                return element;
+            }
+            case DOM::Node::Type::TEXT_NODE:
+                return document.create_text_node(source.value());
+            case DOM::Node::Type::CDATA_SECTION_NODE:
+                return document.create_cdata_section(source.value());
+            default:
+                return document.create_comment(source.value());
+        }
+    };
+
+    // children are created and appended in order when their parent is visited
+    std::vector<std::pair<const PersistentNode *, DOM::Node *>> stack{{document_.get(), &document}};
+    while (not stack.empty()) {
+        auto [source, target] = stack.back();
+        stack.pop_back();
+        source->children_.for_each([&](const std::shared_ptr<PersistentNode> &child) {
+            auto node = create(*child);
+            target->append_child(node);
+            if (not child->children_.empty())
+                stack.emplace_back(child.get(), node);
+        });
+    }
+    return document;
+}
+
+std::string_view PersistentDocument::xml_prolog() const
+{
+    return *xml_prolog_;
+}
+
+std::string_view PersistentDocument::doctype() const
+{
+    return *doctype_;
+}
+
+void PersistentDocument::set_xml_prolog(std::string_view prolog)
+{
+    xml_prolog_ = std::make_shared<const std::string>(prolog);
+}
+
+void PersistentDocument::set_doctype(std::string_view doctype)
+{
+    doctype_ = std::make_shared<const std::string>(doctype);
+}
+
+const PersistentNode &PersistentDocument::document() const
+{
+    return *document_;
+}
+
+const PersistentNode *PersistentDocument::root_element() const
+{
+    for (size_t i = 0, count = document_->children_.size(); i < count; i++)
+        if (document_->children_[i]->type() == DOM::Node::Type::ELEMENT_NODE)
+            return document_->children_[i].get();
+    return nullptr;
+}
+
+const PersistentNode *PersistentDocument::node(const Path &path) const
+{
+    const PersistentNode *node = document_.get();
+    for (auto index : path) {
+        if (index >= node->children_.size())
+            return nullptr;
+        node = node->children_[index].get();
+    }
+    return node;
+}
+
+bool PersistentDocument::same_version(const PersistentDocument &other) const
+{
+    return document_ == other.document_ and xml_prolog_ == other.xml_prolog_ and doctype_ == other.doctype_;
+}
+
+void PersistentDocument::set_attribute(const Path &element, std::string_view name, std::string_view value)
+{
+    if (existing(element).type() != DOM::Node::Type::ELEMENT_NODE)
+        throw DOMError("Only elements have attributes");
+    Lexer::validate_name(name);
+
+    auto &node = writable(element);
+    for (auto &attr : node.attributes_) {
+        if (attr.name == name) {
+            attr.value = value;
+            return;
+        }
+    }
+    node.attributes_.push_back({std::string(name), std::string(value)});
+}
+
+void PersistentDocument::remove_attribute(const Path &element, std::string_view name)
+{
+    auto &source = existing(element);
+    if (source.type() != DOM::Node::Type::ELEMENT_NODE)
+        throw DOMError("Only elements have attributes");
+    // nothing is copied if there is nothing to remove
+    if (not source.find_attribute(name))
+        return;
+
+    auto &attributes = writable(element).attributes_;
+    attributes.erase(std::find_if(attributes.begin(), attributes.end(),
+                                  [name](const PersistentAttribute &attr) { return attr.name == name; }));
+}
+
+void PersistentDocument::append_child(const Path &parent, PersistentNode::Ptr child)
+{
+    check_child(existing(parent), child);
+    writable(parent).children_.push_back(std::const_pointer_cast<PersistentNode>(std::move(child)));
+}
+
+void PersistentDocument::insert_child(const Path &parent, size_t index, PersistentNode::Ptr child)
+{
+    auto &source = existing(parent);
+    check_child(source, child);
+    if (index > source.child_count())
+        throw DOMError("Child index out of range");
+
+    writable(parent).children_.insert(index, std::const_pointer_cast<PersistentNode>(std::move(child)));
+}
+
+void PersistentDocument::remove_child(const Path &parent, size_t index)
+{
+    if (index >= existing(parent).child_count())
+        throw DOMError("Child index out of range");
+
+    writable(parent).children_.erase(index);
+}
+
+void PersistentDocument::set_text_content(const Path &node, std::string_view text)
+{
+    switch (existing(node).type()) {
+        case DOM::Node::Type::DOCUMENT_NODE:
+            throw DOMError("Cannot set text content of the document node");
+        case DOM::Node::Type::ELEMENT_NODE: {
+            auto text_node = std::const_pointer_cast<PersistentNode>(PersistentNode::text(text));
+            auto &children = writable(node).children_;
+            children.clear();
+            children.push_back(std::move(text_node));
+            break;
+        }
+        case DOM::Node::Type::COMMENT_NODE:
+            if (text.find("--") != std::string_view::npos)
+                throw SyntaxError("Double hyphen in comments is forbidden");
+            writable(node).value_ = text;
+            break;
+        default:
+            writable(node).value_ = text;
+    }
+}
+
+const PersistentNode &PersistentDocument::existing(const Path &path) const
+{
+    auto result = node(path);
+    if (result == nullptr)
+        throw DOMError("Path does not name a node");
+    return *result;
+}
+
+PersistentNode &PersistentDocument::writable(const Path &path)
+{
+    // a node no other version or pointer holds can't be seen by anyone else, so it is changed in place.
+    // use_count() is a relaxed load, the fence orders the change after the reads of threads that dropped the node
+    auto unshare = [](std::shared_ptr<PersistentNode> &slot) {
+        if (slot.use_count() != 1)
+            slot = std::shared_ptr<PersistentNode>(new PersistentNode(*slot));
+        else
+            std::atomic_thread_fence(std::memory_order_acquire);
+    };
+
+    auto slot = &document_;
+    unshare(*slot);
+    for (auto index : path) {
+        slot = &(*slot)->children_.writable(index);
+        unshare(*slot);
+    }
+    return **slot;
+}
+
+void PersistentDocument::check_child(const PersistentNode &parent, const PersistentNode::Ptr &child)
+{
+    if (child == nullptr)
+        throw DOMError("Cannot append a null node");
+
+    auto type = child->type();
+    if (parent.type() == DOM::Node::Type::DOCUMENT_NODE) {
+        if (type != DOM::Node::Type::ELEMENT_NODE and type != DOM::Node::Type::COMMENT_NODE)
+            throw DOMError("Document node cannot have child of this type");
+        if (type == DOM::Node::Type::ELEMENT_NODE)
+            for (size_t i = 0, count = parent.child_count(); i < count; i++)
+                if (parent.children_[i]->type() == DOM::Node::Type::ELEMENT_NODE)
+                    throw DOMError("Document node can't have more than one root element");
+    } else if (parent.type() != DOM::Node::Type::ELEMENT_NODE) {
+        throw DOMError("Only elements and the document node can have child nodes");
+    } else if (type == DOM::Node::Type::DOCUMENT_NODE or type == DOM::Node::Type::INVALID_NODE) {
+        throw DOMError("Cannot append nodes of this type");
+    }
+}
+
+DocumentHistory::DocumentHistory(PersistentDocument initial, size_t limit)
+        : current_(std::move(initial)), limit(limit) {}
+
+const PersistentDocument &DocumentHistory::current() const
+{
+    return current_;
+}
+
+void DocumentHistory::commit(PersistentDocument version)
+{
+    undo_.push_back(std::move(current_));
+    if (limit and undo_.size() > limit)
+        undo_.pop_front();
+    current_ = std::move(version);
+    redo_.clear();
+}
+
+bool DocumentHistory::can_undo() const
+{
+    return not undo_.empty();
+}
+
+bool DocumentHistory::can_redo() const
+{
+    return not redo_.empty();
+}
+
+bool DocumentHistory::undo()
+{
+    if (undo_.empty())
+        return false;
+    redo_.push_back(std::move(current_));
+    current_ = std::move(undo_.back());
+    undo_.pop_back();
+    return true;
+}
+
+bool DocumentHistory::redo()
+{
+    if (redo_.empty())
+        return false;
+    undo_.push_back(std::move(current_));
+    current_ = std::move(redo_.back());
+    redo_.pop_back();
+    return true;
+}
+
+void DocumentHistory::clear()
+{
+    undo_.clear();
+    redo_.clear();
+}
+
+} // namespace XML
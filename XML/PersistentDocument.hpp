@@ -0,0 +1,327 @@
+#ifndef XML_PERSISTENTDOCUMENT_HPP
+#define XML_PERSISTENTDOCUMENT_HPP
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DOM.hpp"
+#include "Errors.hpp"
+
+namespace XML
+{
+
+class PersistentDocument;
+
+/// Attribute of a PersistentNode
+struct PersistentAttribute
+{
+    std::string name;
+    std::string value;
+};
+
+/// Immutable node of a PersistentDocument. Nodes know neither their parent nor their position, so one node
+/// can be shared by any number of versions, and every reference to a node stays valid and unchanged as long
+/// as some version or pointer holding it is alive
+class PersistentNode
+{
+public:
+    using Ptr = std::shared_ptr<const PersistentNode>;
+
+    /// Creates an element without children, throws SyntaxError if a name is invalid
+    /// \param name Tag name
+    /// \param attributes Attributes in order, names must be unique
+    /// \return Element
+    static Ptr element(std::string_view name, std::vector<PersistentAttribute> attributes = {});
+
+    /// Creates a text node
+    /// \param value Text, unescaped
+    /// \return Text node
+    static Ptr text(std::string_view value);
+
+    /// Creates a CDATA section
+    /// \param value Content
+    /// \return CDATA section
+    static Ptr cdata_section(std::string_view value);
+
+    /// Creates a comment
+    /// \param value Content
+    /// \return Comment
+    static Ptr comment(std::string_view value);
+
+    /// Copies a DOM subtree. Lazy elements are loaded
+    /// \param node Element, text, CDATA section or comment
+    /// \return Copy of the subtree
+    static Ptr from_dom(const DOM::Node &node);
+
+    /// Destroys the nodes only this one holds without recursion, so deep trees don't overflow the stack
+    ~PersistentNode();
+
+    PersistentNode(const PersistentNode &other) = default;
+    PersistentNode& operator=(const PersistentNode &other) = delete;
+
+    /// Returns this nodes type
+    /// \return Node type
+    DOM::Node::Type type() const;
+
+    /// Returns this nodes name
+    /// \return Node name
+    std::string_view name() const;
+
+    /// Returns this nodes value
+    /// \return Node value
+    std::string_view value() const;
+
+    /// Returns number of children
+    /// \return Number of children
+    size_t child_count() const;
+
+    /// Returns child by position
+    /// \param index Index less than child_count()
+    /// \return Child
+    const PersistentNode &child_at(size_t index) const;
+
+    /// Returns shared pointer to a child, e.g. to insert it into another version without copying it
+    /// \param index Index less than child_count()
+    /// \return Child
+    Ptr child(size_t index) const;
+
+    /// Returns number of attributes
+    /// \return Number of attributes
+    size_t attribute_count() const;
+
+    /// Returns attribute by position
+    /// \param index Index less than attribute_count()
+    /// \return Attribute
+    const PersistentAttribute &attribute_at(size_t index) const;
+
+    /// Returns attribute value by name
+    /// \param name Name of the attribute
+    /// \return Attribute value, nullopt if there is no such attribute
+    std::optional<std::string_view> find_attribute(std::string_view name) const;
+
+    /// Returns text content the way DOM::Node::text_content() does
+    /// \return Text content
+    std::string text_content() const;
+
+private:
+    friend class PersistentDocument;
+
+    PersistentNode(DOM::Node::Type type, std::string_view name, std::string_view value);
+
+    /// Copies a DOM node and its descendants
+    static std::shared_ptr<PersistentNode> copy_tree(const DOM::Node &top);
+
+    /// Children in chunks that are shared like nodes, so copying a node with many children
+    /// copies a pointer per chunk and editing it copies one chunk
+    class ChildList
+    {
+    public:
+        static constexpr size_t chunk_capacity = 64;
+
+        using Chunk = std::vector<std::shared_ptr<PersistentNode>>;
+
+        size_t size() const;
+        bool empty() const;
+
+        /// Returns child by position, O(log(number of chunks))
+        const std::shared_ptr<PersistentNode> &operator[](size_t index) const;
+
+        /// Returns child by position after copying its chunk if it is shared
+        std::shared_ptr<PersistentNode> &writable(size_t index);
+
+        void push_back(std::shared_ptr<PersistentNode> child);
+        void insert(size_t index, std::shared_ptr<PersistentNode> child);
+        void erase(size_t index);
+        void clear();
+
+        /// Calls function with every child in order
+        template<class Function>
+        void for_each(Function function) const
+        {
+            for (auto &chunk : chunks)
+                for (auto &child : *chunk)
+                    function(child);
+        }
+
+        /// Moves the children out of the chunks only this list holds, for the destructor
+        void release(std::vector<std::shared_ptr<PersistentNode>> &out);
+
+    private:
+        /// Returns position of the chunk holding child at index
+        size_t chunk_of(size_t index) const;
+
+        /// Copies chunk if it is shared
+        Chunk &unshare(size_t chunk);
+
+        std::vector<std::shared_ptr<Chunk>> chunks;
+        // ends[i] is the number of children in chunks [0, i]
+        std::vector<size_t> ends;
+    };
+
+    DOM::Node::Type type_;
+    std::string name_;
+    std::string value_;
+    std::vector<PersistentAttribute> attributes_;
+    ChildList children_;
+};
+
+/// Version of a document with structural sharing. Copying a version is O(1) and gives an independent
+/// snapshot: an edit copies the nodes on the path from the edited node up to the document node (and in each
+/// of them the chunk of children holding the next one) and shares the rest with the other versions,
+/// nodes no other version or pointer holds are edited in place.
+///
+/// Nodes are addressed by paths, the positions of the node and its ancestors among their siblings
+/// from the document node down ({} is the document node, {0} its first child).
+/// Nodes are never changed once shared, so different threads can read and edit their own copies of a version
+/// without locking; a single PersistentDocument object is no more thread safe than a std::string
+class PersistentDocument
+{
+public:
+    using Path = std::vector<size_t>;
+
+    /// Creates an empty document
+    PersistentDocument();
+
+    /// Copies a DOM document. Lazy elements are loaded
+    /// \param document Document
+    explicit PersistentDocument(const DOM::Document &document);
+
+    /// Builds a mutable document with the same nodes
+    /// \return Document
+    DOM::Document to_document() const;
+
+    /// Returns XML prolog of the document
+    /// \return XML prolog
+    std::string_view xml_prolog() const;
+
+    /// Returns doctype of the document
+    /// \return Doctype
+    std::string_view doctype() const;
+
+    /// Sets XML prolog of the document
+    /// \param prolog XML prolog
+    void set_xml_prolog(std::string_view prolog);
+
+    /// Sets doctype of the document
+    /// \param doctype Doctype
+    void set_doctype(std::string_view doctype);
+
+    /// Returns the document node
+    /// \return Document node
+    const PersistentNode &document() const;
+
+    /// Returns root element
+    /// \return Root element, nullptr if there is none
+    const PersistentNode *root_element() const;
+
+    /// Returns node by path
+    /// \param path Path to the node
+    /// \return Node, nullptr if there is no such node
+    const PersistentNode *node(const Path &path) const;
+
+    /// Check whether other is this version or a copy of it that wasn't edited since, in O(1)
+    /// \param other Version
+    /// \return True if both versions share the document node
+    bool same_version(const PersistentDocument &other) const;
+
+    // editing, each throws DOMError (or SyntaxError for invalid names) and leaves the version unchanged
+    // if the path doesn't name a fitting node
+
+    /// Replaces value of attribute or appends a new one
+    /// \param element Path to an element
+    /// \param name Name of the attribute
+    /// \param value Value of the attribute
+    void set_attribute(const Path &element, std::string_view name, std::string_view value);
+
+    /// Removes attribute keeping the order of the rest
+    /// \param element Path to an element
+    /// \param name Name of the attribute
+    void remove_attribute(const Path &element, std::string_view name);
+
+    /// Appends child to a node. The child is shared, not copied
+    /// \param parent Path to the document node or an element
+    /// \param child Child
+    void append_child(const Path &parent, PersistentNode::Ptr child);
+
+    /// Inserts child before the child at index. The child is shared, not copied
+    /// \param parent Path to the document node or an element
+    /// \param index Position of the child, at most the number of children
+    /// \param child Child
+    void insert_child(const Path &parent, size_t index, PersistentNode::Ptr child);
+
+    /// Removes child of a node
+    /// \param parent Path to the document node or an element
+    /// \param index Position of the child
+    void remove_child(const Path &parent, size_t index);
+
+    /// Sets text content the way DOM::Node::set_text_content() does: the children of an element
+    /// are replaced by one text node, other nodes get text as value
+    /// \param node Path to a node other than the document node
+    /// \param text Text content
+    void set_text_content(const Path &node, std::string_view text);
+
+private:
+    /// Returns node by path or throws DOMError
+    const PersistentNode &existing(const Path &path) const;
+
+    /// Copies the shared nodes on path and returns the last one, which the caller may change
+    PersistentNode &writable(const Path &path);
+
+    /// Throws DOMError unless child can be a child of parent
+    static void check_child(const PersistentNode &parent, const PersistentNode::Ptr &child);
+
+    std::shared_ptr<PersistentNode> document_;
+    std::shared_ptr<const std::string> xml_prolog_;
+    std::shared_ptr<const std::string> doctype_;
+};
+
+/// Undo and redo over versions of a document, each step holds a version, so memory grows with
+/// what the edits copied rather than with the document size
+class DocumentHistory
+{
+public:
+    /// DocumentHistory constructor
+    /// \param initial Current version
+    /// \param limit Maximal number of versions kept for undo, 0 for no limit
+    explicit DocumentHistory(PersistentDocument initial = {}, size_t limit = 0);
+
+    /// Returns current version
+    /// \return Current version
+    const PersistentDocument &current() const;
+
+    /// Makes version current, the previous one can be restored by undo(). Discards the redo steps
+    /// \param version New version, usually an edited copy of current()
+    void commit(PersistentDocument version);
+
+    /// Check whether there is a version to go back to
+    /// \return True if undo() would change the current version
+    bool can_undo() const;
+
+    /// Check whether there is an undone version
+    /// \return True if redo() would change the current version
+    bool can_redo() const;
+
+    /// Restores the version before the current one
+    /// \return False if there is none
+    bool undo();
+
+    /// Restores the version undone last
+    /// \return False if there is none
+    bool redo();
+
+    /// Discards the undo and redo steps, keeping the current version
+    void clear();
+
+private:
+    PersistentDocument current_;
+    std::deque<PersistentDocument> undo_;
+    std::vector<PersistentDocument> redo_;
+    size_t limit;
+};
+
+} // namespace XML
+
+#endif //XML_PERSISTENTDOCUMENT_HPP
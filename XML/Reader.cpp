@@ -0,0 +1,402 @@
+#include <algorithm>
+#include <functional>
+#include "Reader.hpp"
+#include "Entities.hpp"
+#include "Scanner.hpp"
+
+namespace XML
+{
+
+namespace
+{
+
+/// Thrown when incremental input ends in the middle of a token
+struct InputStarved {};
+
+} // namespace
+
+Reader::Reader()
+{
+    reset();
+}
+
+Reader::Reader(std::string_view input)
+{
+    reset(input);
+}
+
+void Reader::reset(std::string_view input)
+{
+    cursor.reset(input);
+
+    kind_ = Kind::NONE;
+    name_ = {};
+    value_ = {};
+    attributes_.clear();
+    open_names_.clear();
+    open_offsets_.clear();
+    depth_ = 0;
+    started_ = false;
+    primed_ = false;
+    has_root_ = false;
+    has_doctype_ = false;
+    extra_root_ = false;
+    empty_element_ = false;
+    pending_end_ = false;
+    skipping_ = false;
+    skip_pos_ = 0;
+    skip_depth_ = 0;
+    finished_ = true;
+    needs_input_ = false;
+    held_ = false;
+}
+
+void Reader::reset()
+{
+    buffer_.clear();
+    reset(std::string_view(buffer_));
+    finished_ = false;
+}
+
+void Reader::feed(std::string_view chunk)
+{
+    if (finished_)
+        throw Error("Cannot feed input after it was finished");
+
+    // everything before the lookahead token was already reported and can be dropped,
+    // except the content of an element skip_subtree() is or may be called on
+    if (chunk.find('\0') != std::string_view::npos)
+        held_ = true;
+
+    auto &lexer = cursor.lexer;
+    auto &peek_token = cursor.peek_token;
+    auto keep_from = std::min(lexer.position(), buffer_.size());
+    bool keep_skip = skipping_ or (kind_ == Kind::START_ELEMENT and not empty_element_);
+    if (keep_skip)
+        keep_from = std::min(keep_from, skip_pos_);
+    auto peek_offset = std::string::npos;
+    auto peek_data = peek_token.value.data();
+    std::less_equal<const char *> before;
+    if (peek_data and before(buffer_.data(), peek_data) and before(peek_data, buffer_.data() + buffer_.size())) {
+        peek_offset = static_cast<size_t>(peek_data - buffer_.data());
+        keep_from = std::min(keep_from, peek_offset);
+    }
+
+    buffer_.erase(0, keep_from);
+    buffer_.append(chunk);
+
+    if (peek_offset != std::string::npos)
+        peek_token.value = std::string_view(buffer_.data() + peek_offset - keep_from, peek_token.value.size());
+    lexer.resume(buffer_, keep_from);
+    cursor.input = buffer_;
+    if (keep_skip)
+        skip_pos_ -= keep_from;
+    needs_input_ = false;
+}
+
+void Reader::finish()
+{
+    finished_ = true;
+    needs_input_ = false;
+}
+
+bool Reader::needs_input() const
+{
+    return needs_input_;
+}
+
+void Reader::check(bool ok)
+{
+    if (not finished_ and cursor.lexer.hit_end_of_input())
+        throw InputStarved();
+    if (not ok)
+        cursor.error.raise();
+}
+
+bool Reader::next()
+{
+    while (true) {
+        value_ = {};
+        attributes_.clear();
+        empty_element_ = false;
+        needs_input_ = false;
+
+        if (pending_end_) {
+            pending_end_ = false;
+            kind_ = Kind::END_ELEMENT;
+            return true;
+        }
+
+        if (held_ and not finished_) {
+            kind_ = Kind::NONE;
+            needs_input_ = true;
+            return false;
+        }
+
+        auto result = finished_ ? read_next() : read_incremental();
+        if (not extra_root_)
+            return result;
+
+        // like Parser, which rejects a second root once it was parsed, the nodes of a second root are read
+        // without reporting them, so errors inside it come first
+        pending_end_ = false;
+        if (needs_input_)
+            return false;
+        if (open_offsets_.empty())
+            throw DOMError("Document node can't have more than one root element");
+    }
+}
+
+bool Reader::read_incremental()
+{
+    // if a token is cut by the end of input, roll back to the
+    // state after the last complete node and wait for more input
+    auto saved_cursor = cursor;
+    auto saved_started = started_;
+    auto saved_primed = primed_;
+    auto saved_has_root = has_root_;
+    auto saved_has_doctype = has_doctype_;
+    auto saved_extra_root = extra_root_;
+    auto saved_skipping = skipping_;
+
+    try {
+        return read_next();
+    } catch (const InputStarved &) {
+        // the cut token is read again from its start, but its value is only scanned from where this stopped,
+        // and so is the content skip_subtree() scans for the end tag
+        saved_cursor.lexer.keep_scan_progress(cursor.lexer);
+        cursor = saved_cursor;
+        started_ = saved_started;
+        primed_ = saved_primed;
+        has_root_ = saved_has_root;
+        has_doctype_ = saved_has_doctype;
+        extra_root_ = saved_extra_root;
+        skipping_ = saved_skipping;
+
+        kind_ = Kind::NONE;
+        name_ = {};
+        value_ = {};
+        attributes_.clear();
+        empty_element_ = false;
+        needs_input_ = true;
+        return false;
+    }
+}
+
+bool Reader::read_next()
+{
+    name_ = {};
+
+    if (not primed_) {
+        primed_ = true;
+        check(cursor.advance());
+    }
+    if (skipping_)
+        skip_to_end_tag();
+    check(cursor.advance());
+
+    if (open_offsets_.empty())
+        return next_top_level();
+
+    next_content();
+    return true;
+}
+
+bool Reader::next_top_level()
+{
+    bool first = not started_;
+    started_ = true;
+    depth_ = 0;
+
+    auto &curr_token = cursor.curr_token;
+    switch (curr_token.type) {
+        case Token::Type::END_OF_FILE: {
+            kind_ = Kind::NONE;
+            return false;
+        }
+        case Token::Type::PI: {
+            if (not first)
+                check(cursor.fail(ParseError::Code::UNEXPECTED_TOKEN_AT_TOP_LEVEL, curr_token));
+            kind_ = Kind::PROCESSING_INSTRUCTION;
+            value_ = curr_token.value;
+            break;
+        }
+        case Token::Type::TAG_BEGIN: {
+            read_start_tag();
+            extra_root_ = has_root_;
+            has_root_ = true;
+            break;
+        }
+        case Token::Type::DOCTYPE: {
+            if (has_doctype_)
+                check(cursor.fail(ParseError::Code::MORE_THAN_ONE_DOCTYPE, curr_token));
+            has_doctype_ = true;
+            kind_ = Kind::DOCTYPE;
+            value_ = curr_token.value;
+            break;
+        }
+        case Token::Type::COMMENT_BEGIN: {
+            kind_ = Kind::COMMENT;
+            check(cursor.read_comment(value_));
+            break;
+        }
+        default:
+            check(cursor.fail(ParseError::Code::UNEXPECTED_TOKEN_AT_TOP_LEVEL, curr_token));
+    }
+    return true;
+}
+
+void Reader::next_content()
+{
+    depth_ = open_offsets_.size();
+
+    auto &curr_token = cursor.curr_token;
+    switch (curr_token.type) {
+        case Token::Type::TAG_CLOSE: {
+            check(cursor.check_end_tag(open_element()));
+            open_names_.resize(open_offsets_.back());
+            open_offsets_.pop_back();
+            kind_ = Kind::END_ELEMENT;
+            name_ = curr_token.value;
+            depth_ = open_offsets_.size();
+            break;
+        }
+        case Token::Type::CONTENT: {
+            kind_ = Kind::TEXT;
+            value_ = Entities::decode(curr_token.value, decoded_);
+            break;
+        }
+        case Token::Type::TAG_BEGIN: {
+            read_start_tag();
+            break;
+        }
+        case Token::Type::CDATA_BEGIN: {
+            kind_ = Kind::CDATA;
+            check(cursor.read_cdata(value_));
+            break;
+        }
+        case Token::Type::COMMENT_BEGIN: {
+            kind_ = Kind::COMMENT;
+            check(cursor.read_comment(value_));
+            break;
+        }
+        default:
+            check(cursor.fail(ParseError::Code::UNEXPECTED_TOKEN, curr_token));
+    }
+}
+
+void Reader::read_start_tag()
+{
+    kind_ = Kind::START_ELEMENT;
+    name_ = cursor.curr_token.value;
+    depth_ = open_offsets_.size();
+
+    // values are decoded as they are read, so a bad reference is reported before the attributes after it,
+    // like Parser does; their views are made once decoded_ has stopped growing
+    decoded_.clear();
+    decoded_ranges_.clear();
+    check(cursor.read_attributes(empty_element_,
+        [this](std::string_view name) {
+            for (auto &attr : attributes_)
+                if (attr.name == name)
+                    return true;
+            return false;
+        },
+        [this](std::string_view name, const Token &value) {
+            attributes_.push_back({name, value.value});
+            if (not Entities::has_references(value.value))
+                return true;
+            auto begin = decoded_.size();
+            if (not Entities::try_decode_append(value.value, decoded_, cursor.error)) {
+                cursor.error.offset += value.value.data() - cursor.input.data();
+                return false;
+            }
+            decoded_ranges_.push_back({attributes_.size() - 1, begin});
+            return true;
+        }));
+    for (size_t i = 0; i < decoded_ranges_.size(); i++) {
+        auto [index, begin] = decoded_ranges_[i];
+        auto end = i + 1 < decoded_ranges_.size() ? decoded_ranges_[i + 1].second : decoded_.size();
+        attributes_[index].value = std::string_view(decoded_).substr(begin, end - begin);
+    }
+
+    if (empty_element_) {
+        pending_end_ = true;
+    } else {
+        open_offsets_.push_back(open_names_.size());
+        open_names_.append(name_);
+        // curr_token is the '>' of the tag
+        skip_pos_ = cursor.curr_token.value.data() + 1 - cursor.input.data();
+    }
+}
+
+std::string_view Reader::open_element() const
+{
+    return std::string_view(open_names_).substr(open_offsets_.back());
+}
+
+bool Reader::skip_subtree()
+{
+    if (kind_ != Kind::START_ELEMENT)
+        return true;
+
+    // an empty element tag has its END_ELEMENT pending already
+    if (not empty_element_) {
+        skipping_ = true;
+        skip_depth_ = 0;
+    }
+    return next();
+}
+
+void Reader::skip_to_end_tag()
+{
+    auto end = Scanner::find_end_tag(cursor.input, skip_pos_, skip_depth_);
+    if (end == std::string_view::npos) {
+        if (not finished_)
+            throw InputStarved();
+        // the element is not closed, the cursor reports the end of input where its end tag should be
+        end = cursor.input.size();
+    }
+    skipping_ = false;
+    check(cursor.skip_to(end));
+}
+
+Reader::Kind Reader::kind() const
+{
+    return kind_;
+}
+
+std::string_view Reader::name() const
+{
+    return name_;
+}
+
+std::string_view Reader::value() const
+{
+    return value_;
+}
+
+const std::vector<Attribute> &Reader::attributes() const
+{
+    return attributes_;
+}
+
+std::string_view Reader::attribute(std::string_view name) const
+{
+    for (auto &attr : attributes_)
+        if (attr.name == name)
+            return attr.value;
+    return {};
+}
+
+size_t Reader::depth() const
+{
+    return depth_;
+}
+
+bool Reader::is_empty_element() const
+{
+    return empty_element_;
+}
+
+} // namespace XML
@@ -0,0 +1,177 @@
+#ifndef XML_READER_HPP
+#define XML_READER_HPP
+
+#include <utility>
+#include <string_view>
+#include <vector>
+#include "Errors.hpp"
+#include "TokenCursor.hpp"
+
+namespace XML
+{
+
+/// Attribute of a start tag, the name points into the parser input, so does the value unless it had references
+struct Attribute
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+/// Pull parser (cursor) over XML content. Accepts the same documents as Parser and throws the same errors
+/// (it runs the same checks, see TokenCursor), but reports them one node at a time without building a DOM. Example:
+///
+///     XML::Reader r(buffer);
+///     while (r.next()) {
+///         switch (r.kind()) { ... }
+///     }
+///
+/// Every view returned by the reader points into the input and stays valid as long as the input does.
+/// Text and attribute values with references (&amp;, &#38;) are the exception, they are decoded into a buffer
+/// of the reader and valid until the next call to next().
+///
+/// Input can also be passed incrementally. A default constructed reader waits for chunks passed
+/// with feed(), next() returns false with needs_input() set when it ran out of complete nodes, and
+/// finish() marks the end of input. Only the unfinished tail of the input is kept, views returned
+/// in this mode are valid until the next call to feed(). A long text, value, comment or CDATA
+/// section spread over many chunks is searched for its end once, not once per chunk. The lexer
+/// takes a NUL byte for the end of input only where a token starts, so from a chunk with a NUL byte
+/// on nothing is read until finish(), then the rest is read like whole input
+class Reader
+{
+public:
+    enum class Kind
+    {
+        NONE,
+        PROCESSING_INSTRUCTION,
+        DOCTYPE,
+        START_ELEMENT,
+        END_ELEMENT,
+        TEXT,
+        CDATA,
+        COMMENT
+    };
+
+    /// Constructs reader for incremental input passed with feed()
+    Reader();
+
+    /// Reader constructor. Input is not copied
+    /// \param input XML string
+    explicit Reader(std::string_view input);
+
+    /// Restarts reading on new input, keeping allocated buffers
+    /// \param input XML string
+    void reset(std::string_view input);
+
+    /// Restarts reading on incremental input passed with feed(), keeping allocated buffers
+    void reset();
+
+    /// Appends next chunk of incremental input. Chunk is copied
+    /// \param chunk Next part of the document
+    void feed(std::string_view chunk);
+
+    /// Marks the end of incremental input
+    void finish();
+
+    /// Check whether last call to next() returned false because it needs more input
+    /// \return True if feed() or finish() has to be called before reading further
+    bool needs_input() const;
+
+    /// Moves to the next node. Empty element tags produce both START_ELEMENT and END_ELEMENT
+    /// \return False when the whole input was read or more incremental input is needed
+    bool next();
+
+    /// When positioned on START_ELEMENT, moves to the matching END_ELEMENT. The content in between is only
+    /// scanned for the end tag (see Scanner::find_end_tag()), it is neither lexed nor checked.
+    /// If incremental input ends first, the skip is kept and the next call to next() after feed() finishes it.
+    /// Does nothing for other kinds
+    /// \return False if more incremental input is needed, true otherwise
+    bool skip_subtree();
+
+    /// Returns kind of the current node
+    /// \return Node kind
+    Kind kind() const;
+
+    /// Returns tag name for START_ELEMENT and END_ELEMENT, empty view otherwise
+    /// \return Tag name
+    std::string_view name() const;
+
+    /// Returns content of TEXT, CDATA and COMMENT nodes, or the whole
+    /// PROCESSING_INSTRUCTION and DOCTYPE declaration. Empty view otherwise
+    /// \return Node value
+    std::string_view value() const;
+
+    /// Returns attributes of START_ELEMENT in source order, only valid until the next call to next()
+    /// \return Attributes
+    const std::vector<Attribute> &attributes() const;
+
+    /// Returns attribute value by name
+    /// \param name Name of the attribute
+    /// \return Attribute value or empty view if current element has no such attribute
+    std::string_view attribute(std::string_view name) const;
+
+    /// Returns number of elements enclosing the current node (0 for the root element)
+    /// \return Depth
+    size_t depth() const;
+
+    /// Check whether current START_ELEMENT came from an empty element tag (i.e. <tag/>)
+    /// \return True if element is empty
+    bool is_empty_element() const;
+
+private:
+    bool read_next();
+
+    /// Calls read_next() and rolls back if incremental input ends inside a node
+    bool read_incremental();
+    bool next_top_level();
+    void next_content();
+    void read_start_tag();
+
+    /// Moves the cursor to the end tag of the element skip_subtree() was called on
+    void skip_to_end_tag();
+
+    /// Called after every step of the cursor: throws InputStarved if incremental input ended in the last token,
+    /// so the node is read again after feed(), and raises the error of a failed step
+    /// \param ok Result of the step
+    void check(bool ok);
+
+    /// Returns name of the innermost open element
+    std::string_view open_element() const;
+
+    TokenCursor cursor;
+
+    Kind kind_;
+    std::string_view name_;
+    std::string_view value_;
+    std::vector<Attribute> attributes_;
+    // names of open elements are copied, so they survive dropping consumed incremental input
+    std::string open_names_;
+    std::vector<size_t> open_offsets_;
+    size_t depth_;
+    bool started_;
+    bool primed_;
+    bool has_root_;
+    bool has_doctype_;
+    // reading a second root element, which is an error once it was read
+    bool extra_root_;
+    bool empty_element_;
+    bool pending_end_;
+    // skip_subtree() is looking for the end tag. The scan continues at skip_pos_ with skip_depth_ child elements
+    // open there. Until then skip_pos_ is where the content of the last START_ELEMENT begins
+    bool skipping_;
+    size_t skip_pos_;
+    size_t skip_depth_;
+
+    std::string buffer_;
+    // text and attribute values with references are decoded here
+    std::string decoded_;
+    // attributes whose values are in decoded_: index in attributes_ and offset of the value
+    std::vector<std::pair<size_t, size_t>> decoded_ranges_;
+    bool finished_;
+    bool needs_input_;
+    // a chunk had a NUL byte, the rest of the input is read once it is finished
+    bool held_;
+};
+
+} // namespace XML
+
+#endif //XML_READER_HPP
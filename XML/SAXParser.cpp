@@ -0,0 +1,88 @@
+#include "SAXParser.hpp"
+#include "MappedFile.hpp"
+
+namespace XML
+{
+
+SAXParser::SAXParser(Handler &handler) : handler(handler) {}
+
+void SAXParser::parse(std::string_view input)
+{
+    reader.reset(input);
+    streaming = false;
+
+    handler.start_document();
+    dispatch();
+    handler.end_document();
+}
+
+void SAXParser::feed(std::string_view chunk)
+{
+    if (not streaming) {
+        reader.reset();
+        streaming = true;
+        handler.start_document();
+    }
+
+    reader.feed(chunk);
+    dispatch();
+}
+
+void SAXParser::finish()
+{
+    if (not streaming) {
+        reader.reset();
+        handler.start_document();
+    }
+    streaming = false;
+
+    reader.finish();
+    dispatch();
+    handler.end_document();
+}
+
+void SAXParser::dispatch()
+{
+    while (reader.next()) {
+        switch (reader.kind()) {
+            case Reader::Kind::PROCESSING_INSTRUCTION:
+                handler.processing_instruction(reader.value());
+                break;
+            case Reader::Kind::DOCTYPE:
+                handler.doctype(reader.value());
+                break;
+            case Reader::Kind::START_ELEMENT:
+                handler.start_element(reader.name(), reader.attributes());
+                break;
+            case Reader::Kind::END_ELEMENT:
+                handler.end_element(reader.name());
+                break;
+            case Reader::Kind::TEXT:
+                handler.text(reader.value());
+                break;
+            case Reader::Kind::CDATA:
+                handler.cdata(reader.value());
+                break;
+            case Reader::Kind::COMMENT:
+                handler.comment(reader.value());
+                break;
+            case Reader::Kind::NONE:
+                break;
+        }
+    }
+}
+
+void SAXParser::from_string(std::string_view str, Handler &handler)
+{
+    SAXParser p(handler);
+    p.parse(str);
+}
+
+void SAXParser::from_file(const std::string &path, Handler &handler)
+{
+    MappedFile file(path);
+    SAXParser p(handler);
+    p.parse(file.view());
+}
+
+} // namespace XML
@@ -0,0 +1,97 @@
+#ifndef XML_SAXPARSER_HPP
+#define XML_SAXPARSER_HPP
+
+#include <string_view>
+#include <vector>
+#include "Reader.hpp"
+#include "Errors.hpp"
+
+namespace XML
+{
+
+/// Receives parsing events from SAXParser. Every view passed to a callback
+/// points into the parser input and stays valid as long as the input does
+class Handler
+{
+public:
+    virtual ~Handler() = default;
+
+    /// Called once before any other event
+    virtual void start_document() {}
+
+    /// Called once after the whole input was parsed successfully
+    virtual void end_document() {}
+
+    /// Called for XML prolog
+    /// \param value Whole processing instruction including <? and ?>
+    virtual void processing_instruction(std::string_view /*value*/) {}
+
+    /// Called for doctype declaration
+    /// \param value Whole declaration including <! and >
+    virtual void doctype(std::string_view /*value*/) {}
+
+    /// Called for start tags and empty element tags
+    /// \param name Tag name
+    /// \param attributes Attributes in source order, only valid during the call
+    virtual void start_element(std::string_view /*name*/, const std::vector<Attribute> &/*attributes*/) {}
+
+    /// Called for end tags and right after start_element for empty element tags
+    /// \param name Tag name
+    virtual void end_element(std::string_view /*name*/) {}
+
+    /// Called for text content
+    /// \param value Text
+    virtual void text(std::string_view /*value*/) {}
+
+    /// Called for CDATA sections
+    /// \param value Section content
+    virtual void cdata(std::string_view /*value*/) {}
+
+    /// Called for comments
+    /// \param value Comment content
+    virtual void comment(std::string_view /*value*/) {}
+};
+
+/// Event parser that reports document structure to a Handler without building a DOM.
+/// Built on Reader, so it accepts the same documents as Parser and uses memory proportional to nesting depth only
+class SAXParser
+{
+public:
+    /// SAXParser constructor
+    /// \param handler Handler to report events to
+    explicit SAXParser(Handler &handler);
+
+    /// Parses XML content. Input is not copied
+    /// \param input XML string
+    void parse(std::string_view input);
+
+    /// Parses next chunk of incrementally passed input. Events are reported as soon as
+    /// they are complete, their views are only valid during the callback
+    /// \param chunk Next part of the document
+    void feed(std::string_view chunk);
+
+    /// Marks the end of incrementally passed input and reports remaining events
+    void finish();
+
+    /// Static function to parse XML
+    /// \param str XML string
+    /// \param handler Handler to report events to
+    static void from_string(std::string_view str, Handler &handler);
+
+    /// Static function to parse XML file. File is memory mapped and lexed in place
+    /// \param path Path to XML file
+    /// \param handler Handler to report events to
+    static void from_file(const std::string &path, Handler &handler);
+
+private:
+    /// Reports every node available in reader to handler
+    void dispatch();
+
+    Handler &handler;
+    Reader reader;
+    bool streaming{false};
+};
+
+} // namespace XML
+
+#endif //XML_SAXPARSER_HPP
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include "Scanner.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define XML_SCANNER_X86
+#endif
+
+namespace XML
+{
+namespace Scanner
+{
+
+namespace
+{
+
+using FindFunction = size_t (*)(const char *data, size_t size, size_t pos, const char *set, size_t set_size);
+
+size_t find_scalar(const char *data, size_t size, size_t pos, const char *set, size_t set_size)
+{
+    for (auto i = pos; i < size; i++)
+        for (size_t k = 0; k < set_size; k++)
+            if (data[i] == set[k])
+                return i;
+    return size;
+}
+
+#ifdef XML_SCANNER_X86
+
+__attribute__((target("sse2")))
+size_t find_sse2(const char *data, size_t size, size_t pos, const char *set, size_t set_size)
+{
+    __m128i needles[max_set_size];
+    for (size_t k = 0; k < set_size; k++)
+        needles[k] = _mm_set1_epi8(set[k]);
+
+    auto i = pos;
+    for (; i + 16 <= size; i += 16) {
+        auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        auto matches = _mm_cmpeq_epi8(chunk, needles[0]);
+        for (size_t k = 1; k < set_size; k++)
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(chunk, needles[k]));
+        auto mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    return find_scalar(data, size, i, set, set_size);
+}
+
+__attribute__((target("avx2")))
+size_t find_avx2(const char *data, size_t size, size_t pos, const char *set, size_t set_size)
+{
+    __m256i needles[max_set_size];
+    for (size_t k = 0; k < set_size; k++)
+        needles[k] = _mm256_set1_epi8(set[k]);
+
+    auto i = pos;
+    for (; i + 32 <= size; i += 32) {
+        auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        auto matches = _mm256_cmpeq_epi8(chunk, needles[0]);
+        for (size_t k = 1; k < set_size; k++)
+            matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(chunk, needles[k]));
+        auto mask = static_cast<unsigned>(_mm256_movemask_epi8(matches));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    // the compiler tail-calls the SSE code without clearing the upper halves of the registers,
+    // which makes every later SSE instruction pay for the transition
+    _mm256_zeroupper();
+    return find_sse2(data, size, i, set, set_size);
+}
+
+#endif
+
+struct Implementation
+{
+    FindFunction find;
+    const char *name;
+};
+
+Implementation select()
+{
+#ifdef XML_SCANNER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {find_avx2, "avx2"};
+    if (__builtin_cpu_supports("sse2"))
+        return {find_sse2, "sse2"};
+#endif
+    return {find_scalar, "scalar"};
+}
+
+const Implementation &selected()
+{
+    static const Implementation impl = select();
+    return impl;
+}
+
+bool is_name_char(char c)
+{
+    return ('a' <= c and c <= 'z') or ('A' <= c and c <= 'Z') or ('0' <= c and c <= '9') or c == '_' or c == ':';
+}
+
+} // namespace
+
+size_t find_first_of(std::string_view input, size_t pos, std::string_view set)
+{
+    if (pos >= input.size())
+        return input.size();
+    // shorter than a vector, not worth the indirect call and the setup of the needles
+    if (set.empty() or set.size() > max_set_size or input.size() - pos < 16)
+        return find_scalar(input.data(), input.size(), pos, set.data(), set.size());
+    return selected().find(input.data(), input.size(), pos, set.data(), set.size());
+}
+
+size_t find(std::string_view input, size_t pos, char c)
+{
+    return find_first_of(input, pos, std::string_view(&c, 1));
+}
+
+size_t find(std::string_view input, size_t pos, std::string_view substr)
+{
+    if (substr.empty())
+        return pos < input.size() ? pos : input.size();
+
+    while (pos < input.size()) {
+        pos = find(input, pos, substr.front());
+        if (pos == input.size() or input.compare(pos, substr.size(), substr) == 0)
+            return pos;
+        pos++;
+    }
+    return input.size();
+}
+
+size_t skip_start_tag(std::string_view input, size_t pos, bool &self_closing)
+{
+    while (true) {
+        pos = find_first_of(input, pos, "\"'>");
+        if (pos >= input.size())
+            return std::string_view::npos;
+        if (input[pos] == '>') {
+            self_closing = input[pos - 1] == '/';
+            return pos + 1;
+        }
+        pos = find(input, pos + 1, input[pos]);
+        if (pos >= input.size())
+            return std::string_view::npos;
+        pos++;
+    }
+}
+
+size_t skip_special_tag(std::string_view input, size_t pos)
+{
+    size_t end;
+    if (input.compare(pos, 4, "<!--") == 0)
+        end = find(input, pos + 4, "-->") + 3;
+    else if (input.compare(pos, 9, "<![CDATA[") == 0)
+        end = find(input, pos + 9, "]]>") + 3;
+    else
+        end = find(input, pos + 1, '>') + 1;
+    return end > input.size() ? std::string_view::npos : end;
+}
+
+size_t skip_element(std::string_view input, size_t pos)
+{
+    bool self_closing = false;
+    pos = skip_start_tag(input, pos, self_closing);
+    if (pos == std::string_view::npos or self_closing)
+        return pos;
+
+    size_t depth = 0;
+    auto end = find_end_tag(input, pos, depth);
+    if (end == std::string_view::npos)
+        return end;
+    return skip_end_tag(input, end);
+}
+
+size_t skip_end_tag(std::string_view input, size_t pos)
+{
+    // like the Lexer, an end tag is "</", a name and any one character
+    pos += 2;
+    while (pos < input.size() and is_name_char(input[pos]))
+        pos++;
+    return std::min(pos + 1, input.size());
+}
+
+size_t find_end_tag(std::string_view input, size_t &pos, size_t &depth)
+{
+    while (true) {
+        auto begin = find(input, pos, '<');
+        if (begin + 1 >= input.size()) {
+            pos = begin;
+            return std::string_view::npos;
+        }
+
+        auto next = input[begin + 1];
+        size_t end;
+        if (next == '/') {
+            if (depth == 0) {
+                pos = begin;
+                return begin;
+            }
+            // the character after the name belongs to the end tag, so an end tag isn't complete without it
+            end = begin + 2;
+            while (end < input.size() and is_name_char(input[end]))
+                end++;
+            if (end < input.size()) {
+                end++;
+                depth--;
+            } else {
+                end = std::string_view::npos;
+            }
+        } else if (next == '!' or next == '?') {
+            end = skip_special_tag(input, begin);
+        } else {
+            bool self_closing = false;
+            end = skip_start_tag(input, begin, self_closing);
+            if (end != std::string_view::npos and not self_closing)
+                depth++;
+        }
+
+        if (end == std::string_view::npos) {
+            pos = begin;
+            return end;
+        }
+        pos = end;
+    }
+}
+
+const char *implementation()
+{
+    return selected().name;
+}
+
+}
+} // namespace XML::Scanner
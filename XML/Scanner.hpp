@@ -0,0 +1,79 @@
+#ifndef XML_SCANNER_HPP
+#define XML_SCANNER_HPP
+
+#include <string_view>
+
+namespace XML
+{
+namespace Scanner
+{
+
+/// Maximum number of characters in a set passed to find_first_of
+constexpr size_t max_set_size = 4;
+
+/// Vectorized search for the first of up to max_set_size characters.
+/// Uses AVX2 or SSE2 when the CPU supports them (picked once at runtime), scalar code otherwise
+/// \param input Input to scan
+/// \param pos Offset to start scanning from
+/// \param set Characters to look for
+/// \return Offset of the first match or input.size() if there is none
+size_t find_first_of(std::string_view input, size_t pos, std::string_view set);
+
+/// Vectorized search for a single character
+/// \param input Input to scan
+/// \param pos Offset to start scanning from
+/// \param c Character to look for
+/// \return Offset of the first match or input.size() if there is none
+size_t find(std::string_view input, size_t pos, char c);
+
+/// Linear time substring search, scans for the first character of substr with find()
+/// \param input Input to scan
+/// \param pos Offset to start scanning from
+/// \param substr Substring to look for
+/// \return Offset of the first match or input.size() if there is none
+size_t find(std::string_view input, size_t pos, std::string_view substr);
+
+/// Skips a start tag, honoring quoted attribute values. Only finds where markup ends, the input is validated by the parser
+/// \param input Input
+/// \param pos Offset of '<'
+/// \param self_closing Set to whether the tag ends with "/>"
+/// \return Offset after the tag or std::string_view::npos if the input ends inside it
+size_t skip_start_tag(std::string_view input, size_t pos, bool &self_closing);
+
+/// Skips a comment, CDATA section, doctype or processing instruction
+/// \param input Input
+/// \param pos Offset of '<'
+/// \return Offset after it or std::string_view::npos if the input ends inside it
+size_t skip_special_tag(std::string_view input, size_t pos);
+
+/// Skips an element with its descendants, matching end tags to start tags by nesting only.
+/// An end tag is read like the Lexer reads it: "</", a name and any one character
+/// \param input Input
+/// \param pos Offset of '<' of the start tag
+/// \return Offset after the end tag or std::string_view::npos if the input ends inside the element
+size_t skip_element(std::string_view input, size_t pos);
+
+/// Skips an end tag like the Lexer reads it: "</", a name and any one character
+/// \param input Input
+/// \param pos Offset of '<'
+/// \return Offset after the end tag, at most input.size()
+size_t skip_end_tag(std::string_view input, size_t pos);
+
+/// Finds the end tag of an element in its content, matching end tags to start tags by nesting only like
+/// skip_element(). Resumable: on input that ends before the end tag it records where it stopped, so it can
+/// be called again once more input was appended
+/// \param input Input
+/// \param pos Offset to scan from. Set to where the scan has to continue if there is no end tag yet,
+/// which is the end of input or the start of markup cut by it
+/// \param depth Number of child elements open at pos, updated along with pos
+/// \return Offset of '<' of the end tag or std::string_view::npos if the input ends before it
+size_t find_end_tag(std::string_view input, size_t &pos, size_t &depth);
+
+/// Returns name of the implementation picked for this CPU ("avx2", "sse2" or "scalar")
+/// \return Implementation name
+const char *implementation();
+
+}
+} // namespace XML::Scanner
+
+#endif //XML_SCANNER_HPP
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include "Serializer.hpp"
+#include "Scanner.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace XML
+{
+
+namespace
+{
+
+const std::string_view whitespace = " \t\n\r";
+// characters escaped in text and in attribute values
+const std::string_view text_specials = "&<>";
+const std::string_view attribute_specials = "&<\"";
+// indentation is written in pieces of this, so it can be referenced instead of copied
+const std::string_view spaces = "                                                                ";
+
+std::ptrdiff_t write_some(int fd, const char *data, size_t size)
+{
+#ifdef _WIN32
+    return ::_write(fd, data, static_cast<unsigned>(size));
+#else
+    return ::write(fd, data, size);
+#endif
+}
+
+void write_fd(int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        auto written = write_some(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw IOError(std::string("Cannot write output: ") + std::strerror(errno));
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+/// Returns reference written instead of a special character
+std::string_view reference(char c)
+{
+    switch (c) {
+    case '&':
+        return "&amp;";
+    case '<':
+        return "&lt;";
+    case '>':
+        return "&gt;";
+    default:
+        return "&quot;";
+    }
+}
+
+/// Calls f for every line of text with leading whitespace removed, skipping blank lines
+template<class F>
+void for_each_line(std::string_view text, F f)
+{
+    while (not text.empty()) {
+        auto end = text.find('\n');
+        auto line = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+
+        auto first = line.find_first_not_of(whitespace);
+        if (first != std::string_view::npos)
+            f(line.substr(first));
+    }
+}
+
+}
+
+void StreamSink::write(std::string_view data)
+{
+    out.write(data.data(), data.size());
+    if (not out)
+        throw IOError("Cannot write output");
+}
+
+void StreamSink::flush()
+{
+    out.flush();
+}
+
+FileDescriptorSink::FileDescriptorSink(int fd, size_t buffer_size)
+        : fd(fd), buffer(new char[buffer_size]), capacity(buffer_size), used(0) {}
+
+FileDescriptorSink::~FileDescriptorSink()
+{
+    try {
+        flush();
+    } catch (IOError&) {}
+}
+
+void FileDescriptorSink::write(std::string_view data)
+{
+    if (used + data.size() > capacity)
+        flush();
+
+    if (data.size() >= capacity) {
+        write_fully(data.data(), data.size());
+    } else {
+        std::memcpy(buffer.get() + used, data.data(), data.size());
+        used += data.size();
+    }
+}
+
+void FileDescriptorSink::flush()
+{
+    // mark the buffer empty first, so a failed flush isn't repeated by the destructor
+    auto size = used;
+    used = 0;
+    write_fully(buffer.get(), size);
+}
+
+void FileDescriptorSink::write_fully(const char *data, size_t size)
+{
+    write_fd(fd, data, size);
+}
+
+GatherSink::GatherSink() : size_(0) {}
+
+void GatherSink::write(std::string_view data)
+{
+    if (data.empty())
+        return;
+
+    auto copy = static_cast<char *>(copies_.allocate(data.size(), 1));
+    std::memcpy(copy, data.data(), data.size());
+    write_ref(std::string_view(copy, data.size()));
+}
+
+void GatherSink::write_ref(std::string_view data)
+{
+    if (data.empty())
+        return;
+
+    // merge with the previous segment if they are adjacent in memory
+    if (not segments_.empty()) {
+        auto &last = segments_.back();
+        if (last.data() + last.size() == data.data()) {
+            last = std::string_view(last.data(), last.size() + data.size());
+            size_ += data.size();
+            return;
+        }
+    }
+
+    segments_.push_back(data);
+    size_ += data.size();
+}
+
+const std::vector<std::string_view> &GatherSink::segments() const
+{
+    return segments_;
+}
+
+size_t GatherSink::size() const
+{
+    return size_;
+}
+
+void GatherSink::write_to(int fd) const
+{
+#ifdef _WIN32
+    for (auto segment : segments_)
+        write_fd(fd, segment.data(), segment.size());
+#else
+    std::vector<iovec> batch;
+    batch.reserve(std::min<size_t>(segments_.size(), IOV_MAX));
+
+    size_t next = 0;
+    while (next < segments_.size()) {
+        batch.clear();
+        for (auto i = next; i < segments_.size() and batch.size() < IOV_MAX; i++)
+            batch.push_back(iovec{const_cast<char *>(segments_[i].data()), segments_[i].size()});
+
+        auto written = ::writev(fd, batch.data(), static_cast<int>(batch.size()));
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw IOError(std::string("Cannot write output: ") + std::strerror(errno));
+        }
+
+        // skip fully written segments, finish a partially written one with plain writes
+        size_t done = written;
+        while (done > 0 and done >= segments_[next].size())
+            done -= segments_[next++].size();
+        if (done > 0) {
+            write_fd(fd, segments_[next].data() + done, segments_[next].size() - done);
+            next++;
+        }
+    }
+#endif
+}
+
+std::string GatherSink::str() const
+{
+    std::string out;
+    out.reserve(size_);
+    for (auto segment : segments_)
+        out += segment;
+    return out;
+}
+
+Serializer::Serializer(Sink &sink, size_t tab_size) : sink(sink), tab_size(tab_size), minified(false) {}
+
+void Serializer::set_minified(bool minified)
+{
+    this->minified = minified;
+}
+
+void Serializer::write(const DOM::Document &document)
+{
+    if (not document.xml_prolog().empty()) {
+        sink.write_ref(document.xml_prolog());
+        write_line("\n");
+    }
+    if (not document.doctype().empty()) {
+        sink.write_ref(document.doctype());
+        write_line("\n");
+    }
+    for (auto child : document.child_nodes())
+        write(*child, 0);
+}
+
+void Serializer::write(const DOM::Node &node, size_t level)
+{
+    if (node.type() == DOM::Node::Type::DOCUMENT_NODE) {
+        write(static_cast<const DOM::Document &>(node));
+        return;
+    }
+
+    // walk the subtree through parent and sibling links
+    auto curr = &node;
+    while (true) {
+        if (open(*curr, level)) {
+            curr = curr->first_child();
+            level++;
+            continue;
+        }
+
+        while (curr != &node and not curr->next_sibling()) {
+            curr = curr->parent_node();
+            level--;
+            close(*curr, level);
+        }
+        if (curr == &node)
+            break;
+        curr = curr->next_sibling();
+    }
+}
+
+bool Serializer::open(const DOM::Node &node, size_t level)
+{
+    switch (node.type()) {
+    case DOM::Node::Type::ELEMENT_NODE: {
+        auto &element = static_cast<const DOM::Element &>(node);
+        indent(level);
+        sink.write_ref("<");
+        sink.write_ref(element.name());
+        for (auto &attr : element.attributes()) {
+            sink.write_ref(" ");
+            sink.write_ref(attr.name.view());
+            sink.write_ref("=\"");
+            write_escaped(attr.value, attribute_specials);
+            sink.write_ref("\"");
+        }
+
+        auto child = element.first_child();
+        if (not child) {
+            write_line("/>\n");
+            return false;
+        }
+
+        sink.write_ref(">");
+        // an only text child is written on the same line as the tags
+        if (not child->next_sibling() and child->type() == DOM::Node::Type::TEXT_NODE) {
+            write_escaped(child->value(), text_specials);
+            close(element, 0);
+            return false;
+        }
+
+        write_line("\n");
+        return true;
+    }
+    case DOM::Node::Type::TEXT_NODE:
+        write_text(node.value(), level);
+        return false;
+    case DOM::Node::Type::CDATA_SECTION_NODE:
+        indent(level);
+        sink.write_ref("<![CDATA[");
+        write_block(node.value(), level);
+        write_line("]]>\n");
+        return false;
+    case DOM::Node::Type::COMMENT_NODE:
+        indent(level);
+        sink.write_ref("<!--");
+        write_block(node.value(), level);
+        write_line("-->\n");
+        return false;
+    default:
+        return false;
+    }
+}
+
+void Serializer::close(const DOM::Node &node, size_t level)
+{
+    indent(level);
+    sink.write_ref("</");
+    sink.write_ref(node.name());
+    write_line(">\n");
+}
+
+void Serializer::indent(size_t level)
+{
+    if (minified)
+        return;
+    for (auto count = tab_size * level; count > 0;) {
+        auto piece = std::min(count, spaces.size());
+        sink.write_ref(spaces.substr(0, piece));
+        count -= piece;
+    }
+}
+
+void Serializer::write_line(std::string_view text)
+{
+    sink.write_ref(minified ? text.substr(0, text.size() - 1) : text);
+}
+
+void Serializer::write_text(std::string_view text, size_t level)
+{
+    if (minified) {
+        auto first = text.find_first_not_of(whitespace);
+        if (first != std::string_view::npos)
+            write_escaped(text.substr(first, text.find_last_not_of(whitespace) + 1 - first), text_specials);
+        return;
+    }
+
+    for_each_line(text, [&](std::string_view line) {
+        indent(level);
+        write_escaped(line, text_specials);
+        sink.write_ref("\n");
+    });
+}
+
+void Serializer::write_escaped(std::string_view text, std::string_view specials)
+{
+    // runs without special characters are found with a vectorized scan and referenced, not copied
+    size_t pos = 0;
+    while (true) {
+        auto special = Scanner::find_first_of(text, pos, specials);
+        sink.write_ref(text.substr(pos, special - pos));
+        if (special == text.size())
+            return;
+        sink.write_ref(reference(text[special]));
+        pos = special + 1;
+    }
+}
+
+void Serializer::write_block(std::string_view text, size_t level)
+{
+    if (minified) {
+        sink.write_ref(text);
+        return;
+    }
+
+    // the first line continues the start tag
+    auto end = text.find('\n');
+    auto first_line = text.substr(0, end);
+    auto first = first_line.find_first_not_of(whitespace);
+    if (first != std::string_view::npos)
+        sink.write_ref(first_line.substr(first));
+    if (end == std::string_view::npos)
+        return;
+
+    for_each_line(text.substr(end + 1), [&](std::string_view line) {
+        sink.write_ref("\n");
+        indent(level);
+        sink.write_ref(line);
+    });
+}
+
+} // namespace XML
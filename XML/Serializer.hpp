@@ -0,0 +1,183 @@
+#ifndef XML_SERIALIZER_HPP
+#define XML_SERIALIZER_HPP
+
+#include <memory>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DOM.hpp"
+#include "Errors.hpp"
+
+namespace XML
+{
+
+/// Destination of serialized output
+class Sink
+{
+public:
+    virtual ~Sink() = default;
+
+    /// Writes bytes that are only valid during the call
+    /// \param data Bytes to write
+    virtual void write(std::string_view data) = 0;
+
+    /// Writes bytes that stay valid and unchanged for the lifetime of the sink (node strings, literals).
+    /// Gather sinks keep a reference to them instead of copying
+    /// \param data Bytes to write
+    virtual void write_ref(std::string_view data) { write(data); }
+
+    /// Pushes buffered bytes to the destination
+    virtual void flush() {}
+};
+
+/// Appends to a std::string
+class StringSink : public Sink
+{
+public:
+    /// StringSink constructor
+    /// \param out String to append to
+    explicit StringSink(std::string &out) : out(out) {}
+
+    void write(std::string_view data) override { out += data; }
+
+private:
+    std::string &out;
+};
+
+/// Writes to a std::ostream
+class StreamSink : public Sink
+{
+public:
+    /// StreamSink constructor
+    /// \param out Stream to write to
+    explicit StreamSink(std::ostream &out) : out(out) {}
+
+    void write(std::string_view data) override;
+    void flush() override;
+
+private:
+    std::ostream &out;
+};
+
+/// Writes to a file descriptor through a fixed size buffer
+class FileDescriptorSink : public Sink
+{
+public:
+    /// FileDescriptorSink constructor
+    /// \param fd Open file descriptor, not closed by the sink
+    /// \param buffer_size Size of the write buffer
+    explicit FileDescriptorSink(int fd, size_t buffer_size = 64 * 1024);
+
+    /// Flushes the buffer, errors are ignored (call flush() to see them)
+    ~FileDescriptorSink() override;
+
+    FileDescriptorSink(const FileDescriptorSink&) = delete;
+    FileDescriptorSink& operator=(const FileDescriptorSink&) = delete;
+
+    void write(std::string_view data) override;
+
+    /// Writes the buffer out, throws IOError on failure
+    void flush() override;
+
+private:
+    void write_fully(const char *data, size_t size);
+
+    int fd;
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
+    size_t used;
+};
+
+/// Collects output as a list of segments. Segments passed to write_ref() point into the nodes,
+/// only bytes passed to write() are copied. The document must outlive the sink
+class GatherSink : public Sink
+{
+public:
+    GatherSink();
+
+    void write(std::string_view data) override;
+    void write_ref(std::string_view data) override;
+
+    /// Returns segments in output order
+    /// \return Segments
+    const std::vector<std::string_view> &segments() const;
+
+    /// Returns total number of bytes in all segments
+    /// \return Size in bytes
+    size_t size() const;
+
+    /// Writes all segments to a file descriptor (with writev where available), throws IOError on failure
+    /// \param fd Open file descriptor
+    void write_to(int fd) const;
+
+    /// Concatenates all segments
+    /// \return Output as one string
+    std::string str() const;
+
+private:
+    std::vector<std::string_view> segments_;
+    size_t size_;
+    // storage for copied bytes
+    std::pmr::monotonic_buffer_resource copies_;
+};
+
+/// Writes nodes to a Sink in the format of Node::serialize(), walking the tree without recursion
+/// and without building intermediate strings
+class Serializer
+{
+public:
+    /// Serializer constructor
+    /// \param sink Output sink
+    /// \param tab_size Size of one tab in spaces
+    explicit Serializer(Sink &sink, size_t tab_size = 0);
+
+    /// Sets whether output is minified: no line breaks or indentation, text trimmed of surrounding whitespace
+    /// and whitespace-only text dropped, comments and CDATA written as they are
+    /// \param minified True to minify
+    void set_minified(bool minified);
+
+    /// Writes XML prolog, doctype and every child of the document
+    /// \param document Document to write
+    void write(const DOM::Document &document);
+
+    /// Writes node and its descendants
+    /// \param node Node to write
+    /// \param level Indent level of the node
+    void write(const DOM::Node &node, size_t level = 0);
+
+private:
+    /// Writes node, or only its start tag if its children have to follow
+    /// \return True if children have to be written next
+    bool open(const DOM::Node &node, size_t level);
+
+    void close(const DOM::Node &node, size_t level);
+
+    void indent(size_t level);
+
+    /// Writes text that ends with a newline, without the newline if output is minified
+    /// \param text Text ending with '\n'
+    void write_line(std::string_view text);
+
+    /// Writes text node lines with leading whitespace removed, each indented and ended by a newline.
+    /// Blank lines are dropped
+    void write_text(std::string_view text, size_t level);
+
+    /// Writes text replacing special characters with references
+    /// \param text Text
+    /// \param specials Characters to replace ('&', '<', '>' or '"')
+    void write_escaped(std::string_view text, std::string_view specials);
+
+    /// Writes comment or CDATA content the same way, except the first line continues the start tag
+    /// and the others are preceded by a newline
+    void write_block(std::string_view text, size_t level);
+
+    Sink &sink;
+    size_t tab_size;
+    bool minified;
+};
+
+} // namespace XML
+
+#endif //XML_SERIALIZER_HPP
@@ -0,0 +1,564 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include "Snapshot.hpp"
+#include "Lexer.hpp"
+
+namespace XML
+{
+
+namespace
+{
+
+const char magic[8] = {'q', 'O', 'l', 'i', 'v', 'e', 'S', 'n'};
+
+static_assert(sizeof(Snapshot::Header) % 8 == 0, "sections after the header must stay aligned");
+static_assert(sizeof(Snapshot::NodeRecord) == 32, "node records are part of the format");
+static_assert(sizeof(Snapshot::AttributeRecord) == 12, "attribute records are part of the format");
+
+bool little_endian()
+{
+    const uint16_t probe = 1;
+    char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+uint64_t rotate(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/// Checksum of the format: every 8 byte little-endian word of the image (the last one padded with zeroes,
+/// the checksum field counted as zero) is mixed in with xor, a rotation and a multiplication, then the hash
+/// is finalized like splitmix64. A word per step keeps verification far faster than reading the image from disk
+uint64_t checksum(std::string_view image)
+{
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    const size_t checksum_offset = offsetof(Snapshot::Header, checksum);
+    uint64_t hash = image.size() * multiplier;
+    size_t pos = 0;
+    for (; pos + 8 <= image.size(); pos += 8) {
+        uint64_t word = 0;
+        if (pos != checksum_offset)
+            std::memcpy(&word, image.data() + pos, 8);
+        hash = rotate(hash ^ word, 27) * multiplier;
+    }
+    if (pos < image.size()) {
+        uint64_t word = 0;
+        std::memcpy(&word, image.data() + pos, image.size() - pos);
+        hash = rotate(hash ^ word, 27) * multiplier;
+    }
+
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+    return hash ^ (hash >> 31);
+}
+
+size_t align(size_t offset)
+{
+    return (offset + 7) & ~size_t(7);
+}
+
+/// Collects the sections of a snapshot while the document is walked
+class Builder
+{
+public:
+    Snapshot::StringRef add_string(std::string_view value)
+    {
+        if (strings.size() + value.size() > UINT32_MAX)
+            throw IOError("Document is too large for a snapshot");
+        Snapshot::StringRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.size())};
+        strings += value;
+        return ref;
+    }
+
+    uint32_t add_name(std::string_view name)
+    {
+        if (name.empty())
+            return Snapshot::none;
+        auto found = name_indexes.find(name);
+        if (found != name_indexes.end())
+            return found->second;
+        auto index = static_cast<uint32_t>(names.size());
+        names.push_back(add_string(name));
+        name_indexes.emplace(name, index);
+        return index;
+    }
+
+    uint32_t add_node(const DOM::Node &node, uint32_t parent)
+    {
+        if (nodes.size() >= Snapshot::none)
+            throw IOError("Document is too large for a snapshot");
+        auto index = static_cast<uint32_t>(nodes.size());
+
+        Snapshot::NodeRecord record{};
+        record.type = static_cast<uint32_t>(node.type());
+        record.name = add_name(node.name());
+        record.parent = parent;
+        record.first_child = Snapshot::none;
+        record.next_sibling = Snapshot::none;
+        record.first_attribute = static_cast<uint32_t>(attributes.size());
+        record.value = add_string(node.value());
+        nodes.push_back(record);
+
+        if (node.type() == DOM::Node::Type::ELEMENT_NODE) {
+            for (auto &attr : static_cast<const DOM::Element &>(node).attributes())
+                attributes.push_back({add_name(attr.name.view()), add_string(attr.value)});
+        }
+        return index;
+    }
+
+    std::vector<Snapshot::NodeRecord> nodes;
+    std::vector<Snapshot::AttributeRecord> attributes;
+    std::vector<Snapshot::StringRef> names;
+    std::string strings;
+
+private:
+    // names are views into the documents name table
+    std::unordered_map<std::string_view, uint32_t> name_indexes;
+};
+
+template<class T>
+const T *section(std::string_view image, uint64_t offset, uint64_t count)
+{
+    if (offset % 8 != 0 or offset > image.size() or count > (image.size() - offset) / sizeof(T))
+        throw IOError("Invalid snapshot: section out of bounds");
+    return reinterpret_cast<const T *>(image.data() + offset);
+}
+
+}
+
+SnapshotNode::SnapshotNode() : snapshot(nullptr), index_(Snapshot::none) {}
+
+SnapshotNode::SnapshotNode(const Snapshot *snapshot, uint32_t index)
+        : snapshot(index == Snapshot::none ? nullptr : snapshot), index_(index) {}
+
+SnapshotNode::operator bool() const
+{
+    return snapshot != nullptr;
+}
+
+size_t SnapshotNode::index() const
+{
+    return index_;
+}
+
+DOM::Node::Type SnapshotNode::type() const
+{
+    return static_cast<DOM::Node::Type>(snapshot->nodes[index_].type);
+}
+
+std::string_view SnapshotNode::name() const
+{
+    return snapshot->name(snapshot->nodes[index_].name);
+}
+
+std::string_view SnapshotNode::value() const
+{
+    return snapshot->string(snapshot->nodes[index_].value);
+}
+
+SnapshotNode SnapshotNode::parent_node() const
+{
+    return {snapshot, snapshot->nodes[index_].parent};
+}
+
+SnapshotNode SnapshotNode::first_child() const
+{
+    return {snapshot, snapshot->nodes[index_].first_child};
+}
+
+SnapshotNode SnapshotNode::next_sibling() const
+{
+    return {snapshot, snapshot->nodes[index_].next_sibling};
+}
+
+size_t SnapshotNode::attribute_count() const
+{
+    auto end = index_ + 1 < snapshot->header->node_count ? snapshot->nodes[index_ + 1].first_attribute
+                                                         : snapshot->header->attribute_count;
+    return end - snapshot->nodes[index_].first_attribute;
+}
+
+SnapshotAttribute SnapshotNode::attribute_at(size_t index) const
+{
+    auto &record = snapshot->attributes[snapshot->nodes[index_].first_attribute + index];
+    return {snapshot->name(record.name), snapshot->string(record.value)};
+}
+
+std::optional<std::string_view> SnapshotNode::find_attribute(std::string_view name) const
+{
+    for (size_t i = 0, count = attribute_count(); i < count; i++) {
+        auto attr = attribute_at(i);
+        if (attr.name == name)
+            return attr.value;
+    }
+    return std::nullopt;
+}
+
+std::string SnapshotNode::text_content() const
+{
+    if (type() != DOM::Node::Type::ELEMENT_NODE)
+        return std::string(value());
+
+    auto child = first_child();
+    if (child and not child.next_sibling() and child.type() == DOM::Node::Type::TEXT_NODE)
+        return std::string(child.value());
+
+    // descendants follow the node in tree order up to the next sibling of the node or of an ancestor
+    auto end = *this;
+    while (end and not end.next_sibling())
+        end = end.parent_node();
+    auto end_index = end ? end.next_sibling().index_ : snapshot->header->node_count;
+
+    std::string buffer;
+    for (auto i = index_ + 1; i < end_index; i++) {
+        if (snapshot->nodes[i].type == static_cast<uint32_t>(DOM::Node::Type::TEXT_NODE)) {
+            buffer += snapshot->string(snapshot->nodes[i].value);
+            buffer += ' ';
+        }
+    }
+    return buffer;
+}
+
+bool SnapshotNode::operator==(const SnapshotNode &other) const
+{
+    return snapshot == other.snapshot and index_ == other.index_;
+}
+
+bool SnapshotNode::operator!=(const SnapshotNode &other) const
+{
+    return not (*this == other);
+}
+
+std::string Snapshot::create(const DOM::Document &document)
+{
+    Builder builder;
+    auto prolog = builder.add_string(document.xml_prolog());
+    auto doctype = builder.add_string(document.doctype());
+
+    // tree order without recursion, last_children[i] links the children of node i as they come
+    std::vector<uint32_t> last_children;
+    const DOM::Node *node = &document;
+    uint32_t parent = none;
+    while (true) {
+        auto index = builder.add_node(*node, parent);
+        last_children.push_back(none);
+        if (parent != none) {
+            if (last_children[parent] == none)
+                builder.nodes[parent].first_child = index;
+            else
+                builder.nodes[last_children[parent]].next_sibling = index;
+            last_children[parent] = index;
+        }
+
+        if (node->first_child()) {
+            node = node->first_child();
+            parent = index;
+            continue;
+        }
+        while (node != &document and not node->next_sibling()) {
+            node = node->parent_node();
+            parent = builder.nodes[parent].parent;
+        }
+        if (node == &document)
+            break;
+        node = node->next_sibling();
+    }
+
+    Header header{};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = format_version;
+    header.header_size = sizeof(Header);
+    header.node_count = static_cast<uint32_t>(builder.nodes.size());
+    header.attribute_count = static_cast<uint32_t>(builder.attributes.size());
+    header.name_count = static_cast<uint32_t>(builder.names.size());
+    header.nodes = sizeof(Header);
+    header.attributes = align(header.nodes + builder.nodes.size() * sizeof(NodeRecord));
+    header.names = align(header.attributes + builder.attributes.size() * sizeof(AttributeRecord));
+    header.strings = align(header.names + builder.names.size() * sizeof(StringRef));
+    header.strings_size = builder.strings.size();
+    header.size = align(header.strings + builder.strings.size());
+    header.xml_prolog = prolog;
+    header.doctype = doctype;
+
+    std::string image(header.size, '\0');
+    auto copy = [&](uint64_t offset, const void *data, size_t size) {
+        if (size)
+            std::memcpy(&image[offset], data, size);
+    };
+    copy(header.nodes, builder.nodes.data(), builder.nodes.size() * sizeof(NodeRecord));
+    copy(header.attributes, builder.attributes.data(), builder.attributes.size() * sizeof(AttributeRecord));
+    copy(header.names, builder.names.data(), builder.names.size() * sizeof(StringRef));
+    copy(header.strings, builder.strings.data(), builder.strings.size());
+
+    copy(0, &header, sizeof(Header));
+    header.checksum = checksum(image);
+    copy(0, &header, sizeof(Header));
+    return image;
+}
+
+void Snapshot::save(const DOM::Document &document, const std::string &path)
+{
+    auto image = create(document);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (not file)
+        throw IOError("Cannot open file " + path);
+    file.write(image.data(), static_cast<std::streamsize>(image.size()));
+    file.close();
+    if (not file)
+        throw IOError("Cannot write file " + path);
+}
+
+Snapshot Snapshot::open(const std::string &path, bool verify)
+{
+    auto file = std::make_unique<MappedFile>(path);
+    Snapshot snapshot(file->view(), verify);
+    snapshot.file = std::move(file);
+    return snapshot;
+}
+
+Snapshot::Snapshot(std::string_view image, bool verify) : image_(image)
+{
+    if (not little_endian())
+        throw IOError("Snapshots can only be read on little-endian machines");
+    if (reinterpret_cast<uintptr_t>(image.data()) % 8 != 0)
+        throw IOError("Snapshot image is not aligned to 8 bytes");
+    if (image.size() < sizeof(Header) or std::memcmp(image.data(), magic, sizeof(magic)) != 0)
+        throw IOError("Not a snapshot");
+
+    header = reinterpret_cast<const Header *>(image.data());
+    if (header->version != format_version)
+        throw IOError("Unsupported snapshot version " + std::to_string(header->version));
+    if (header->header_size != sizeof(Header) or header->size != image.size())
+        throw IOError("Invalid snapshot: wrong size");
+
+    nodes = section<NodeRecord>(image, header->nodes, header->node_count);
+    attributes = section<AttributeRecord>(image, header->attributes, header->attribute_count);
+    names = section<StringRef>(image, header->names, header->name_count);
+    strings = section<char>(image, header->strings, header->strings_size);
+    if (header->node_count == 0 or nodes[0].type != static_cast<uint32_t>(DOM::Node::Type::DOCUMENT_NODE))
+        throw IOError("Invalid snapshot: no document node");
+
+    if (verify) {
+        if (checksum(image) != header->checksum)
+            throw IOError("Invalid snapshot: checksum mismatch");
+        verify_records();
+    }
+}
+
+Snapshot::Snapshot(Snapshot&& other) noexcept = default;
+
+Snapshot& Snapshot::operator=(Snapshot&& other) noexcept = default;
+
+void Snapshot::verify_records() const
+{
+    auto check_string = [this](StringRef ref) {
+        if (ref.offset > header->strings_size or ref.size > header->strings_size - ref.offset)
+            throw IOError("Invalid snapshot: string out of bounds");
+    };
+    auto check_name = [this](uint32_t name) {
+        if (name != none and name >= header->name_count)
+            throw IOError("Invalid snapshot: name out of bounds");
+    };
+
+    check_string(header->xml_prolog);
+    check_string(header->doctype);
+    for (uint32_t i = 0; i < header->name_count; i++) {
+        check_string(names[i]);
+        // to_document() sets them on elements, which validates them
+        try {
+            Lexer::validate_name(string(names[i]));
+        } catch (SyntaxError &) {
+            throw IOError("Invalid snapshot: invalid name");
+        }
+    }
+    for (uint32_t i = 0; i < header->attribute_count; i++) {
+        if (attributes[i].name == none)
+            throw IOError("Invalid snapshot: attribute without name");
+        check_name(attributes[i].name);
+        check_string(attributes[i].value);
+    }
+
+    // links have to follow tree order, so walks over them always end
+    const auto element = static_cast<uint32_t>(DOM::Node::Type::ELEMENT_NODE);
+    const auto comment = static_cast<uint32_t>(DOM::Node::Type::COMMENT_NODE);
+    const auto document = static_cast<uint32_t>(DOM::Node::Type::DOCUMENT_NODE);
+    // whether a first_child or next_sibling link leads to the node, each but the document node needs exactly one
+    std::vector<char> linked(header->node_count, false);
+    auto link = [&](uint32_t target, uint32_t parent) {
+        if (target == none)
+            return;
+        if (linked[target] or nodes[target].parent != parent)
+            throw IOError("Invalid snapshot: broken tree");
+        linked[target] = true;
+    };
+    uint32_t root_elements = 0;
+    std::vector<uint32_t> attribute_names;
+    for (uint32_t i = 0; i < header->node_count; i++) {
+        auto &node = nodes[i];
+        if (node.type < element or node.type > document or (node.type == document) != (i == 0))
+            throw IOError("Invalid snapshot: wrong node type");
+        if ((i == 0) != (node.parent == none) or (node.parent != none and node.parent >= i) or
+            (node.first_child != none and (node.first_child != i + 1 or node.first_child >= header->node_count)) or
+            (node.next_sibling != none and (node.next_sibling <= i or node.next_sibling >= header->node_count)))
+            throw IOError("Invalid snapshot: broken tree");
+        // only elements and the document have children, the document at most one element and no text
+        if (i != 0) {
+            auto parent_type = nodes[node.parent].type;
+            if (parent_type != element and parent_type != document)
+                throw IOError("Invalid snapshot: broken tree");
+            if (parent_type == document and node.type != element and node.type != comment)
+                throw IOError("Invalid snapshot: wrong child of the document");
+            if (parent_type == document and node.type == element and ++root_elements > 1)
+                throw IOError("Invalid snapshot: wrong child of the document");
+        }
+        link(node.first_child, i);
+        if (i != 0)
+            link(node.next_sibling, node.parent);
+        else if (node.next_sibling != none)
+            throw IOError("Invalid snapshot: broken tree");
+
+        // only elements own the attributes up to the next nodes first one
+        auto end = i + 1 < header->node_count ? nodes[i + 1].first_attribute : header->attribute_count;
+        if ((i == 0 and node.first_attribute != 0) or end < node.first_attribute or end > header->attribute_count or
+            (node.type != element and end != node.first_attribute))
+            throw IOError("Invalid snapshot: attributes out of order");
+        check_name(node.name);
+        check_string(node.value);
+        // what Comment::set_text_content() would throw in to_document()
+        if (node.type == comment and string(node.value).find("--") != std::string_view::npos)
+            throw IOError("Invalid snapshot: double hyphen in comment");
+        // only elements have names, and only text, CDATA sections and comments values
+        if ((node.type == element) != (node.name != none) or
+            ((node.type == element or node.type == document) and node.value.size != 0))
+            throw IOError("Invalid snapshot: wrong node name or value");
+
+        // to_document() would merge repeated attributes
+        attribute_names.clear();
+        for (auto a = node.first_attribute; a < end; a++)
+            attribute_names.push_back(attributes[a].name);
+        std::sort(attribute_names.begin(), attribute_names.end());
+        if (std::adjacent_find(attribute_names.begin(), attribute_names.end()) != attribute_names.end())
+            throw IOError("Invalid snapshot: repeated attribute");
+    }
+
+    // every node but the document has to be in the sibling chain of its parent
+    for (uint32_t i = 1; i < header->node_count; i++)
+        if (not linked[i])
+            throw IOError("Invalid snapshot: broken tree");
+}
+
+std::string_view Snapshot::string(StringRef ref) const
+{
+    return std::string_view(strings + ref.offset, ref.size);
+}
+
+std::string_view Snapshot::name(uint32_t index) const
+{
+    return index == none ? std::string_view() : string(names[index]);
+}
+
+std::string_view Snapshot::xml_prolog() const
+{
+    return string(header->xml_prolog);
+}
+
+std::string_view Snapshot::doctype() const
+{
+    return string(header->doctype);
+}
+
+SnapshotNode Snapshot::document() const
+{
+    return {this, 0};
+}
+
+SnapshotNode Snapshot::root_element() const
+{
+    for (auto child = document().first_child(); child; child = child.next_sibling()) {
+        if (child.type() == DOM::Node::Type::ELEMENT_NODE)
+            return child;
+    }
+    return {};
+}
+
+size_t Snapshot::size() const
+{
+    return header->node_count;
+}
+
+SnapshotNode Snapshot::node(size_t index) const
+{
+    return {this, static_cast<uint32_t>(index)};
+}
+
+std::vector<SnapshotNode> Snapshot::get_elements_by_tag_name(std::string_view tag_name) const
+{
+    std::vector<SnapshotNode> elements;
+    uint32_t name_index = none;
+    for (uint32_t i = 0; i < header->name_count; i++) {
+        if (string(names[i]) == tag_name) {
+            name_index = i;
+            break;
+        }
+    }
+    if (name_index == none)
+        return elements;
+
+    for (uint32_t i = 0; i < header->node_count; i++) {
+        if (nodes[i].name == name_index and nodes[i].type == static_cast<uint32_t>(DOM::Node::Type::ELEMENT_NODE))
+            elements.push_back({this, i});
+    }
+    return elements;
+}
+
+DOM::Document Snapshot::to_document() const
+{
+    DOM::Document document;
+    document.set_xml_prolog(xml_prolog());
+    document.set_doctype(doctype());
+
+    // parents come before their children in tree order
+    std::vector<DOM::Node *> created(header->node_count);
+    created[0] = &document;
+    for (uint32_t i = 1; i < header->node_count; i++) {
+        SnapshotNode source(this, i);
+        DOM::Node *node = nullptr;
+        switch (source.type()) {
+            case DOM::Node::Type::ELEMENT_NODE: {
+                auto element = document.create_element(source.name());
+                for (size_t a = 0, count = source.attribute_count(); a < count; a++) {
+                    auto attr = source.attribute_at(a);
+                    element->set_attribute(attr.name, attr.value);
+                }
+                node = element;
+                break;
+            }
+            case DOM::Node::Type::TEXT_NODE:
+                node = document.create_text_node(source.value());
+                break;
+            case DOM::Node::Type::CDATA_SECTION_NODE:
+                node = document.create_cdata_section(source.value());
+                break;
+            case DOM::Node::Type::COMMENT_NODE:
+                node = document.create_comment(source.value());
+                break;
+            default:
+                throw IOError("Invalid snapshot: wrong node type");
+        }
+        created[i] = node;
+        created[nodes[i].parent]->append_child(node);
+    }
+    return document;
+}
+
+std::string_view Snapshot::image() const
+{
+    return image_;
+}
+
+} // namespace XML
@@ -0,0 +1,251 @@
+#ifndef XML_SNAPSHOT_HPP
+#define XML_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DOM.hpp"
+#include "Errors.hpp"
+#include "MappedFile.hpp"
+
+namespace XML
+{
+
+class Snapshot;
+
+/// Attribute of an element in a snapshot
+struct SnapshotAttribute
+{
+    std::string_view name;
+    std::string_view value;
+};
+
+/// Handle of a node in a Snapshot, valid as long as the snapshot is neither destroyed nor moved.
+/// Null handles convert to false
+class SnapshotNode
+{
+public:
+    SnapshotNode();
+
+    /// Check whether this handle points to a node
+    /// \return True unless null
+    explicit operator bool() const;
+
+    /// Returns position of this node in tree order, the document is 0
+    /// \return Index
+    size_t index() const;
+
+    /// Returns this nodes type
+    /// \return Node type
+    DOM::Node::Type type() const;
+
+    /// Returns this nodes name
+    /// \return View into the snapshot
+    std::string_view name() const;
+
+    /// Returns this nodes value
+    /// \return View into the snapshot
+    std::string_view value() const;
+
+    /// Returns parent, null for the document
+    /// \return Parent
+    SnapshotNode parent_node() const;
+
+    /// Returns first child, null if there are no children
+    /// \return First child
+    SnapshotNode first_child() const;
+
+    /// Returns next sibling, null for the last child
+    /// \return Next sibling
+    SnapshotNode next_sibling() const;
+
+    /// Returns number of attributes
+    /// \return Number of attributes
+    size_t attribute_count() const;
+
+    /// Returns attribute by position in source order
+    /// \param index Index less than attribute_count()
+    /// \return Attribute
+    SnapshotAttribute attribute_at(size_t index) const;
+
+    /// Returns attribute value by name
+    /// \param name Name of the attribute
+    /// \return View into the snapshot, nullopt if there is no such attribute
+    std::optional<std::string_view> find_attribute(std::string_view name) const;
+
+    /// Returns text content the way DOM::Node::text_content() does
+    /// \return Text content
+    std::string text_content() const;
+
+    bool operator==(const SnapshotNode &other) const;
+    bool operator!=(const SnapshotNode &other) const;
+
+private:
+    friend class Snapshot;
+
+    SnapshotNode(const Snapshot *snapshot, uint32_t index);
+
+    const Snapshot *snapshot;
+    uint32_t index_;
+};
+
+/// Read-only binary image of a Document that is queried in place, e.g. straight from a memory mapped file
+/// or a shared memory segment, so loading it costs a validation pass instead of a parse, and processes
+/// mapping the same file share its pages.
+///
+/// Layout, little-endian, every section aligned to 8 bytes:
+///  - Header: magic, format version, total size, checksum of the whole image,
+///    counts and offsets of the sections, prolog and doctype
+///  - nodes in tree order, the document first: type, name, parent, first child, next sibling,
+///    first attribute (the attributes of a node end where the next nodes begin) and value
+///  - attributes: name and value
+///  - names: every distinct element and attribute name, referenced by index
+///  - strings: bytes of names and values, referenced by offset and size
+/// References between records are indices, so the image can be mapped anywhere
+class Snapshot
+{
+public:
+    /// Version written to new snapshots, others are rejected
+    static constexpr uint32_t format_version = 1;
+
+    /// Builds the snapshot image of document. Lazy elements are loaded
+    /// \param document Document
+    /// \return Image
+    static std::string create(const DOM::Document &document);
+
+    /// Writes the snapshot image of document to a file, throws IOError on failure
+    /// \param document Document
+    /// \param path Path to the file
+    static void save(const DOM::Document &document, const std::string &path);
+
+    /// Maps a snapshot file and checks it (see Snapshot(std::string_view, bool))
+    /// \param path Path to the file
+    /// \param verify Whether the checksum and the records are checked
+    /// \return Snapshot
+    static Snapshot open(const std::string &path, bool verify = true);
+
+    /// Snapshot of an image in memory, which is not copied. Throws IOError if the image is not a snapshot
+    /// of this version. With verify it also compares the checksum and checks every record, which reads the
+    /// whole image once; without it only the header is checked, for images that were verified before
+    /// (e.g. by the process that filled a shared memory segment) and come from a trusted source
+    /// \param image Image, aligned to 8 bytes, must outlive the snapshot
+    /// \param verify Whether the checksum and the records are checked
+    explicit Snapshot(std::string_view image, bool verify = true);
+
+    /// The image is not copied, so it can't be a temporary
+    explicit Snapshot(std::string &&image, bool verify = true) = delete;
+
+    Snapshot(Snapshot&& other) noexcept;
+    Snapshot& operator=(Snapshot&& other) noexcept;
+
+    /// Returns XML prolog of the document
+    /// \return View into the snapshot
+    std::string_view xml_prolog() const;
+
+    /// Returns doctype of the document
+    /// \return View into the snapshot
+    std::string_view doctype() const;
+
+    /// Returns the document node
+    /// \return Document node
+    SnapshotNode document() const;
+
+    /// Returns root element, null if there is none
+    /// \return Root element
+    SnapshotNode root_element() const;
+
+    /// Returns number of nodes, the document included
+    /// \return Number of nodes
+    size_t size() const;
+
+    /// Returns node by position in tree order
+    /// \param index Index less than size()
+    /// \return Node
+    SnapshotNode node(size_t index) const;
+
+    /// Returns elements with tag name in tree order, with a scan of the node records
+    /// \param tag_name Tag name
+    /// \return Elements
+    std::vector<SnapshotNode> get_elements_by_tag_name(std::string_view tag_name) const;
+
+    /// Builds a mutable document with the same nodes
+    /// \return Document
+    DOM::Document to_document() const;
+
+    /// Returns the image
+    /// \return Image
+    std::string_view image() const;
+
+    /// Reference to bytes in the strings section
+    struct StringRef
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t header_size;
+        uint64_t size;
+        uint64_t checksum;
+        uint32_t node_count;
+        uint32_t attribute_count;
+        uint32_t name_count;
+        uint32_t reserved;
+        uint64_t nodes;
+        uint64_t attributes;
+        uint64_t names;
+        uint64_t strings;
+        uint64_t strings_size;
+        StringRef xml_prolog;
+        StringRef doctype;
+    };
+
+    struct NodeRecord
+    {
+        // value of DOM::Node::Type
+        uint32_t type;
+        uint32_t name;
+        uint32_t parent;
+        uint32_t first_child;
+        uint32_t next_sibling;
+        uint32_t first_attribute;
+        StringRef value;
+    };
+
+    struct AttributeRecord
+    {
+        uint32_t name;
+        StringRef value;
+    };
+
+    /// Index of no node or no name
+    static constexpr uint32_t none = UINT32_MAX;
+
+private:
+    friend class SnapshotNode;
+
+    /// Checks every record, so accessors can trust indices and string references and to_document()
+    /// builds the tree the links describe without throwing
+    void verify_records() const;
+
+    std::string_view string(StringRef ref) const;
+    std::string_view name(uint32_t index) const;
+
+    std::unique_ptr<MappedFile> file;
+    std::string_view image_;
+    const Header *header;
+    const NodeRecord *nodes;
+    const AttributeRecord *attributes;
+    const StringRef *names;
+    const char *strings;
+};
+
+} // namespace XML
+
+#endif //XML_SNAPSHOT_HPP
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include "StructuralIndex.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define XML_INDEX_X86
+#endif
+
+namespace XML
+{
+
+namespace
+{
+
+/// Writes offsets of structural characters of data to out
+/// \return Number of offsets written, nul is set if data has a NUL byte
+using IndexFunction = size_t (*)(const char *data, size_t size, uint32_t *out, bool &nul);
+
+bool is_structural(char c)
+{
+    return c == '<' or c == '>' or c == '"' or c == '\'';
+}
+
+size_t index_scalar_from(const char *data, size_t size, size_t pos, uint32_t *out, size_t count, bool &nul)
+{
+    for (auto i = pos; i < size; i++) {
+        if (is_structural(data[i]))
+            out[count++] = static_cast<uint32_t>(i);
+        else if (data[i] == 0)
+            nul = true;
+    }
+    return count;
+}
+
+size_t index_scalar(const char *data, size_t size, uint32_t *out, bool &nul)
+{
+    return index_scalar_from(data, size, 0, out, 0, nul);
+}
+
+/// Appends the offsets of the set bits of a 64 byte block mask
+inline size_t flatten(uint64_t mask, size_t base, uint32_t *out, size_t count)
+{
+    while (mask) {
+        out[count++] = static_cast<uint32_t>(base + __builtin_ctzll(mask));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+#ifdef XML_INDEX_X86
+
+__attribute__((target("sse2")))
+size_t index_sse2(const char *data, size_t size, uint32_t *out, bool &nul)
+{
+    auto lt = _mm_set1_epi8('<');
+    auto gt = _mm_set1_epi8('>');
+    auto quote = _mm_set1_epi8('"');
+    auto apostrophe = _mm_set1_epi8('\'');
+    auto zero = _mm_setzero_si128();
+
+    size_t count = 0;
+    uint64_t nul_mask = 0;
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        uint64_t mask = 0;
+        for (int k = 0; k < 4; k++) {
+            auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 16 * k));
+            auto matches = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, lt), _mm_cmpeq_epi8(chunk, gt)),
+                                        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, apostrophe)));
+            mask |= static_cast<uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(matches))) << (16 * k);
+            nul_mask |= static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, zero)));
+        }
+        count = flatten(mask, i, out, count);
+    }
+    if (nul_mask)
+        nul = true;
+    return index_scalar_from(data, size, i, out, count, nul);
+}
+
+__attribute__((target("avx2")))
+size_t index_avx2(const char *data, size_t size, uint32_t *out, bool &nul)
+{
+    auto lt = _mm256_set1_epi8('<');
+    auto gt = _mm256_set1_epi8('>');
+    auto quote = _mm256_set1_epi8('"');
+    auto apostrophe = _mm256_set1_epi8('\'');
+    auto zero = _mm256_setzero_si256();
+
+    size_t count = 0;
+    uint64_t nul_mask = 0;
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        uint64_t mask = 0;
+        for (int k = 0; k < 2; k++) {
+            auto chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 32 * k));
+            auto matches = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lt), _mm256_cmpeq_epi8(chunk, gt)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote), _mm256_cmpeq_epi8(chunk, apostrophe)));
+            mask |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(matches))) << (32 * k);
+            nul_mask |= static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, zero)));
+        }
+        count = flatten(mask, i, out, count);
+    }
+    if (nul_mask)
+        nul = true;
+    return index_scalar_from(data, size, i, out, count, nul);
+}
+
+#endif
+
+struct Implementation
+{
+    IndexFunction index;
+    const char *name;
+};
+
+Implementation select()
+{
+#ifdef XML_INDEX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return {index_avx2, "avx2"};
+    if (__builtin_cpu_supports("sse2"))
+        return {index_sse2, "sse2"};
+#endif
+    return {index_scalar, "scalar"};
+}
+
+const Implementation &selected()
+{
+    static const Implementation impl = select();
+    return impl;
+}
+
+} // namespace
+
+StructuralIndex::StructuralIndex(std::string_view input)
+        : input(input), positions(std::min(input.size(), window_size)), count(0), cursor(0),
+          window_begin(0), window_end(0), nul(false) {}
+
+void StructuralIndex::skip_to(size_t pos)
+{
+    while (peek() < pos) {
+        // whole window before pos
+        if (window_begin + positions[count - 1] < pos) {
+            cursor = count;
+            continue;
+        }
+        auto first = positions.begin() + cursor;
+        auto last = positions.begin() + count;
+        cursor = std::lower_bound(first, last, static_cast<uint32_t>(pos - window_begin)) - positions.begin();
+    }
+}
+
+bool StructuralIndex::saw_nul() const
+{
+    return nul;
+}
+
+const char *StructuralIndex::implementation()
+{
+    return selected().name;
+}
+
+bool StructuralIndex::fill()
+{
+    while (window_end < input.size()) {
+        window_begin = window_end;
+        window_end = std::min(window_begin + window_size, input.size());
+        count = selected().index(input.data() + window_begin, window_end - window_begin, positions.data(), nul);
+        cursor = 0;
+        if (count > 0)
+            return true;
+    }
+    return false;
+}
+
+} // namespace XML
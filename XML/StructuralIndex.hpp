@@ -0,0 +1,72 @@
+#ifndef XML_STRUCTURALINDEX_HPP
+#define XML_STRUCTURALINDEX_HPP
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace XML
+{
+
+/// Stage 1 of the structural index parser (see IndexedParser): offsets of '<', '>', '"' and '\'' in the input,
+/// found 64 bytes at a time with SIMD compares (AVX2 or SSE2, picked once at runtime, scalar code otherwise).
+/// The input is indexed one window at a time as the cursor reaches it, so the index stays in cache
+class StructuralIndex
+{
+public:
+    /// Number of input bytes indexed at once
+    static constexpr size_t window_size = 64 * 1024;
+
+    /// StructuralIndex constructor
+    /// \param input Input to index, must outlive the index
+    explicit StructuralIndex(std::string_view input);
+
+    /// Returns offset of the next structural character without moving past it
+    /// \return Offset or input size at the end
+    size_t peek()
+    {
+        if (cursor == count and not fill())
+            return input.size();
+        return window_begin + positions[cursor];
+    }
+
+    /// Returns offset of the next structural character and moves past it
+    /// \return Offset or input size at the end
+    size_t next()
+    {
+        auto pos = peek();
+        if (pos < input.size())
+            cursor++;
+        return pos;
+    }
+
+    /// Moves past every structural character before pos
+    /// \param pos Offset
+    void skip_to(size_t pos);
+
+    /// Whether a NUL byte was found in the part of the input indexed so far
+    /// \return True if there was a NUL byte
+    bool saw_nul() const;
+
+    /// Returns name of the implementation picked for this CPU ("avx2", "sse2" or "scalar")
+    /// \return Implementation name
+    static const char *implementation();
+
+private:
+    /// Indexes the next window
+    /// \return False at the end of input
+    bool fill();
+
+    std::string_view input;
+    // offsets relative to window_begin, the first count are valid
+    std::vector<uint32_t> positions;
+    size_t count;
+    size_t cursor;
+    size_t window_begin;
+    size_t window_end;
+    bool nul;
+};
+
+} // namespace XML
+
+#endif //XML_STRUCTURALINDEX_HPP
@@ -7,7 +7,7 @@
 namespace XML
 {
 
-Token::Token(Type type, const std::string &value) : type(type), value(value) {}
+Token::Token(Type type, std::string_view value) : type(type), value(value) {}
 
 std::string Token::type_name(Type type)
 {
@@ -6,6 +6,7 @@
 #define XML_TOKEN_HPP
 
 #include <string>
+#include <string_view>
 #include <ostream>
 
 namespace XML
@@ -17,9 +18,9 @@ struct Token
     {
         // LEXEME             EXAMPLE
 
-        TAG_BEGIN,          // <NAME
+        TAG_BEGIN,          // <NAME (value is NAME)
         TAG_END,            // >
-        TAG_CLOSE,          // </NAME>
+        TAG_CLOSE,          // </NAME> (value is NAME)
         TAG_END_AND_CLOSE,  // />
         ATTRIBUTE_NAME,     // NAME
         EQUAL_SIGN,         // =
@@ -39,9 +40,9 @@ struct Token
 
     /// Token constructor
     /// \param type Type of token
-    /// \param value Value of token
+    /// \param value View of token value
     explicit Token(Type type = Type::END_OF_FILE,
-                   const std::string& value = "");
+                   std::string_view value = {});
 
     /// Returns string representation of token type
     /// \param type Token type
@@ -59,7 +60,8 @@ struct Token
     friend std::ostream &operator<<(std::ostream &os, const Token &token);
 
     Type type;
-    std::string value;
+    /// Slice of the lexer input, valid as long as the input buffer is alive
+    std::string_view value;
 };
 
 } // namespace XML
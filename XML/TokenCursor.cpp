@@ -0,0 +1,65 @@
+#include <algorithm>
+#include "TokenCursor.hpp"
+
+namespace XML
+{
+
+TokenCursor::TokenCursor(std::string_view input) : lexer(input), input(input) {}
+
+void TokenCursor::reset(std::string_view input)
+{
+    lexer = Lexer(input);
+    this->input = input;
+    curr_token = Token();
+    peek_token = Token();
+    error = ParseError();
+}
+
+bool TokenCursor::skip_to(size_t pos)
+{
+    lexer.skip_to(pos);
+    peek_token = lexer.try_next_token();
+    if (lexer.unexpected_symbol())
+        return fail(ParseError::Code::UNEXPECTED_SYMBOL, peek_token);
+    return true;
+}
+
+bool TokenCursor::fail(ParseError::Code code, const Token &token)
+{
+    error = ParseError();
+    error.code = code;
+    error.found = token.type;
+    // end of file tokens have no value to point at, the lexer stops past the end of its input
+    if (token.value.data())
+        error.offset = token.value.data() - input.data();
+    else
+        error.offset = std::min(lexer.position(), input.size());
+    return false;
+}
+
+bool TokenCursor::read_cdata(std::string_view &value)
+{
+    if (not advance(Token::Type::CDATA))
+        return false;
+    value = curr_token.value;
+    return advance(Token::Type::CDATA_END);
+}
+
+bool TokenCursor::read_comment(std::string_view &value)
+{
+    // comment tokens are split on hyphens but lie next to each other in the input,
+    // so the whole comment is a single slice from the first to the last one
+    value = {};
+    while (peek_token.type != Token::Type::COMMENT_END and
+           peek_token.type != Token::Type::END_OF_FILE) {
+        if (not advance(Token::Type::COMMENT))
+            return false;
+        if (value.empty())
+            value = curr_token.value;
+        else
+            value = std::string_view(value.data(), curr_token.value.data() + curr_token.value.size() - value.data());
+    }
+    return advance(Token::Type::COMMENT_END);
+}
+
+} // namespace XML
@@ -0,0 +1,122 @@
+#ifndef XML_TOKENCURSOR_HPP
+#define XML_TOKENCURSOR_HPP
+
+#include <string_view>
+#include "Lexer.hpp"
+#include "ParseError.hpp"
+
+namespace XML
+{
+
+/// Lexer with one token of lookahead and the well-formedness checks of markup that Parser, Reader and LazyParser
+/// share, so they accept the same input and reject it with the same ParseError. Nothing here throws:
+/// a failed check records its error and returns false, callers that throw raise() it
+class TokenCursor
+{
+public:
+    /// TokenCursor constructor
+    /// \param input XML string, error offsets are relative to it
+    explicit TokenCursor(std::string_view input = {});
+
+    /// Restarts lexing at the beginning of new input, the tokens and the error are cleared
+    /// \param input XML string
+    void reset(std::string_view input);
+
+    /// Lexes the token at offset pos into peek_token, the markup between the current position and pos
+    /// is skipped without lexing it. pos has to be in content, e.g. an end tag found by Scanner
+    /// \param pos Offset in input
+    /// \return False if the lexer found an unexpected symbol
+    bool skip_to(size_t pos);
+
+    /// Advance to next token
+    /// \return False if the lexer found an unexpected symbol
+    bool advance()
+    {
+        curr_token = peek_token;
+        peek_token = lexer.try_next_token();
+        if (lexer.unexpected_symbol())
+            return fail(ParseError::Code::UNEXPECTED_SYMBOL, peek_token);
+        return true;
+    }
+
+    /// Advance to next token, if token is not expected_type it's an error
+    /// \param expected_type Expected token type
+    /// \return False on error
+    bool advance(Token::Type expected_type)
+    {
+        if (peek_token.type == expected_type)
+            return advance();
+
+        fail(ParseError::Code::EXPECTED_TOKEN, peek_token);
+        error.expected = expected_type;
+        return false;
+    }
+
+    /// Records an error found at token
+    /// \param code Error code
+    /// \param token Token the error was found at
+    /// \return False
+    bool fail(ParseError::Code code, const Token &token);
+
+    /// Reads the attributes of the start tag in curr_token up to the end of the tag
+    /// \param self_closing Set to true if the tag is self-closing
+    /// \param has Called with an attribute name, returns whether the element already has the attribute
+    /// \param add Called with an attribute name and the ATTRIBUTE_VALUE token, returns false on error
+    /// \return False on error
+    template<class Has, class Add>
+    bool read_attributes(bool &self_closing, Has has, Add add)
+    {
+        // curr_token is the start tag, its name is kept for errors as it views the input
+        auto elem_name = curr_token.value;
+        while (true) {
+            if (peek_token.type == Token::Type::TAG_END or peek_token.type == Token::Type::TAG_END_AND_CLOSE) {
+                self_closing = peek_token.type == Token::Type::TAG_END_AND_CLOSE;
+                return advance();
+            }
+
+            if (not advance(Token::Type::ATTRIBUTE_NAME))
+                return false;
+            auto attr_name = curr_token.value;
+            if (has(attr_name)) {
+                fail(ParseError::Code::REPEATED_ATTRIBUTE, curr_token);
+                error.name = elem_name;
+                error.attribute = attr_name;
+                return false;
+            }
+
+            if (not advance(Token::Type::EQUAL_SIGN) or not advance(Token::Type::ATTRIBUTE_VALUE) or
+                not add(attr_name, curr_token))
+                return false;
+        }
+    }
+
+    /// Checks that the end tag in curr_token closes the innermost open element
+    /// \param open_name Name of the innermost open element
+    /// \return False on error
+    bool check_end_tag(std::string_view open_name)
+    {
+        if (curr_token.value != open_name)
+            return fail(ParseError::Code::UNEXPECTED_TAG_CLOSE, curr_token);
+        return true;
+    }
+
+    /// Reads the CDATA section started by curr_token
+    /// \param value Section content
+    /// \return False on error
+    bool read_cdata(std::string_view &value);
+
+    /// Reads the comment started by curr_token
+    /// \param value Comment content
+    /// \return False on error
+    bool read_comment(std::string_view &value);
+
+    Lexer lexer;
+    std::string_view input;
+    Token curr_token;
+    Token peek_token;
+    ParseError error;
+};
+
+} // namespace XML
+
+#endif //XML_TOKENCURSOR_HPP
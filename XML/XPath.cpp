@@ -0,0 +1,574 @@
+#include <algorithm>
+#include <unordered_map>
+#include "XPath.hpp"
+
+namespace XML
+{
+
+namespace
+{
+
+using Step = XPath::Step;
+using Predicate = XPath::Predicate;
+
+/// Reads an expression into steps
+class Compiler
+{
+public:
+    explicit Compiler(std::string_view input) : input(input), pos(0) {}
+
+    [[noreturn]] void fail(const std::string &what) const
+    {
+        throw SyntaxError("Invalid XPath '" + std::string(input) + "' at position " + std::to_string(pos) + ": " + what);
+    }
+
+    bool at_end()
+    {
+        skip_spaces();
+        return pos >= input.size();
+    }
+
+    bool consume(std::string_view token)
+    {
+        skip_spaces();
+        if (input.compare(pos, token.size(), token) != 0)
+            return false;
+        pos += token.size();
+        return true;
+    }
+
+    void expect(std::string_view token)
+    {
+        if (not consume(token))
+            fail("expected " + std::string(token));
+    }
+
+    /// Reads a step, '//' before an attribute step adds the descendant-or-self step it needs
+    void step(bool descendant, std::vector<Step> &steps)
+    {
+        Step step{descendant ? Step::Axis::DESCENDANT : Step::Axis::CHILD, Step::Test::ANY_NODE, {}, {}, false};
+
+        auto parent = consume("..");
+        if (parent or consume(".")) {
+            if (descendant)
+                fail("'//' has to be followed by a name test");
+            step.axis = parent ? Step::Axis::PARENT : Step::Axis::SELF;
+            steps.push_back(std::move(step));
+            return;
+        }
+
+        if (consume("@")) {
+            if (descendant)
+                steps.push_back(Step{Step::Axis::DESCENDANT_OR_SELF, Step::Test::ANY_ELEMENT, {}, {}, false});
+            step.axis = Step::Axis::ATTRIBUTE;
+            if (consume("*")) {
+                step.test = Step::Test::ANY_ELEMENT;
+            } else {
+                step.test = Step::Test::NAME;
+                step.name = name();
+            }
+            steps.push_back(std::move(step));
+            return;
+        }
+
+        if (consume("*")) {
+            step.test = Step::Test::ANY_ELEMENT;
+        } else {
+            auto test = name();
+            if (consume("(")) {
+                expect(")");
+                if (test == "text")
+                    step.test = Step::Test::TEXT;
+                else if (test == "comment")
+                    step.test = Step::Test::COMMENT;
+                else if (test == "node")
+                    step.test = Step::Test::ANY_NODE;
+                else
+                    fail("unsupported node test " + std::string(test) + "()");
+            } else {
+                step.test = Step::Test::NAME;
+                step.name = test;
+            }
+        }
+
+        while (consume("[")) {
+            step.predicates.push_back(predicate());
+            step.positional = step.positional or step.predicates.back().kind == Predicate::Kind::POSITION;
+            expect("]");
+        }
+        steps.push_back(std::move(step));
+    }
+
+private:
+    Predicate predicate()
+    {
+        Predicate predicate{Predicate::Kind::POSITION, {}, {}, 0, false};
+
+        skip_spaces();
+        if (pos < input.size() and is_digit(input[pos])) {
+            predicate.position = number();
+        } else if (consume("last()")) {
+            predicate.from_end = true;
+            if (consume("-"))
+                predicate.position = number();
+        } else if (consume("@")) {
+            predicate.name = name();
+            if (consume("!=")) {
+                predicate.kind = Predicate::Kind::ATTRIBUTE_NE;
+                predicate.value = literal();
+            } else if (consume("=")) {
+                predicate.kind = Predicate::Kind::ATTRIBUTE_EQ;
+                predicate.value = literal();
+            } else {
+                predicate.kind = Predicate::Kind::HAS_ATTRIBUTE;
+            }
+        } else {
+            predicate.name = name();
+            if (predicate.name == "text" and consume("(")) {
+                expect(")");
+                expect("=");
+                predicate.kind = Predicate::Kind::TEXT_EQ;
+                predicate.value = literal();
+            } else {
+                predicate.kind = Predicate::Kind::HAS_CHILD;
+            }
+        }
+        return predicate;
+    }
+
+    std::string_view name()
+    {
+        skip_spaces();
+        auto begin = pos;
+        if (pos >= input.size() or not is_name_start(input[pos]))
+            fail("expected name");
+        while (pos < input.size() and (is_name_start(input[pos]) or is_digit(input[pos]) or input[pos] == ':'))
+            pos++;
+        return input.substr(begin, pos - begin);
+    }
+
+    std::string literal()
+    {
+        skip_spaces();
+        if (pos >= input.size() or (input[pos] != '\'' and input[pos] != '"'))
+            fail("expected quoted literal");
+        auto end = input.find(input[pos], pos + 1);
+        if (end == std::string_view::npos)
+            fail("unterminated literal");
+        auto value = input.substr(pos + 1, end - pos - 1);
+        pos = end + 1;
+        return std::string(value);
+    }
+
+    size_t number()
+    {
+        skip_spaces();
+        if (pos >= input.size() or not is_digit(input[pos]))
+            fail("expected number");
+        size_t value = 0;
+        while (pos < input.size() and is_digit(input[pos]))
+            value = value * 10 + (input[pos++] - '0');
+        return value;
+    }
+
+    void skip_spaces()
+    {
+        while (pos < input.size() and (input[pos] == ' ' or input[pos] == '\t' or input[pos] == '\n' or input[pos] == '\r'))
+            pos++;
+    }
+
+    static bool is_name_start(char c)
+    {
+        return ('a' <= c and c <= 'z') or ('A' <= c and c <= 'Z') or c == '_';
+    }
+
+    static bool is_digit(char c)
+    {
+        return '0' <= c and c <= '9';
+    }
+
+    std::string_view input;
+    size_t pos;
+};
+
+/// Buffers of evaluations on this thread, kept so repeated queries don't allocate
+struct Scratch
+{
+    std::vector<DOM::Node*> context;
+    std::vector<DOM::Node*> next;
+    // candidates of descendant steps with positional predicates, a group per open element
+    std::vector<DOM::Node*> groups;
+    // offset of the group of every open element and of its next candidate
+    std::vector<std::pair<size_t, size_t>> frames;
+    // positions among siblings for sorting, DOM::Node::child_num() would build the child index of a shared tree
+    std::unordered_map<const DOM::Node*, size_t> positions;
+};
+
+thread_local Scratch scratch;
+
+const DOM::Attribute *find_attribute(const DOM::Node *node, std::string_view name)
+{
+    if (node->type() != DOM::Node::Type::ELEMENT_NODE)
+        return nullptr;
+    for (auto &attr : static_cast<const DOM::Element *>(node)->attributes())
+        if (attr.name.view() == name)
+            return &attr;
+    return nullptr;
+}
+
+bool matches_test(const DOM::Node *node, const Step &step)
+{
+    auto type = node->type();
+    switch (step.test) {
+    case Step::Test::NAME:
+        return type == DOM::Node::Type::ELEMENT_NODE and node->name() == step.name;
+    case Step::Test::ANY_ELEMENT:
+        return type == DOM::Node::Type::ELEMENT_NODE;
+    case Step::Test::TEXT:
+        return type == DOM::Node::Type::TEXT_NODE or type == DOM::Node::Type::CDATA_SECTION_NODE;
+    case Step::Test::COMMENT:
+        return type == DOM::Node::Type::COMMENT_NODE;
+    case Step::Test::ANY_NODE:
+        return true;
+    }
+    return false;
+}
+
+/// \param position Position of node among the candidates, from 1
+/// \param size Number of candidates
+bool matches_predicate(const DOM::Node *node, const Predicate &predicate, size_t position, size_t size)
+{
+    switch (predicate.kind) {
+    case Predicate::Kind::POSITION:
+        if (predicate.from_end)
+            return predicate.position < size and position == size - predicate.position;
+        return position == predicate.position;
+    case Predicate::Kind::HAS_ATTRIBUTE:
+        return find_attribute(node, predicate.name) != nullptr;
+    case Predicate::Kind::ATTRIBUTE_EQ: {
+        auto attr = find_attribute(node, predicate.name);
+        return attr and attr->value == predicate.value;
+    }
+    case Predicate::Kind::ATTRIBUTE_NE: {
+        auto attr = find_attribute(node, predicate.name);
+        return attr and attr->value != predicate.value;
+    }
+    case Predicate::Kind::TEXT_EQ:
+        for (auto child = node->first_child(); child; child = child->next_sibling())
+            if ((child->type() == DOM::Node::Type::TEXT_NODE or child->type() == DOM::Node::Type::CDATA_SECTION_NODE)
+                and child->value() == predicate.value)
+                return true;
+        return false;
+    case Predicate::Kind::HAS_CHILD:
+        for (auto child = node->first_child(); child; child = child->next_sibling())
+            if (child->type() == DOM::Node::Type::ELEMENT_NODE and child->name() == predicate.name)
+                return true;
+        return false;
+    }
+    return false;
+}
+
+/// Filters nodes[begin..] by the predicates of step, one predicate after another
+void apply_predicates(std::vector<DOM::Node*> &nodes, size_t begin, const Step &step)
+{
+    for (auto &predicate : step.predicates) {
+        auto size = nodes.size() - begin;
+        auto kept = begin;
+        for (auto i = begin; i < nodes.size(); i++)
+            if (matches_predicate(nodes[i], predicate, i - begin + 1, size))
+                nodes[kept++] = nodes[i];
+        nodes.resize(kept);
+    }
+}
+
+/// Whether node matches step on its own, only for steps without positional predicates
+bool matches(const DOM::Node *node, const Step &step)
+{
+    if (not matches_test(node, step))
+        return false;
+    for (auto &predicate : step.predicates)
+        if (not matches_predicate(node, predicate, 1, 1))
+            return false;
+    return true;
+}
+
+/// Whether any node of a set in document order is a descendant of another
+bool has_nesting(const std::vector<DOM::Node*> &nodes)
+{
+    // a subtree is contiguous in document order, so checking neighbours is enough
+    for (size_t i = 1; i < nodes.size(); i++)
+        if (nodes[i - 1]->is_ancestor(nodes[i]))
+            return true;
+    return false;
+}
+
+/// Removes nodes that are descendants of other nodes of a set in document order
+void drop_nested(std::vector<DOM::Node*> &nodes)
+{
+    size_t kept = 0;
+    for (auto node : nodes)
+        if (kept == 0 or not nodes[kept - 1]->is_ancestor(node))
+            nodes[kept++] = node;
+    nodes.resize(kept);
+}
+
+/// Returns position of node among its siblings, numbering all children of its parent on first use
+size_t sibling_position(const DOM::Node *node)
+{
+    auto &positions = scratch.positions;
+    auto found = positions.find(node);
+    if (found != positions.end())
+        return found->second;
+
+    size_t position = 0;
+    for (auto child = node->parent_node()->first_child(); child; child = child->next_sibling())
+        positions[child] = position++;
+    return positions[node];
+}
+
+/// Document order comparison. DOM::Node::child_num() would build the child index of the parent,
+/// sibling_position() doesn't change the tree, so queries on a shared tree can run concurrently
+bool precedes(const DOM::Node *node, const DOM::Node *other)
+{
+    if (node == other)
+        return false;
+
+    size_t depth = 0;
+    size_t other_depth = 0;
+    for (auto curr = node->parent_node(); curr; curr = curr->parent_node())
+        depth++;
+    for (auto curr = other->parent_node(); curr; curr = curr->parent_node())
+        other_depth++;
+
+    auto up = node;
+    auto other_up = other;
+    for (; depth > other_depth; depth--)
+        up = up->parent_node();
+    for (; other_depth > depth; other_depth--)
+        other_up = other_up->parent_node();
+    // an ancestor goes before its descendants
+    if (up == other_up)
+        return up == node;
+
+    while (up->parent_node() != other_up->parent_node()) {
+        up = up->parent_node();
+        other_up = other_up->parent_node();
+    }
+    return sibling_position(up) < sibling_position(other_up);
+}
+
+void sort_document_order(std::vector<DOM::Node*> &nodes)
+{
+    scratch.positions.clear();
+    std::sort(nodes.begin(), nodes.end(), [](DOM::Node *a, DOM::Node *b) { return precedes(a, b); });
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+}
+
+/// Appends descendants of context (and context itself if include_self) matching step in document order
+void select_descendants(DOM::Node *context, const Step &step, bool include_self, std::vector<DOM::Node*> &out)
+{
+    if (include_self and matches(context, step))
+        out.push_back(context);
+
+    auto node = context->first_child();
+    while (node) {
+        if (matches(node, step))
+            out.push_back(node);
+
+        if (auto child = node->first_child()) {
+            node = child;
+            continue;
+        }
+        while (node != context and not node->next_sibling())
+            node = node->parent_node();
+        if (node == context)
+            break;
+        node = node->next_sibling();
+    }
+}
+
+/// Same for steps with positional predicates, which apply to the children of each element separately.
+/// The candidates of every element on the path to the current node are kept in scratch.groups,
+/// so they can be taken in document order while walking
+void select_descendants_grouped(DOM::Node *context, const Step &step, std::vector<DOM::Node*> &out)
+{
+    auto &groups = scratch.groups;
+    auto &frames = scratch.frames;
+    groups.clear();
+    frames.clear();
+
+    auto open = [&](DOM::Node *parent) {
+        auto begin = groups.size();
+        for (auto child = parent->first_child(); child; child = child->next_sibling())
+            if (matches_test(child, step))
+                groups.push_back(child);
+        apply_predicates(groups, begin, step);
+        frames.emplace_back(begin, begin);
+    };
+    auto close = [&] {
+        groups.resize(frames.back().first);
+        frames.pop_back();
+    };
+
+    open(context);
+    auto node = context->first_child();
+    while (node) {
+        auto &next = frames.back().second;
+        if (next < groups.size() and groups[next] == node) {
+            out.push_back(node);
+            next++;
+        }
+
+        if (auto child = node->first_child()) {
+            open(node);
+            node = child;
+            continue;
+        }
+        while (node != context and not node->next_sibling()) {
+            node = node->parent_node();
+            close();
+        }
+        if (node == context)
+            break;
+        node = node->next_sibling();
+    }
+}
+
+}
+
+XPath::XPath(std::string_view expression) : expression_(expression), absolute(false)
+{
+    Compiler compiler(expression);
+    bool descendant = false;
+    if (compiler.consume("//")) {
+        absolute = true;
+        descendant = true;
+    } else if (compiler.consume("/")) {
+        absolute = true;
+        // "/" alone selects the root
+        if (compiler.at_end())
+            return;
+    }
+
+    while (true) {
+        compiler.step(descendant, steps);
+        if (compiler.at_end())
+            break;
+        if (steps.back().axis == Step::Axis::ATTRIBUTE)
+            compiler.fail("attribute step has to be the last one");
+
+        if (compiler.consume("//"))
+            descendant = true;
+        else if (compiler.consume("/"))
+            descendant = false;
+        else
+            compiler.fail("expected /");
+    }
+}
+
+const std::vector<DOM::Node*> &XPath::evaluate(DOM::Node *context) const
+{
+    auto &nodes = scratch.context;
+    auto &next = scratch.next;
+    nodes.clear();
+
+    if (absolute)
+        while (context->parent_node())
+            context = context->parent_node();
+    nodes.push_back(context);
+
+    for (auto &step : steps) {
+        if (step.axis == Step::Axis::ATTRIBUTE)
+            break;
+
+        next.clear();
+        switch (step.axis) {
+        case Step::Axis::CHILD: {
+            auto nested = has_nesting(nodes);
+            for (auto node : nodes) {
+                auto begin = next.size();
+                for (auto child = node->first_child(); child; child = child->next_sibling())
+                    if (matches_test(child, step))
+                        next.push_back(child);
+                apply_predicates(next, begin, step);
+            }
+            // children of a node can come after its descendants
+            if (nested)
+                sort_document_order(next);
+            break;
+        }
+        case Step::Axis::DESCENDANT:
+        case Step::Axis::DESCENDANT_OR_SELF:
+            // the subtrees of nested nodes are part of their ancestors subtrees
+            drop_nested(nodes);
+            for (auto node : nodes) {
+                if (step.positional)
+                    select_descendants_grouped(node, step, next);
+                else
+                    select_descendants(node, step, step.axis == Step::Axis::DESCENDANT_OR_SELF, next);
+            }
+            break;
+        case Step::Axis::SELF:
+            for (auto node : nodes)
+                if (matches_test(node, step))
+                    next.push_back(node);
+            break;
+        case Step::Axis::PARENT:
+            for (auto node : nodes)
+                if (node->parent_node())
+                    next.push_back(node->parent_node());
+            sort_document_order(next);
+            break;
+        case Step::Axis::ATTRIBUTE:
+            break;
+        }
+        std::swap(nodes, next);
+    }
+    return nodes;
+}
+
+std::vector<DOM::Node*> XPath::select(DOM::Node *context) const
+{
+    std::vector<DOM::Node*> result;
+    select(context, result);
+    return result;
+}
+
+void XPath::select(DOM::Node *context, std::vector<DOM::Node*> &result) const
+{
+    if (not steps.empty() and steps.back().axis == Step::Axis::ATTRIBUTE)
+        throw DOMError("XPath " + expression_ + " selects attributes, use select_values()");
+
+    auto &nodes = evaluate(context);
+    result.assign(nodes.begin(), nodes.end());
+}
+
+void XPath::select_values(DOM::Node *context, std::vector<std::string_view> &values) const
+{
+    values.clear();
+    if (steps.empty())
+        throw DOMError("XPath " + expression_ + " doesn't select values");
+
+    auto &last = steps.back();
+    if (last.axis == Step::Axis::ATTRIBUTE) {
+        for (auto node : evaluate(context)) {
+            if (node->type() != DOM::Node::Type::ELEMENT_NODE)
+                continue;
+            for (auto &attr : static_cast<DOM::Element *>(node)->attributes())
+                if (last.test == Step::Test::ANY_ELEMENT or attr.name.view() == last.name)
+                    values.push_back(attr.value);
+        }
+    } else if (last.test == Step::Test::TEXT or last.test == Step::Test::COMMENT) {
+        for (auto node : evaluate(context))
+            values.push_back(node->value());
+    } else {
+        throw DOMError("XPath " + expression_ + " doesn't select values");
+    }
+}
+
+const std::string &XPath::expression() const
+{
+    return expression_;
+}
+
+} // namespace XML
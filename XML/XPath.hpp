@@ -0,0 +1,113 @@
+#ifndef XML_XPATH_HPP
+#define XML_XPATH_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include "DOM.hpp"
+#include "Errors.hpp"
+
+namespace XML
+{
+
+/// Compiled query in a subset of XPath 1.0. Compile once, then evaluate against any number of nodes
+/// (concurrently too, evaluation only reads the plan and the tree and keeps its buffers per thread,
+/// except that it loads the elements of lazy documents it visits).
+///
+/// Supported syntax:
+///  - absolute and relative paths, steps separated by '/' (child) and '//' (descendant)
+///  - steps: name, '*', 'text()', 'comment()', 'node()', '.', '..', and '@name' or '@*' as the last step
+///  - predicates: [n], [last()], [last()-n], [@name], [@name='value'], [@name!='value'],
+///    [text()='value'], [name] (has a child element), several predicates in a row
+/// Names follow the parsers rules, literals are quoted with ' or "
+class XPath
+{
+public:
+    /// Compiles expression, throws SyntaxError if it's not in the supported subset
+    /// \param expression XPath expression
+    explicit XPath(std::string_view expression);
+
+    /// Selects nodes in document order, throws DOMError if the path selects attributes
+    /// \param context Context node, absolute paths start at the root of its tree
+    /// \return Selected nodes
+    std::vector<DOM::Node*> select(DOM::Node *context) const;
+
+    /// Selects nodes in document order into result, which is cleared first, so its buffer can be reused
+    /// \param context Context node
+    /// \param result Selected nodes
+    void select(DOM::Node *context, std::vector<DOM::Node*> &result) const;
+
+    /// Selects values of attributes (paths ending with '@') or of text, CDATA and comment nodes (paths ending
+    /// with 'text()' or 'comment()') in document order, throws DOMError for other paths.
+    /// Views are valid until the nodes change
+    /// \param context Context node
+    /// \param values Selected values, cleared first
+    void select_values(DOM::Node *context, std::vector<std::string_view> &values) const;
+
+    /// Returns the compiled expression
+    /// \return Expression
+    const std::string &expression() const;
+
+    struct Predicate
+    {
+        enum class Kind
+        {
+            POSITION,       // [n], [last()-n] if from_end
+            HAS_ATTRIBUTE,  // [@name]
+            ATTRIBUTE_EQ,   // [@name='value']
+            ATTRIBUTE_NE,   // [@name!='value']
+            TEXT_EQ,        // [text()='value']
+            HAS_CHILD       // [name]
+        };
+
+        Kind kind;
+        std::string name;
+        std::string value;
+        size_t position;
+        bool from_end;
+    };
+
+    struct Step
+    {
+        enum class Axis
+        {
+            CHILD,
+            // '//' fused with the step after it (descendant-or-self::node()/child::step)
+            DESCENDANT,
+            // '//' before an attribute step
+            DESCENDANT_OR_SELF,
+            SELF,
+            PARENT,
+            ATTRIBUTE
+        };
+
+        enum class Test
+        {
+            NAME,
+            ANY_ELEMENT,
+            TEXT,
+            COMMENT,
+            ANY_NODE
+        };
+
+        Axis axis;
+        Test test;
+        std::string name;
+        std::vector<Predicate> predicates;
+        // a predicate depends on the position of the node among the candidates
+        bool positional;
+    };
+
+private:
+    /// Evaluates every step except a trailing attribute step
+    /// \return Selected nodes, in a buffer of this thread valid until the next evaluation
+    const std::vector<DOM::Node*> &evaluate(DOM::Node *context) const;
+
+    std::string expression_;
+    bool absolute;
+    std::vector<Step> steps;
+};
+
+} // namespace XML
+
+#endif //XML_XPATH_HPP
@@ -0,0 +1,73 @@
+// Scrolls a huge flat element through XML::TreeModel the way QTreeView does while painting:
+// index() for every visible row, data() for every column and parent() for every index.
+//
+// Usage: treemodel-benchmark [children] [page rows]
+
+#include <QCoreApplication>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "xmltreemodel.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    int children = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int page = argc > 2 ? std::atoi(argv[2]) : 40;
+
+    using clock = std::chrono::steady_clock;
+
+    auto build_start = clock::now();
+
+    XML::DOM::Document document;
+    auto root = document.create_element("root");
+    document.append_child(root);
+    for (int i = 0; i < children; i++) {
+        auto entry = document.create_element("entry");
+        entry->append_child(document.create_text_node(std::to_string(i)));
+        root->append_child(entry);
+    }
+
+    XML::TreeModel model(document);
+    auto root_index = model.index(0, 0);
+
+    auto scroll_start = clock::now();
+
+    // scroll from top to bottom one page at a time, then jump back and forth
+    size_t visited = 0;
+    auto paint_page = [&](int first) {
+        for (int row = first; row < first + page and row < children; row++) {
+            for (int column = 0; column < model.columnCount(root_index); column++) {
+                auto index = model.index(row, column, root_index);
+                model.data(index);
+                if (model.parent(index) != root_index)
+                    std::abort();
+                visited++;
+            }
+        }
+    };
+
+    for (int first = 0; first < children; first += page)
+        paint_page(first);
+    for (int first = children - page; first > 0; first -= 7 * page)
+        paint_page(first);
+
+    auto end = clock::now();
+
+    auto ms = [](clock::duration d) {
+        return std::chrono::duration<double, std::milli>(d).count();
+    };
+
+    std::cout << "{\"children\": " << children
+              << ", \"page\": " << page
+              << ", \"indexes\": " << visited
+              << ", \"build_ms\": " << ms(scroll_start - build_start)
+              << ", \"scroll_ms\": " << ms(end - scroll_start)
+              << "}" << std::endl;
+
+    return 0;
+}
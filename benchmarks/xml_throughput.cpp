@@ -0,0 +1,351 @@
+// Throughput of the lexer, parser, serializer, tag name lookups and tree traversal on synthetic corpora
+// of different shapes and on example.xml. Every benchmark runs the given number of repetitions and reports
+// the best one, small corpora are processed several times per repetition so every repetition reads about
+// the same number of bytes. Parsing includes destroying the document.
+//
+// Usage: xml-benchmark [options] [megabytes per corpus] [repetitions] [example.xml path]
+// (see usage below for the options shaping the corpora)
+//
+// Results are written to stdout as JSON:
+// {"scanner": ..., "repetitions": ..., "options": {"megabytes": ..., "depth": ..., "fan_out": ..., "attributes": ...,
+//  "text_length": ..., "corpora": [...]}, "corpora": [{"name": ..., "bytes": ..., "nodes": ...,
+//  "benchmarks": {"lexer": {"best_ms": ..., "mb_per_s": ..., "ns_per_node": ...}, ...}}, ...]}
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Lexer.hpp"
+#include "Parser.hpp"
+#include "Scanner.hpp"
+
+namespace
+{
+
+using clock = std::chrono::steady_clock;
+
+const char usage[] =
+    "Usage: xml-benchmark [options] [megabytes per corpus] [repetitions] [example.xml path]\n"
+    "\n"
+    "Options:\n"
+    "  --size N            megabytes per corpus (8 by default)\n"
+    "  --repetitions N     repetitions of every benchmark, the best one is reported (5 by default)\n"
+    "  --example PATH      path of example.xml\n"
+    "  --depth N           nesting of the chains in the deep corpus (1000 by default)\n"
+    "  --fan-out N         children of every group element in the wide corpus, 0 for all under the root (default)\n"
+    "  --attributes N      attributes of every element in the attributes corpus (8 by default)\n"
+    "  --text-length N     characters of every paragraph in the text corpus (231 by default)\n"
+    "  --corpora LIST      comma separated corpora to run: deep, wide, attributes, text, comments, example.xml\n"
+    "                      (all by default)\n"
+    "  --help              print this help\n";
+
+const std::vector<std::string> corpus_names = {"deep", "wide", "attributes", "text", "comments", "example.xml"};
+
+struct Options
+{
+    size_t megabytes = 8;
+    size_t repetitions = 5;
+    std::string example_path = "example.xml";
+    size_t depth = 1000;
+    size_t fan_out = 0;
+    size_t attributes = 8;
+    size_t text_length = 231;
+    std::vector<std::string> corpora = corpus_names;
+};
+
+class UsageError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+size_t parse_number(const std::string &option, const std::string &value)
+{
+    char *end = nullptr;
+    auto number = std::strtoull(value.c_str(), &end, 10);
+    if (value.empty() or *end)
+        throw UsageError("Invalid number for " + option + ": " + value);
+    return number;
+}
+
+std::vector<std::string> parse_corpora(const std::string &list)
+{
+    std::vector<std::string> corpora;
+    std::stringstream stream(list);
+    for (std::string name; std::getline(stream, name, ',');) {
+        if (std::find(corpus_names.begin(), corpus_names.end(), name) == corpus_names.end())
+            throw UsageError("Unknown corpus: " + name);
+        if (std::find(corpora.begin(), corpora.end(), name) == corpora.end())
+            corpora.push_back(name);
+    }
+    if (corpora.empty())
+        throw UsageError("No corpora given to --corpora");
+    return corpora;
+}
+
+Options parse_options(int argc, char *argv[])
+{
+    Options options;
+    size_t positional = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw UsageError("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        // positional arguments of the first version
+        if (arg.empty() or arg[0] != '-') {
+            if (positional == 0)
+                options.megabytes = parse_number("megabytes", arg);
+            else if (positional == 1)
+                options.repetitions = parse_number("repetitions", arg);
+            else if (positional == 2)
+                options.example_path = arg;
+            else
+                throw UsageError("Unexpected argument: " + arg);
+            positional++;
+        } else if (arg == "--size") {
+            options.megabytes = parse_number(arg, value());
+        } else if (arg == "--repetitions") {
+            options.repetitions = parse_number(arg, value());
+        } else if (arg == "--example") {
+            options.example_path = value();
+        } else if (arg == "--depth") {
+            options.depth = parse_number(arg, value());
+        } else if (arg == "--fan-out") {
+            options.fan_out = parse_number(arg, value());
+        } else if (arg == "--attributes") {
+            options.attributes = parse_number(arg, value());
+        } else if (arg == "--text-length") {
+            options.text_length = parse_number(arg, value());
+        } else if (arg == "--corpora") {
+            options.corpora = parse_corpora(value());
+        } else if (arg == "--help") {
+            std::cout << usage;
+            std::exit(0);
+        } else {
+            throw UsageError("Unknown option: " + arg);
+        }
+    }
+
+    options.megabytes = std::max<size_t>(options.megabytes, 1);
+    options.repetitions = std::max<size_t>(options.repetitions, 1);
+    options.depth = std::max<size_t>(options.depth, 1);
+    return options;
+}
+
+struct Corpus
+{
+    std::string name;
+    std::string xml;
+    // tag name looked up with get_elements_by_tag_name
+    std::string tag_name;
+};
+
+/// Repeats block(i) inside the root element until the document has about size bytes
+template<class F>
+std::string repeat(const std::string &root, size_t size, F block)
+{
+    std::string xml = "<?xml version=\"1.0\"?>\n<" + root + ">\n";
+    for (size_t i = 0; xml.size() < size; i++)
+        block(i, xml);
+    xml += "</" + root + ">\n";
+    return xml;
+}
+
+/// Chains of depth nested elements
+Corpus deep(size_t size, size_t depth)
+{
+    return {"deep", repeat("deep", size, [&](size_t i, std::string &xml) {
+        for (size_t level = 0; level < depth; level++)
+            xml += "<d>";
+        xml += std::to_string(i);
+        for (size_t level = 0; level < depth; level++)
+            xml += "</d>";
+        xml += "\n";
+    }), "d"};
+}
+
+/// Elements with a huge number of small children, fan_out per group element or all of them in the root if 0
+Corpus wide(size_t size, size_t fan_out)
+{
+    auto xml = repeat("wide", size, [&](size_t i, std::string &xml) {
+        if (fan_out and i % fan_out == 0)
+            xml += i ? "  </group>\n  <group>\n" : "  <group>\n";
+        xml += "  <item>" + std::to_string(i) + "</item>\n";
+    });
+    // the last group is closed before the root
+    if (fan_out)
+        xml.insert(xml.rfind("</wide>"), "  </group>\n");
+    return {"wide", std::move(xml), "item"};
+}
+
+/// Empty elements with count attributes each
+Corpus attributes(size_t size, size_t count)
+{
+    return {"attributes", repeat("records", size, [&](size_t i, std::string &xml) {
+        auto n = std::to_string(i);
+        const std::string attributes[] = {
+            " id=\"" + n + "\"", " name=\"record " + n + "\"", " kind='plain'", " price=\"" + n + ".99\"",
+            " currency=\"USD\"", " created=\"2026-10-17T12:00:00\"", " owner=\"user" + n + "\"", " flags=\"a b c\""
+        };
+        xml += "  <rec";
+        for (size_t k = 0; k < count; k++)
+            xml += k < std::size(attributes) ? attributes[k] : " extra" + std::to_string(k) + "=\"" + n + "\"";
+        xml += "/>\n";
+    }), "rec"};
+}
+
+/// Paragraphs of length characters of text ending with a reference, and CDATA sections
+Corpus text(size_t size, size_t length)
+{
+    const std::string lorem = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt"
+                              " ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation"
+                              " ullamco laboris nisi ut aliquip ex ea commodo consequat ";
+    std::string paragraph;
+    while (paragraph.size() < length)
+        paragraph += lorem;
+    paragraph.resize(length);
+
+    return {"text", repeat("book", size, [&](size_t i, std::string &xml) {
+        xml += "  <p>" + paragraph + "&amp; more.</p>\n";
+        if (i % 4 == 0)
+            xml += "  <code><![CDATA[if (a < b && c > d) { return \"" + std::to_string(i) + "\"; }]]></code>\n";
+    }), "p"};
+}
+
+/// Comments between small elements
+Corpus comments(size_t size)
+{
+    return {"comments", repeat("log", size, [](size_t i, std::string &xml) {
+        xml += "  <!-- entry " + std::to_string(i) + " was generated for the benchmark and means nothing -->\n"
+               "  <c/>\n";
+    }), "c"};
+}
+
+struct Result
+{
+    double best_ms;
+    double mb_per_s;
+    double ns_per_node;
+};
+
+/// Runs f loops times per repetition and returns the best time of one run
+template<class F>
+Result measure(size_t repetitions, size_t loops, size_t bytes, size_t nodes, F f)
+{
+    auto best = std::numeric_limits<double>::max();
+    for (size_t repetition = 0; repetition < repetitions; repetition++) {
+        auto start = clock::now();
+        for (size_t loop = 0; loop < loops; loop++)
+            f();
+        auto seconds = std::chrono::duration<double>(clock::now() - start).count() / loops;
+        best = std::min(best, seconds);
+    }
+    return {best * 1e3, bytes / best / 1e6, best * 1e9 / std::max<size_t>(nodes, 1)};
+}
+
+/// Keeps results of benchmarked code alive, printed so the compiler cannot drop the work
+size_t checksum = 0;
+
+void run(const Corpus &corpus, size_t repetitions, size_t target_bytes, bool first)
+{
+    auto &input = corpus.xml;
+    auto document = XML::Parser().parse(input);
+    size_t nodes = std::distance(document.begin(), document.end());
+
+    auto loops = std::max<size_t>(1, target_bytes / input.size());
+    auto bench = [&](auto f) { return measure(repetitions, loops, input.size(), nodes, f); };
+
+    std::vector<std::pair<std::string, Result>> results;
+    results.emplace_back("lexer", bench([&] {
+        XML::Lexer lexer(input);
+        while (lexer.next_token().type != XML::Token::Type::END_OF_FILE)
+            checksum++;
+    }));
+    results.emplace_back("parse", bench([&] {
+        checksum += XML::Parser().parse(input).child_nodes().size();
+    }));
+    results.emplace_back("serialize", bench([&] {
+        checksum += document.serialize().size();
+    }));
+    results.emplace_back("get_elements_by_tag_name", bench([&] {
+        checksum += document.get_elements_by_tag_name(corpus.tag_name).size();
+    }));
+    results.emplace_back("traversal", bench([&] {
+        for (auto node : document)
+            checksum += node->type() == XML::DOM::Node::Type::ELEMENT_NODE;
+    }));
+
+    std::cout << (first ? "" : ",\n")
+              << "    {\"name\": \"" << corpus.name << "\", \"bytes\": " << input.size() << ", \"nodes\": " << nodes
+              << ", \"loops\": " << loops << ", \"benchmarks\": {";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto &result = results[i].second;
+        std::cout << (i ? "," : "") << "\n      \"" << results[i].first << "\": {\"best_ms\": " << result.best_ms
+                  << ", \"mb_per_s\": " << result.mb_per_s << ", \"ns_per_node\": " << result.ns_per_node << "}";
+    }
+    std::cout << "}}";
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    } catch (UsageError &e) {
+        std::cerr << e.what() << "\n\n" << usage;
+        return 2;
+    }
+
+    auto size = options.megabytes << 20;
+
+    std::vector<Corpus> corpora;
+    for (auto &name : options.corpora) {
+        if (name == "deep") {
+            corpora.push_back(deep(size, options.depth));
+        } else if (name == "wide") {
+            corpora.push_back(wide(size, options.fan_out));
+        } else if (name == "attributes") {
+            corpora.push_back(attributes(size, options.attributes));
+        } else if (name == "text") {
+            corpora.push_back(text(size, options.text_length));
+        } else if (name == "comments") {
+            corpora.push_back(comments(size));
+        } else {
+            std::ifstream example(options.example_path, std::ios::binary);
+            if (example) {
+                std::stringstream content;
+                content << example.rdbuf();
+                corpora.push_back({"example.xml", content.str(), "data"});
+            } else {
+                std::cerr << "Cannot read " << options.example_path << ", skipping it" << std::endl;
+            }
+        }
+    }
+
+    std::cout << "{\"scanner\": \"" << XML::Scanner::implementation() << "\", \"repetitions\": " << options.repetitions
+              << ", \"options\": {\"megabytes\": " << options.megabytes << ", \"depth\": " << options.depth
+              << ", \"fan_out\": " << options.fan_out << ", \"attributes\": " << options.attributes
+              << ", \"text_length\": " << options.text_length << ", \"corpora\": [";
+    for (size_t i = 0; i < options.corpora.size(); i++)
+        std::cout << (i ? ", " : "") << "\"" << options.corpora[i] << "\"";
+    std::cout << "]}, \"corpora\": [\n";
+    for (size_t i = 0; i < corpora.size(); i++)
+        run(corpora[i], options.repetitions, size, i == 0);
+    std::cout << "\n], \"checksum\": " << checksum << "}" << std::endl;
+
+    return 0;
+}
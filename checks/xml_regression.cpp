@@ -0,0 +1,1500 @@
+// Headless regression check of the parse entry points. Random documents, the files given on the command line,
+// and copies of both with a few bytes changed, inserted or removed are parsed with every engine, and the
+// results have to agree:
+// - Engine::LEXER and Engine::STRUCTURAL_INDEX build the same tree or throw the same error, parse() and check()
+//   of either engine accept the same input,
+// - parse_lazy() accepts the same input as parse() once every element is loaded, and builds the same tree, also
+//   of elements 200,000 levels deep,
+// - try_parse() and try_check() of either engine return the tree or the error parse() gives, and their error
+//   raises the exception parse() throws,
+// - Reader accepts the same input as parse() and throws the same error, and Reader and SAXParser report the same
+//   nodes when the input is passed with feed() in chunks cut at random offsets, also when skip_subtree() is called
+//   while the rest of the element hasn't arrived,
+// - parse_parallel() of a root with many children gives the tree or the error parse() gives, also with a NUL byte,
+// - Document::import_node() copies the root element, a node of another document is rejected with DOMError,
+// - parse() of Serializer output, indented and minified, gives the same tree up to whitespace in text, and
+//   writing that tree again gives the same output,
+// - XPath selects what a walk of the tree selects for random expressions of every axis and predicate it supports,
+//   from random context nodes, in document order and without duplicates where '//' steps overlap,
+// - get_elements_by_tag_name() with a tag index finds what a walk of the tree finds after random edits, and
+//   neither lookups nor inserts next to 200,000 comments scan them,
+// - Snapshot::to_document() gives the document the snapshot was created from, images with a flipped byte,
+//   another version, a wrong size, a reference out of bounds or "--" in a comment are rejected with IOError.
+//
+// PersistentDocument is checked against a DOM::Document as reference model: both get the same random edits,
+// which have to fail on the same ones and leave the same tree, while the versions copied before and the
+// versions in a DocumentHistory keep what they had.
+//
+// Usage: xml-regression-check [iterations] [seed] [file...]
+//
+// Mismatches are printed to stderr with the input, the exit code is 1 if there are any.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Errors.hpp"
+#include "Parser.hpp"
+#include "PersistentDocument.hpp"
+#include "Reader.hpp"
+#include "SAXParser.hpp"
+#include "Serializer.hpp"
+#include "Snapshot.hpp"
+#include "XPath.hpp"
+
+namespace
+{
+
+using Engine = XML::Parser::Engine;
+using Path = XML::PersistentDocument::Path;
+
+const char *const names[] = {"a", "b", "item", "x:y", "_n", "data1"};
+
+/// Builds a random document, mostly well-formed: names and references are valid, markup in text is escaped
+class Generator
+{
+public:
+    explicit Generator(std::mt19937 &random) : random(random) {}
+
+    std::string document()
+    {
+        std::string xml;
+        if (chance(2))
+            xml += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        if (chance(4))
+            xml += "<!DOCTYPE a>\n";
+        if (chance(3))
+            xml += "<!-- before -->";
+        element(xml, 0);
+        if (chance(3))
+            xml += "\n<!-- after -->\n";
+        return xml;
+    }
+
+private:
+    bool chance(unsigned n)
+    {
+        return random() % n == 0;
+    }
+
+    const char *name()
+    {
+        return names[random() % std::size(names)];
+    }
+
+    /// Appends text with references and markup characters the serializer has to escape
+    /// \param quote Quote around an attribute value, which can't be in it unescaped
+    void text(std::string &xml, char quote = 0)
+    {
+        static const char *const pieces[] = {"text", " ", "\n  ", "&amp;", "&lt;", "&gt;", "&quot;", "&apos;",
+                                             "&#65;", "&#x42;", "&#x1F600;", "caf\xc3\xa9", "1 &lt; 2", "\"", "'",
+                                             "]]&gt;", "&#60;", "&#38;", "&#x22;", "&#39;", "&#x3E;"};
+        for (auto count = random() % 4; count;) {
+            auto piece = pieces[random() % std::size(pieces)];
+            if (piece[0] == quote and piece[1] == 0)
+                continue;
+            xml += piece;
+            count--;
+        }
+    }
+
+    void element(std::string &xml, size_t depth)
+    {
+        auto tag = name();
+        xml += "<";
+        xml += tag;
+        // attribute names are distinct, repeated ones come from mutations
+        for (size_t i = 0, count = random() % 4; i < count; i++) {
+            auto quote = chance(2) ? '"' : '\'';
+            xml += " at" + std::to_string(i) + "=" + quote;
+            text(xml, quote);
+            xml += quote;
+        }
+        if (chance(5)) {
+            xml += "/>";
+            return;
+        }
+        xml += ">";
+
+        for (auto count = depth < 6 ? random() % 5 : 0; count; count--) {
+            switch (random() % 5) {
+                case 0:
+                    xml += "<!-- comment -->";
+                    break;
+                case 1:
+                    xml += chance(2) ? "<![CDATA[a < b && c]]>" : "<![CDATA[\"q\" 'a' ]] ]>]]>";
+                    break;
+                case 2:
+                    text(xml);
+                    break;
+                default:
+                    element(xml, depth + 1);
+            }
+        }
+        xml += "</";
+        xml += tag;
+        xml += ">";
+    }
+
+    std::mt19937 &random;
+};
+
+/// Changes, inserts or removes a few bytes, mostly markup characters
+std::string mutate(std::string xml, std::mt19937 &random)
+{
+    static const char alphabet[] = "<>\"'/=!?-[] \n\0aB:_]CDAT1&;#x";
+    for (auto count = 1 + random() % 3; count and not xml.empty(); count--) {
+        auto position = random() % xml.size();
+        auto ch = alphabet[random() % (sizeof(alphabet) - 1)];
+        switch (random() % 3) {
+            case 0:
+                xml[position] = ch;
+                break;
+            case 1:
+                xml.insert(xml.begin() + position, ch);
+                break;
+            default:
+                xml.erase(position, 1);
+        }
+    }
+    return xml;
+}
+
+/// Replaces each run of whitespace in text with one space and trims it
+std::string collapse_whitespace(std::string_view text)
+{
+    std::string out;
+    bool space = false;
+    for (auto ch : text) {
+        if (ch == ' ' or ch == '\t' or ch == '\n' or ch == '\r') {
+            space = true;
+            continue;
+        }
+        if (space and not out.empty())
+            out += ' ';
+        space = false;
+        out += ch;
+    }
+    return out;
+}
+
+/// Appends node and its descendants to out, loading lazy elements
+/// \param whitespace False to collapse whitespace in values of text, comments and CDATA sections
+/// and leave out text that is only whitespace, which the Serializer changes
+void describe(const XML::DOM::Node &node, std::string &out, bool whitespace = true)
+{
+    auto value = std::string(node.value());
+    if (not whitespace and node.type() != XML::DOM::Node::Type::ELEMENT_NODE) {
+        value = collapse_whitespace(value);
+        if (value.empty() and node.type() == XML::DOM::Node::Type::TEXT_NODE)
+            return;
+    }
+
+    out += std::to_string(static_cast<int>(node.type()));
+    out += '|';
+    out += node.name();
+    out += '|';
+    out += value;
+    out += '|';
+    if (node.type() == XML::DOM::Node::Type::ELEMENT_NODE) {
+        for (auto &attribute : static_cast<const XML::DOM::Element &>(node).attributes()) {
+            out += attribute.name.view();
+            out += '=';
+            out += attribute.value;
+            out += ';';
+        }
+    }
+    out += '{';
+    for (auto child = node.first_child(); child; child = child->next_sibling())
+        describe(*child, out, whitespace);
+    out += '}';
+}
+
+std::string describe(const XML::DOM::Document &document, bool whitespace = true)
+{
+    std::string out = document.xml_prolog() + "#" + document.doctype() + "#";
+    describe(static_cast<const XML::DOM::Node &>(document), out, whitespace);
+    return out;
+}
+
+/// Tree the input was parsed into, or the error
+struct Outcome
+{
+    bool ok;
+    std::string text;
+
+    bool operator==(const Outcome &other) const
+    {
+        return ok == other.ok and text == other.text;
+    }
+};
+
+/// Runs f and describes the document it returns or the exception it throws
+template<class F>
+Outcome outcome(F f)
+{
+    try {
+        return {true, f()};
+    } catch (XML::SyntaxError &e) {
+        return {false, std::string("SyntaxError: ") + e.what()};
+    } catch (XML::DOMError &e) {
+        return {false, std::string("DOMError: ") + e.what()};
+    } catch (XML::IOError &e) {
+        return {false, std::string("IOError: ") + e.what()};
+    } catch (std::exception &e) {
+        return {false, std::string("exception: ") + e.what()};
+    }
+}
+
+XML::Parser parser(Engine engine)
+{
+    XML::Parser parser;
+    parser.set_engine(engine);
+    return parser;
+}
+
+size_t failures = 0;
+
+void report(const std::string &check, const std::string &input, const Outcome &expected, const Outcome &actual)
+{
+    if (failures++ >= 10)
+        return;
+    auto shorten = [](const std::string &text) { return text.size() > 400 ? text.substr(0, 400) + "..." : text; };
+    std::cerr << "MISMATCH in " << check << "\n  input:    " << shorten(input)
+              << "\n  expected: " << shorten(expected.text) << "\n  actual:   " << shorten(actual.text) << "\n";
+}
+
+void expect(const std::string &check, const std::string &input, const Outcome &expected, const Outcome &actual)
+{
+    if (not (expected == actual))
+        report(check, input, expected, actual);
+}
+
+/// Passes input to a Reader or SAXParser in chunks cut at random offsets
+class Chunks
+{
+public:
+    Chunks(const std::string &input, std::mt19937 &random) : input(input)
+    {
+        for (auto count = random() % 8; count and not input.empty(); count--)
+            splits.push_back(random() % input.size());
+        // now and then a chunk per byte
+        if (random() % 16 == 0)
+            for (size_t i = 1; i < input.size(); i++)
+                splits.push_back(i);
+        std::sort(splits.begin(), splits.end());
+    }
+
+    /// Passes the next chunk to feed, or calls finish after the last one
+    template<class Feed, class Finish>
+    void pass(Feed feed, Finish finish)
+    {
+        if (fed == input.size() and done) {
+            finish();
+            return;
+        }
+        auto end = next < splits.size() ? splits[next++] : input.size();
+        if (end == input.size())
+            done = true;
+        feed(std::string_view(input).substr(fed, end - fed));
+        fed = end;
+    }
+
+private:
+    const std::string &input;
+    std::vector<size_t> splits;
+    size_t next = 0;
+    size_t fed = 0;
+    bool done = false;
+};
+
+/// Appends the node reader is on to out
+void describe(const XML::Reader &reader, std::string &out)
+{
+    out += std::to_string(static_cast<int>(reader.kind()));
+    out += ':';
+    out += std::to_string(reader.depth());
+    out += reader.is_empty_element() ? "e|" : "|";
+    out += reader.name();
+    out += '|';
+    out += reader.value();
+    out += '|';
+    for (auto &attribute : reader.attributes()) {
+        out += attribute.name;
+        out += '=';
+        out += attribute.value;
+        out += ';';
+    }
+    out += '\n';
+}
+
+/// Reads input with a Reader, in chunks if there are any, and describes its nodes.
+/// Subtrees of elements named skip are skipped with skip_subtree()
+std::string read(const std::string &input, Chunks *chunks, std::string_view skip)
+{
+    XML::Reader reader;
+    if (not chunks)
+        reader.reset(input);
+
+    std::string out;
+    bool skipping = false;
+    while (true) {
+        auto ok = skipping ? reader.skip_subtree() : reader.next();
+        skipping = false;
+        if (not ok) {
+            if (not reader.needs_input())
+                return out;
+            chunks->pass([&](std::string_view chunk) { reader.feed(chunk); }, [&] { reader.finish(); });
+            continue;
+        }
+        describe(reader, out);
+        skipping = reader.kind() == XML::Reader::Kind::START_ELEMENT and reader.name() == skip;
+    }
+}
+
+/// Describes the events of a SAXParser
+class Recorder : public XML::Handler
+{
+public:
+    void start_document() override { out += "start_document\n"; }
+    void end_document() override { out += "end_document\n"; }
+    void processing_instruction(std::string_view value) override { event("pi", value); }
+    void doctype(std::string_view value) override { event("doctype", value); }
+
+    void start_element(std::string_view name, const std::vector<XML::Attribute> &attributes) override
+    {
+        event("start", name);
+        for (auto &attribute : attributes) {
+            out += attribute.name;
+            out += '=';
+            out += attribute.value;
+            out += ';';
+        }
+    }
+
+    void end_element(std::string_view name) override { event("end", name); }
+    void text(std::string_view value) override { event("text", value); }
+    void cdata(std::string_view value) override { event("cdata", value); }
+    void comment(std::string_view value) override { event("comment", value); }
+
+    std::string out;
+
+private:
+    void event(const char *kind, std::string_view value)
+    {
+        out += '\n';
+        out += kind;
+        out += '|';
+        out += value;
+    }
+};
+
+/// Parses input with a SAXParser, in chunks if there are any, and describes its events
+std::string sax(const std::string &input, Chunks *chunks)
+{
+    Recorder recorder;
+    XML::SAXParser parser(recorder);
+    try {
+        if (chunks) {
+            bool finished = false;
+            while (not finished)
+                chunks->pass([&](std::string_view chunk) { parser.feed(chunk); },
+                             [&] { parser.finish(); finished = true; });
+        } else {
+            parser.parse(input);
+        }
+    } catch (...) {
+        // the events before the error have to be the same too
+        recorder.out += "\nerror";
+        throw std::runtime_error(recorder.out);
+    }
+    return recorder.out;
+}
+
+/// Compares the nodes and events of incremental input with the ones of the whole input
+void check_incremental(const std::string &input, const Outcome &reference, std::mt19937 &random)
+{
+    auto whole = outcome([&] { return read(input, nullptr, {}); });
+    // Reader accepts what parse() accepts and throws what it throws
+    Outcome checked{reference.ok, reference.ok ? std::string() : reference.text};
+    expect("Reader", input, checked, {whole.ok, whole.ok ? std::string() : whole.text});
+
+    Chunks chunks(input, random);
+    expect("Reader::feed()", input, whole, outcome([&] { return read(input, &chunks, {}); }));
+
+    auto skip = names[random() % std::size(names)];
+    Chunks skip_chunks(input, random);
+    expect(std::string("Reader::skip_subtree() of ") + skip + " with feed()", input,
+           outcome([&] { return read(input, nullptr, skip); }),
+           outcome([&] { return read(input, &skip_chunks, skip); }));
+
+    Chunks sax_chunks(input, random);
+    expect("SAXParser::feed()", input, outcome([&] { return sax(input, nullptr); }),
+           outcome([&] { return sax(input, &sax_chunks); }));
+}
+
+/// Compares parse_parallel() with parse() on a root with enough children to be cut into pieces, as it is,
+/// with a NUL byte between two children, which ends the input there, and with a few bytes changed
+void check_parallel(std::mt19937 &random)
+{
+    std::string input = "<root>";
+    for (size_t i = 0; i < 200000; i++)
+        input += "<item n=\"" + std::to_string(i) + "\">text &amp; more</item>";
+    input += "</root>";
+
+    auto nul = input;
+    auto child = nul.find("<item", random() % nul.size());
+    nul.insert(child == std::string::npos ? nul.size() / 2 : child, 1, '\0');
+
+    for (auto &piece : {input, nul, mutate(input, random)}) {
+        auto expected = outcome([&] { return describe(XML::Parser().parse(piece)); });
+        auto parallel = outcome([&] { return describe(XML::Parser().parse_parallel(piece, 4)); });
+        // the input is too long to print
+        if (not (expected == parallel))
+            report("parse_parallel()", piece.substr(0, 200), expected, parallel);
+    }
+}
+
+/// Times lookups from and inserts into an element followed by 200,000 comments with a tag index. Labels of
+/// the neighbours are one link away, so 1000 of each take milliseconds, a scan over the comments takes seconds
+void check_tag_index_neighbours()
+{
+    std::string input = "<r><a/>";
+    for (size_t i = 0; i < 200000; i++)
+        input += "<!---->";
+    input += "</r>";
+
+    auto document = XML::Parser().parse(input);
+    document.enable_tag_index();
+    auto root = document.root_element();
+    auto a = static_cast<XML::DOM::Element *>(root->first_child());
+
+    auto start = std::chrono::steady_clock::now();
+    size_t found = 0;
+    for (size_t i = 0; i < 1000; i++) {
+        a->append_child(document.create_element("a"));
+        root->append_child(document.create_element("a"));
+        found += a->get_elements_by_tag_name("a").size();
+    }
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // a + its children after each insert
+    expect("tag index lookups", input.substr(0, 200), {true, std::to_string(1000 * 1001 / 2 + 1000)},
+           {true, std::to_string(found)});
+    if (seconds > 1)
+        report("tag index next to 200,000 comments", input.substr(0, 200), {true, "under 1 s"},
+               {true, std::to_string(seconds) + " s"});
+}
+
+/// Compares text_content() of a lazy document 200,000 elements deep with the one of the parsed document.
+/// Loads continue after the spans of the children found when the input was parsed, so this is one pass over it
+void check_deep_lazy()
+{
+    std::string input;
+    for (size_t i = 0; i < 200000; i++)
+        input += "<a n=\"" + std::to_string(i % 10) + "\">t<!-- c -->";
+    input += "<b/>";
+    for (size_t i = 0; i < 200000; i++)
+        input += "</a>";
+
+    auto expected = outcome([&] { return XML::Parser().parse(input).root_element()->text_content(); });
+    auto lazy = outcome([&] { return XML::Parser().parse_lazy(input).root_element()->text_content(); });
+    expect("parse_lazy() of deep elements", input.substr(0, 200), expected, lazy);
+}
+
+/// Serializes document indented or minified
+std::string serialize(const XML::DOM::Document &document, size_t tab_size, bool minified)
+{
+    std::string out;
+    XML::StringSink sink(out);
+    XML::Serializer serializer(sink, tab_size);
+    serializer.set_minified(minified);
+    serializer.write(document);
+    return out;
+}
+
+/// Parses the output of the Serializer, which has to give the same tree up to whitespace in text, and has to be
+/// written again byte for byte
+void check_round_trip(const std::string &input)
+{
+    auto document = XML::Parser().parse(input);
+    // the prolog and doctype are written as they were read, which is not markup again if a mutation cut them
+    auto ends_with = [](const std::string &text, std::string_view end) {
+        return text.size() >= end.size() and text.compare(text.size() - end.size(), end.size(), end) == 0;
+    };
+    if ((not document.xml_prolog().empty() and not ends_with(document.xml_prolog(), "?>")) or
+        (not document.doctype().empty() and not ends_with(document.doctype(), ">")) or
+        input.find('\0') != std::string::npos)
+        return;
+
+    auto expected = outcome([&] { return describe(document, false); });
+    for (auto [tab_size, minified] : {std::pair<size_t, bool>(0, false), {4, false}, {0, true}}) {
+        std::string mode = minified ? " minified" : " with tab size " + std::to_string(tab_size);
+        auto output = serialize(document, tab_size, minified);
+        std::string again;
+        auto parsed = outcome([&] {
+            auto copy = XML::Parser().parse(output);
+            again = serialize(copy, tab_size, minified);
+            return describe(copy, false);
+        });
+        expect("parse() of Serializer output" + mode, input, expected, parsed);
+        if (parsed.ok)
+            expect("Serializer output of its parsed output" + mode, input, {true, output}, {true, again});
+    }
+}
+
+/// Compares the root element of input with its copy made by Document::import_node() while the source is lazy,
+/// and checks that nodes of the copy are rejected by the source
+void check_import(const std::string &input)
+{
+    auto describe_root = [](const XML::DOM::Document &document) {
+        std::string out;
+        describe(*document.root_element(), out);
+        return out;
+    };
+
+    auto source = XML::Parser().parse(input);
+    if (not source.root_element())
+        return;
+    auto expected = outcome([&] { return describe_root(source); });
+    auto imported = outcome([&] {
+        auto lazy = XML::Parser().parse_lazy(input);
+        XML::DOM::Document copy;
+        copy.append_child(copy.import_node(lazy.root_element()));
+        return describe_root(copy);
+    });
+    expect("Document::import_node()", input, expected, imported);
+
+    XML::DOM::Document other;
+    auto foreign = outcome([&] {
+        source.root_element()->append_child(other.create_comment("foreign"));
+        return describe(source);
+    });
+    if (foreign.ok or foreign.text.rfind("DOMError", 0) != 0)
+        report("append_child() of a node of another document", input, {false, "DOMError"}, foreign);
+
+    // a rejected root element leaves the document without one, the root of source would dangle once it is gone
+    XML::DOM::Document target;
+    target.append_child(target.create_comment("before"));
+    auto parent = target.create_element("parent");
+    auto linked = target.create_element("child");
+    parent->append_child(linked);
+    for (auto node : {static_cast<XML::DOM::Node *>(source.root_element()), static_cast<XML::DOM::Node *>(linked)}) {
+        for (auto insert : {false, true}) {
+            std::string name = insert ? "Document::insert_before()" : "Document::append_child()";
+            name += node == linked ? " of a node with a parent" : " of the root of another document";
+            auto rejected = outcome([&] {
+                if (insert)
+                    target.insert_before(node, target.first_child());
+                else
+                    target.append_child(node);
+                return std::string();
+            });
+            if (rejected.ok or rejected.text.rfind("DOMError", 0) != 0)
+                report(name, input, {false, "DOMError"}, rejected);
+            if (target.root_element())
+                report(name + " root_element()", input, {true, "none"}, {true, std::string(target.root_element()->name())});
+        }
+    }
+}
+
+/// Edits a document with a tag index at random places and compares get_elements_by_tag_name() of the document
+/// and of random elements with a walk of the tree after each edit. Elements inserted again and again before the
+/// same one use up the labels between their neighbours, so the labels around them are spread out again
+void check_tag_index(const std::string &input, std::mt19937 &random)
+{
+    auto document = XML::Parser().parse_lazy(input);
+    document.enable_tag_index();
+
+    auto check_matches = [&](const std::string &edit) {
+        std::unordered_map<const XML::DOM::Node *, size_t> positions;
+        std::vector<XML::DOM::Node *> elements;
+        for (auto node : document.pre_order(XML::DOM::Node::Type::ELEMENT_NODE)) {
+            positions[node] = positions.size();
+            elements.push_back(node);
+        }
+        auto positions_of = [&](const std::list<XML::DOM::Element *> &matches) {
+            std::string out;
+            for (auto element : matches)
+                out += std::to_string(positions[element]) + " ";
+            return out;
+        };
+
+        std::vector<XML::DOM::Node *> contexts{&document};
+        if (not elements.empty())
+            contexts.push_back(elements[random() % elements.size()]);
+        for (auto context : contexts) {
+            for (auto name : names) {
+                std::string walked;
+                for (auto node : context->pre_order(XML::DOM::Node::Type::ELEMENT_NODE, name))
+                    walked += std::to_string(positions[node]) + " ";
+                expect("tag index after " + edit + ", " + name + " from " + std::to_string(positions[context]),
+                       input, {true, walked}, {true, positions_of(context->get_elements_by_tag_name(name))});
+            }
+        }
+        return elements;
+    };
+
+    auto elements = check_matches("enable_tag_index()");
+    // edits that don't apply to the element picked are skipped
+    for (size_t i = 0; i < 20 and not elements.empty(); i++) {
+        auto element = elements[random() % elements.size()];
+        std::string edit;
+        switch (random() % 4) {
+            case 0: {
+                // a new element with a child before a random child, or at the end
+                auto child = document.create_element(names[random() % std::size(names)]);
+                child->append_child(document.create_element(names[random() % std::size(names)]));
+                auto children = element->child_nodes();
+                if (children.empty() or random() % 3 == 0) {
+                    element->append_child(child);
+                    edit = "append_child()";
+                } else {
+                    element->insert_before(child, element->child_at(random() % children.size()));
+                    edit = "insert_before()";
+                }
+                break;
+            }
+            case 1: {
+                if (element->parent_node() == &document)
+                    continue;
+                element->parent_node()->remove_child(element);
+                edit = "remove_child()";
+                break;
+            }
+            case 2: {
+                element->set_name(names[random() % std::size(names)]);
+                edit = "set_name()";
+                break;
+            }
+            default: {
+                auto other = elements[random() % elements.size()];
+                if (other == element or other->is_ancestor(element))
+                    continue;
+                element->append_children_of(other);
+                edit = "append_children_of()";
+            }
+        }
+        elements = check_matches(edit);
+    }
+
+    auto root = document.root_element();
+    if (not root)
+        return;
+    auto ref = document.create_element("x:y");
+    if (root->has_child_nodes())
+        root->insert_before(ref, root->first_child());
+    else
+        root->append_child(ref);
+    for (size_t i = 0; i < 200; i++)
+        root->insert_before(document.create_element(names[i % std::size(names)]), ref);
+    check_matches("inserts before one element");
+}
+
+/// Checksum of the snapshot format (see Snapshot.cpp), so records can be corrupted without the checksum
+/// noticing and the checks of the records have to
+uint64_t snapshot_checksum(std::string_view image)
+{
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    auto mix = [&](uint64_t hash, uint64_t word) {
+        hash ^= word;
+        return ((hash << 27) | (hash >> 37)) * multiplier;
+    };
+    uint64_t hash = image.size() * multiplier;
+    for (size_t pos = 0; pos < image.size(); pos += 8) {
+        uint64_t word = 0;
+        if (pos != offsetof(XML::Snapshot::Header, checksum))
+            std::memcpy(&word, image.data() + pos, std::min<size_t>(8, image.size() - pos));
+        hash = mix(hash, word);
+    }
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+    return hash ^ (hash >> 31);
+}
+
+/// Sets the checksum of a snapshot image to the one of its bytes
+std::string seal(std::string image)
+{
+    auto sum = snapshot_checksum(image);
+    std::memcpy(&image[offsetof(XML::Snapshot::Header, checksum)], &sum, sizeof(sum));
+    return image;
+}
+
+/// Opens a copy of image aligned to 8 bytes and describes the document it holds
+Outcome open_snapshot(const std::string &image)
+{
+    std::vector<uint64_t> words(image.size() / 8 + 1);
+    std::memcpy(words.data(), image.data(), image.size());
+    return outcome([&] {
+        XML::Snapshot snapshot(std::string_view(reinterpret_cast<const char *>(words.data()), image.size()));
+        return describe(snapshot.to_document());
+    });
+}
+
+/// Compares the document of a snapshot with the one it was created from, and checks that images with a flipped
+/// byte, another version, a wrong size or a reference out of bounds are rejected with IOError. Except for the
+/// flipped byte the checksum is fixed, so the header and records are what rejects them
+void check_snapshot(const std::string &input, std::mt19937 &random)
+{
+    auto document = XML::Parser().parse(input);
+    auto image = XML::Snapshot::create(document);
+    expect("Snapshot::to_document()", input, {true, describe(document)}, open_snapshot(image));
+
+    using Header = XML::Snapshot::Header;
+    using NodeRecord = XML::Snapshot::NodeRecord;
+    Header header;
+    std::memcpy(&header, image.data(), sizeof(Header));
+    auto with_header = [&](auto change) {
+        auto copy = header;
+        change(copy);
+        auto corrupted = image;
+        std::memcpy(&corrupted[0], &copy, sizeof(Header));
+        return corrupted;
+    };
+    auto with_node = [&](uint32_t index, auto change) {
+        NodeRecord node;
+        auto offset = header.nodes + index * sizeof(NodeRecord);
+        std::memcpy(&node, image.data() + offset, sizeof(NodeRecord));
+        change(node);
+        auto corrupted = image;
+        std::memcpy(&corrupted[offset], &node, sizeof(NodeRecord));
+        return corrupted;
+    };
+
+    auto flipped = image;
+    flipped[random() % flipped.size()] ^= static_cast<char>(1 + random() % 255);
+    auto last = header.node_count - 1;
+    std::pair<const char *, std::string> corruptions[] = {
+        {"flipped byte", flipped},
+        {"version", seal(with_header([](Header &h) { h.version++; }))},
+        {"truncated image", image.substr(0, image.size() - 8)},
+        {"truncated size", seal(with_header([](Header &h) { h.size -= 8; }).substr(0, image.size() - 8))},
+        {"section offset", seal(with_header([&](Header &h) { h.strings = image.size() + 8; }))},
+        {"string offset", seal(with_node(last, [&](NodeRecord &n) { n.value.offset = header.strings_size + 1; }))},
+        {"node index", seal(with_node(last, [&](NodeRecord &n) { n.parent = header.node_count; }))},
+    };
+    for (auto &[name, corrupted] : corruptions) {
+        auto opened = open_snapshot(corrupted);
+        if (opened.ok or opened.text.rfind("IOError", 0) != 0)
+            report(std::string("Snapshot of an image with wrong ") + name, input, {false, "IOError"}, opened);
+    }
+}
+
+/// Points the value of a comment in a snapshot at the text "--" of another node, which to_document() can't set,
+/// so Snapshot has to reject the image with IOError like the corrupted images of check_snapshot()
+void check_snapshot_comment()
+{
+    std::string input = "<r><!--c-->--</r>";
+    auto image = XML::Snapshot::create(XML::Parser().parse(input));
+    XML::Snapshot::Header header;
+    std::memcpy(&header, image.data(), sizeof(header));
+
+    // the document, r, the comment and the text
+    XML::Snapshot::NodeRecord comment, text;
+    auto comment_offset = header.nodes + 2 * sizeof(comment);
+    std::memcpy(&comment, image.data() + comment_offset, sizeof(comment));
+    std::memcpy(&text, image.data() + comment_offset + sizeof(comment), sizeof(text));
+    comment.value = text.value;
+    std::memcpy(&image[comment_offset], &comment, sizeof(comment));
+
+    auto opened = open_snapshot(seal(image));
+    if (opened.ok or opened.text.rfind("IOError", 0) != 0)
+        report("Snapshot of an image with \"--\" in a comment", input, {false, "IOError"}, opened);
+}
+
+/// Step of a random XPath expression, evaluated by XPath and by walking the tree like XPath 1.0 defines it
+struct QueryStep
+{
+    enum class Axis
+    {
+        CHILD,
+        // '//', descendant-or-self::node()/child::
+        DESCENDANT,
+        SELF,
+        PARENT,
+        ATTRIBUTE
+    };
+
+    struct Predicate
+    {
+        enum class Kind
+        {
+            POSITION,
+            LAST,
+            HAS_ATTRIBUTE,
+            ATTRIBUTE_EQ,
+            ATTRIBUTE_NE,
+            TEXT_EQ,
+            HAS_CHILD
+        };
+
+        Kind kind;
+        std::string name;
+        std::string value;
+        size_t position;
+    };
+
+    Axis axis;
+    // name, "*", "text()", "comment()" or "node()"
+    std::string test;
+    std::vector<Predicate> predicates;
+    // '//' before an attribute step
+    bool descendant_attribute;
+};
+
+/// Writes a literal in the quotes it doesn't contain
+std::string quote(const std::string &value)
+{
+    return value.find('\'') == std::string::npos ? "'" + value + "'" : "\"" + value + "\"";
+}
+
+std::string to_string(const std::vector<QueryStep> &steps, bool absolute)
+{
+    using Axis = QueryStep::Axis;
+    using Kind = QueryStep::Predicate::Kind;
+    std::string out;
+    for (size_t i = 0; i < steps.size(); i++) {
+        auto &step = steps[i];
+        bool descendant = step.axis == Axis::DESCENDANT or step.descendant_attribute;
+        if (descendant)
+            out += "//";
+        else if (i > 0 or absolute)
+            out += "/";
+
+        switch (step.axis) {
+            case Axis::SELF:
+                out += ".";
+                continue;
+            case Axis::PARENT:
+                out += "..";
+                continue;
+            case Axis::ATTRIBUTE:
+                out += "@" + step.test;
+                continue;
+            default:
+                out += step.test;
+        }
+        for (auto &predicate : step.predicates) {
+            out += '[';
+            switch (predicate.kind) {
+                case Kind::POSITION:
+                    out += std::to_string(predicate.position);
+                    break;
+                case Kind::LAST:
+                    out += predicate.position ? "last()-" + std::to_string(predicate.position) : "last()";
+                    break;
+                case Kind::HAS_ATTRIBUTE:
+                    out += "@" + predicate.name;
+                    break;
+                case Kind::ATTRIBUTE_EQ:
+                    out += "@" + predicate.name + "=" + quote(predicate.value);
+                    break;
+                case Kind::ATTRIBUTE_NE:
+                    out += "@" + predicate.name + "!=" + quote(predicate.value);
+                    break;
+                case Kind::TEXT_EQ:
+                    out += "text()=" + quote(predicate.value);
+                    break;
+                case Kind::HAS_CHILD:
+                    out += predicate.name;
+                    break;
+            }
+            out += ']';
+        }
+    }
+    return out;
+}
+
+bool is_text(const XML::DOM::Node *node)
+{
+    return node->type() == XML::DOM::Node::Type::TEXT_NODE or node->type() == XML::DOM::Node::Type::CDATA_SECTION_NODE;
+}
+
+bool matches(const XML::DOM::Node *node, const std::string &test)
+{
+    auto element = node->type() == XML::DOM::Node::Type::ELEMENT_NODE;
+    if (test == "node()")
+        return true;
+    if (test == "text()")
+        return is_text(node);
+    if (test == "comment()")
+        return node->type() == XML::DOM::Node::Type::COMMENT_NODE;
+    return element and (test == "*" or node->name() == test);
+}
+
+std::optional<std::string_view> attribute(const XML::DOM::Node *node, const std::string &name)
+{
+    if (node->type() != XML::DOM::Node::Type::ELEMENT_NODE)
+        return std::nullopt;
+    return static_cast<const XML::DOM::Element *>(node)->find_attribute(name);
+}
+
+/// Filters the candidates of one context node by the predicates of step, each one numbering what the one
+/// before it left
+std::vector<XML::DOM::Node *> filter(std::vector<XML::DOM::Node *> candidates, const QueryStep &step)
+{
+    using Kind = QueryStep::Predicate::Kind;
+    for (auto &predicate : step.predicates) {
+        std::vector<XML::DOM::Node *> kept;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            auto node = candidates[i];
+            auto position = i + 1;
+            auto value = attribute(node, predicate.name);
+            bool keep = false;
+            switch (predicate.kind) {
+                case Kind::POSITION:
+                    keep = position == predicate.position;
+                    break;
+                case Kind::LAST:
+                    keep = position + predicate.position == candidates.size();
+                    break;
+                case Kind::HAS_ATTRIBUTE:
+                    keep = value.has_value();
+                    break;
+                case Kind::ATTRIBUTE_EQ:
+                    keep = value and *value == predicate.value;
+                    break;
+                case Kind::ATTRIBUTE_NE:
+                    keep = value and *value != predicate.value;
+                    break;
+                case Kind::TEXT_EQ:
+                case Kind::HAS_CHILD:
+                    for (auto child = node->first_child(); child; child = child->next_sibling()) {
+                        if (predicate.kind == Kind::TEXT_EQ)
+                            keep = keep or (is_text(child) and child->value() == predicate.value);
+                        else
+                            keep = keep or matches(child, predicate.name);
+                    }
+                    break;
+            }
+            if (keep)
+                kept.push_back(node);
+        }
+        candidates = std::move(kept);
+    }
+    return candidates;
+}
+
+/// Evaluates steps without the attribute step by walking the tree
+std::vector<XML::DOM::Node *> walk(XML::DOM::Node *context, const std::vector<QueryStep> &steps, bool absolute)
+{
+    using Axis = QueryStep::Axis;
+    if (absolute)
+        while (context->parent_node())
+            context = context->parent_node();
+
+    // positions in document order
+    auto root = context;
+    while (root->parent_node())
+        root = root->parent_node();
+    std::unordered_map<const XML::DOM::Node *, size_t> order;
+    for (auto node : root->pre_order())
+        order.emplace(node, order.size());
+
+    std::vector<XML::DOM::Node *> nodes{context};
+    for (auto &step : steps) {
+        std::vector<XML::DOM::Node *> next;
+        for (auto node : nodes) {
+            switch (step.axis) {
+                case Axis::CHILD:
+                case Axis::DESCENDANT:
+                case Axis::ATTRIBUTE: {
+                    // the parents whose children are candidates, attribute steps take the elements themselves
+                    std::vector<XML::DOM::Node *> parents{node};
+                    if (step.axis == Axis::DESCENDANT or step.descendant_attribute) {
+                        parents.clear();
+                        for (auto descendant : node->pre_order())
+                            parents.push_back(descendant);
+                    }
+                    for (auto parent : parents) {
+                        if (step.axis == Axis::ATTRIBUTE) {
+                            if (parent->type() == XML::DOM::Node::Type::ELEMENT_NODE)
+                                next.push_back(parent);
+                            continue;
+                        }
+                        std::vector<XML::DOM::Node *> candidates;
+                        for (auto child = parent->first_child(); child; child = child->next_sibling())
+                            if (matches(child, step.test))
+                                candidates.push_back(child);
+                        for (auto selected : filter(candidates, step))
+                            next.push_back(selected);
+                    }
+                    break;
+                }
+                case Axis::SELF:
+                    next.push_back(node);
+                    break;
+                case Axis::PARENT:
+                    if (node->parent_node())
+                        next.push_back(node->parent_node());
+                    break;
+            }
+        }
+        std::sort(next.begin(), next.end(), [&](auto a, auto b) { return order[a] < order[b]; });
+        next.erase(std::unique(next.begin(), next.end()), next.end());
+        nodes = std::move(next);
+    }
+    return nodes;
+}
+
+/// Builds a random expression of the supported subset, with names and values of document
+std::vector<QueryStep> random_query(const XML::DOM::Document &document, bool absolute, std::mt19937 &random)
+{
+    using Axis = QueryStep::Axis;
+    using Kind = QueryStep::Predicate::Kind;
+    static const char *const tests[] = {"*", "text()", "comment()", "node()"};
+
+    // values that occur in the document, so equality predicates select something
+    std::vector<std::string> values{"x"};
+    for (auto node : document.pre_order()) {
+        if (is_text(node))
+            values.emplace_back(node->value());
+        if (node->type() == XML::DOM::Node::Type::ELEMENT_NODE)
+            for (auto &attr : static_cast<const XML::DOM::Element *>(node)->attributes())
+                values.emplace_back(attr.value);
+    }
+    // a literal can't have both quotes
+    values.erase(std::remove_if(values.begin(), values.end(), [](auto &value) {
+        return value.find('\'') != std::string::npos and value.find('"') != std::string::npos;
+    }), values.end());
+    auto name = [&] { return std::string(names[random() % std::size(names)]); };
+    auto attribute_name = [&] { return "at" + std::to_string(random() % 3); };
+
+    std::vector<QueryStep> steps;
+    for (auto count = 1 + random() % 4; count; count--) {
+        QueryStep step{Axis::CHILD, name(), {}, false};
+        auto kind = random() % 8;
+        // a relative path can't start with '//', '.' and '..' can't follow it
+        if (kind < 3 and (absolute or not steps.empty()))
+            step.axis = Axis::DESCENDANT;
+        else if (kind == 3)
+            step.axis = Axis::SELF;
+        else if (kind == 4)
+            step.axis = Axis::PARENT;
+        if (random() % 3 == 0)
+            step.test = tests[random() % std::size(tests)];
+
+        if (step.axis == Axis::CHILD or step.axis == Axis::DESCENDANT) {
+            for (auto predicates = random() % 3; predicates; predicates--) {
+                QueryStep::Predicate predicate{static_cast<Kind>(random() % 7), attribute_name(),
+                                               values[random() % values.size()], random() % 4};
+                if (predicate.kind == Kind::POSITION)
+                    predicate.position++;
+                if (predicate.kind == Kind::HAS_CHILD)
+                    predicate.name = name();
+                step.predicates.push_back(predicate);
+            }
+        }
+        steps.push_back(step);
+    }
+
+    if (random() % 4 == 0) {
+        bool descendant = random() % 2;
+        steps.push_back({Axis::ATTRIBUTE, random() % 4 ? attribute_name() : "*", {}, descendant});
+    }
+    return steps;
+}
+
+/// Compares random XPath queries from random context nodes with walks of the tree
+void check_xpath(const std::string &input, std::mt19937 &random)
+{
+    auto document = XML::Parser().parse(input);
+    std::vector<XML::DOM::Node *> nodes;
+    for (auto node : document.pre_order())
+        nodes.push_back(node);
+
+    auto describe_nodes = [](const std::vector<XML::DOM::Node *> &selected) {
+        std::string out;
+        for (auto node : selected) {
+            describe(*node, out);
+            out += '\n';
+        }
+        return out;
+    };
+
+    for (size_t i = 0; i < 10; i++) {
+        bool absolute = random() % 2;
+        auto steps = random_query(document, absolute, random);
+        auto expression = to_string(steps, absolute);
+        auto context = nodes[random() % nodes.size()];
+
+        Outcome expected, actual;
+        if (steps.back().axis == QueryStep::Axis::ATTRIBUTE) {
+            auto &last = steps.back();
+            std::string values;
+            // the attribute step selects the elements whose attributes are taken
+            for (auto element : walk(context, steps, absolute))
+                for (auto &attr : static_cast<const XML::DOM::Element *>(element)->attributes())
+                    if (last.test == "*" or attr.name.view() == last.test)
+                        values += std::string(attr.value) + "\n";
+            expected = {true, values};
+            actual = outcome([&] {
+                std::vector<std::string_view> selected;
+                XML::XPath(expression).select_values(context, selected);
+                std::string out;
+                for (auto value : selected)
+                    out += std::string(value) + "\n";
+                return out;
+            });
+        } else {
+            expected = {true, describe_nodes(walk(context, steps, absolute))};
+            actual = outcome([&] { return describe_nodes(XML::XPath(expression).select(context)); });
+        }
+        expect("XPath " + expression, input, expected, actual);
+    }
+}
+
+/// Runs every check on input
+/// \return True if the reference engine accepted it
+bool check(const std::string &input, std::mt19937 &random)
+{
+    auto reference = outcome([&] { return describe(parser(Engine::LEXER).parse(input)); });
+
+    auto indexed = outcome([&] { return describe(parser(Engine::STRUCTURAL_INDEX).parse(input)); });
+    expect("Engine::STRUCTURAL_INDEX parse()", input, reference, indexed);
+
+    // what check() and try_check() give
+    Outcome checked{reference.ok, reference.ok ? std::string() : reference.text};
+    for (auto engine : {Engine::LEXER, Engine::STRUCTURAL_INDEX}) {
+        std::string name = engine == Engine::LEXER ? "Engine::LEXER " : "Engine::STRUCTURAL_INDEX ";
+
+        expect(name + "check()", input, checked, outcome([&] { parser(engine).check(input); return std::string(); }));
+
+        auto error = parser(engine).try_check(input);
+        expect(name + "try_check()", input, checked,
+               error ? outcome([&] { error.raise(); return std::string(); }) : Outcome{true, ""});
+
+        auto result = parser(engine).try_parse(input);
+        expect(name + "try_parse()", input, reference,
+               result ? Outcome{true, describe(result.document)}
+                      : outcome([&] { result.error.raise(); return std::string(); }));
+        // the document of a failed parse is reset
+        if (not result)
+            expect(name + "try_parse() document", input, {true, describe(XML::DOM::Document())},
+                   {true, describe(result.document)});
+    }
+
+    // errors are thrown by the access that loads the element, with messages of their own
+    auto lazy = outcome([&] { return describe(XML::Parser().parse_lazy(input)); });
+    if (reference.ok != lazy.ok or (reference.ok and reference.text != lazy.text))
+        report("parse_lazy()", input, reference, lazy);
+
+    if (reference.ok) {
+        check_import(input);
+        check_round_trip(input);
+        check_xpath(input, random);
+        check_tag_index(input, random);
+        check_snapshot(input, random);
+    }
+    check_incremental(input, reference, random);
+    return reference.ok;
+}
+
+
+/// Appends node and its descendants to out in the format of the DOM nodes
+void describe(const XML::PersistentNode &node, std::string &out)
+{
+    out += std::to_string(static_cast<int>(node.type()));
+    out += '|';
+    out += node.name();
+    out += '|';
+    out += node.value();
+    out += '|';
+    for (size_t i = 0; i < node.attribute_count(); i++) {
+        out += node.attribute_at(i).name;
+        out += '=';
+        out += node.attribute_at(i).value;
+        out += ';';
+    }
+    out += '{';
+    for (size_t i = 0; i < node.child_count(); i++)
+        describe(node.child_at(i), out);
+    out += '}';
+}
+
+std::string describe(const XML::PersistentDocument &version)
+{
+    std::string out = std::string(version.xml_prolog()) + "#" + std::string(version.doctype()) + "#";
+    describe(version.document(), out);
+    return out;
+}
+
+/// Returns node of the model by path, throws DOMError if there is none like PersistentDocument does
+XML::DOM::Node &find(XML::DOM::Document &model, const Path &path)
+{
+    XML::DOM::Node *node = &model;
+    for (auto index : path) {
+        node = node->child_at(index);
+        if (not node)
+            throw XML::DOMError("No node at path");
+    }
+    return *node;
+}
+
+XML::DOM::Element &find_element(XML::DOM::Document &model, const Path &path)
+{
+    auto &node = find(model, path);
+    if (node.type() != XML::DOM::Node::Type::ELEMENT_NODE)
+        throw XML::DOMError("Only elements have attributes");
+    return static_cast<XML::DOM::Element &>(node);
+}
+
+/// Copies a persistent subtree into the model
+XML::DOM::Node *build(XML::DOM::Document &model, const XML::PersistentNode &node)
+{
+    switch (node.type()) {
+        case XML::DOM::Node::Type::TEXT_NODE:
+            return model.create_text_node(node.value());
+        case XML::DOM::Node::Type::CDATA_SECTION_NODE:
+            return model.create_cdata_section(node.value());
+        case XML::DOM::Node::Type::COMMENT_NODE:
+            return model.create_comment(node.value());
+        default:
+            break;
+    }
+
+    auto element = model.create_element(node.name());
+    for (size_t i = 0; i < node.attribute_count(); i++)
+        element->set_attribute(node.attribute_at(i).name, node.attribute_at(i).value);
+    for (size_t i = 0; i < node.child_count(); i++)
+        element->append_child(build(model, node.child_at(i)));
+    return element;
+}
+
+/// Random edits of a version and of its model
+class Editor
+{
+public:
+    Editor(std::mt19937 &random, XML::PersistentDocument &version, XML::DOM::Document &model)
+            : random(random), version(version), model(model) {}
+
+    /// Applies one random edit to both, describing it in name
+    /// \return Outcome of the edit on the version and on the model
+    std::pair<Outcome, Outcome> edit(std::string &name)
+    {
+        auto path = pick();
+        auto text = texts[random() % std::size(texts)];
+        switch (random() % 6) {
+            case 0: {
+                auto attribute = attributes[random() % std::size(attributes)];
+                name = "set_attribute(" + attribute + ")";
+                return run([&] { version.set_attribute(path, attribute, text); },
+                           [&] { find_element(model, path).set_attribute(attribute, text); });
+            }
+            case 1: {
+                auto attribute = attributes[random() % std::size(attributes)];
+                name = "remove_attribute(" + attribute + ")";
+                return run([&] { version.remove_attribute(path, attribute); },
+                           [&] { find_element(model, path).remove_attribute(attribute); });
+            }
+            case 2: {
+                auto child = subtree();
+                name = "append_child()";
+                return run([&] { version.append_child(path, child); },
+                           [&] { find(model, path).append_child(build(model, *child)); });
+            }
+            case 3: {
+                auto child = subtree();
+                auto count = version.node(path) ? version.node(path)->child_count() : 0;
+                auto index = random() % (count + 2);
+                name = "insert_child(" + std::to_string(index) + ")";
+                return run([&] { version.insert_child(path, index, child); }, [&] {
+                    auto &parent = find(model, path);
+                    if (index > count)
+                        throw XML::DOMError("Index out of range");
+                    auto node = build(model, *child);
+                    if (index == count)
+                        parent.append_child(node);
+                    else
+                        parent.insert_before(node, parent.child_at(index));
+                });
+            }
+            case 4: {
+                auto count = version.node(path) ? version.node(path)->child_count() : 0;
+                auto index = random() % (count + 1);
+                name = "remove_child(" + std::to_string(index) + ")";
+                return run([&] { version.remove_child(path, index); }, [&] {
+                    auto &parent = find(model, path);
+                    parent.remove_child(parent.child_at(index));
+                });
+            }
+            default:
+                name = "set_text_content()";
+                return run([&] { version.set_text_content(path, text); }, [&] {
+                    auto &node = find(model, path);
+                    if (node.type() == XML::DOM::Node::Type::DOCUMENT_NODE)
+                        throw XML::DOMError("Cannot set text content of the document node");
+                    node.set_text_content(text);
+                });
+        }
+    }
+
+private:
+    template<class V, class M>
+    std::pair<Outcome, Outcome> run(V edit_version, M edit_model)
+    {
+        // only the kind of error is compared, messages are worded differently
+        auto kind = [](Outcome outcome) {
+            outcome.text = outcome.text.substr(0, outcome.text.find(':'));
+            return outcome;
+        };
+        return {kind(outcome([&] { edit_version(); return std::string(); })),
+                kind(outcome([&] { edit_model(); return std::string(); }))};
+    }
+
+    /// Returns path to a random node, sometimes one past the last child
+    Path pick()
+    {
+        Path path;
+        auto node = &version.document();
+        while (node->child_count() and random() % 3) {
+            auto index = random() % (node->child_count() + (random() % 8 == 0));
+            path.push_back(index);
+            if (index == node->child_count())
+                break;
+            node = &node->child_at(index);
+        }
+        return path;
+    }
+
+    /// Returns a new node or a subtree of the version, which is then shared
+    XML::PersistentNode::Ptr subtree()
+    {
+        auto text = texts[random() % std::size(texts)];
+        switch (random() % 6) {
+            case 0:
+                return XML::PersistentNode::text(text);
+            case 1:
+                return XML::PersistentNode::cdata_section("a < b");
+            case 2:
+                return XML::PersistentNode::comment("note");
+            case 3: {
+                auto path = pick();
+                if (not path.empty() and version.node(path)) {
+                    auto index = path.back();
+                    path.pop_back();
+                    return version.node(path)->child(index);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        auto name = names[random() % std::size(names)];
+        return XML::PersistentNode::element(name, {{"id", std::to_string(random() % 100)}});
+    }
+
+    const std::string attributes[4] = {"id", "at0", "x:y", "1bad"};
+    const std::string texts[5] = {"", "plain", "a < b & c", "two -- hyphens", " "};
+
+    std::mt19937 &random;
+    XML::PersistentDocument &version;
+    XML::DOM::Document &model;
+};
+
+/// Edits a version of a document and a DOM model of it, comparing them after each edit, then checks
+/// that the copies taken before and the undo history still have what they had
+void check_persistent(const std::string &input, size_t edits, std::mt19937 &random)
+{
+    auto model = XML::Parser().parse(input);
+    XML::PersistentDocument version(model);
+    expect("PersistentDocument(document)", input, {true, describe(model)}, {true, describe(version)});
+
+    XML::DocumentHistory history(version);
+    std::vector<std::pair<XML::PersistentDocument, std::string>> versions{{version, describe(version)}};
+    Editor editor(random, version, model);
+    for (size_t i = 0; i < edits; i++) {
+        std::string name;
+        auto [edited, modeled] = editor.edit(name);
+        expect("PersistentDocument::" + name + " result", input, modeled, edited);
+        expect("PersistentDocument::" + name, input, {true, describe(model)}, {true, describe(version)});
+        if (edited.ok) {
+            history.commit(version);
+            versions.emplace_back(version, describe(version));
+        }
+    }
+    expect("PersistentDocument::to_document()", input, {true, describe(model)},
+           {true, describe(version.to_document())});
+
+    for (auto &[copy, description] : versions)
+        expect("PersistentDocument copy", input, {true, description}, {true, describe(copy)});
+
+    // back to the first version and forward again
+    for (size_t i = versions.size() - 1; i > 0; i--) {
+        history.undo();
+        expect("DocumentHistory::undo()", input, {true, versions[i - 1].second}, {true, describe(history.current())});
+    }
+    for (size_t i = 1; i < versions.size(); i++) {
+        history.redo();
+        expect("DocumentHistory::redo()", input, {true, versions[i].second}, {true, describe(history.current())});
+    }
+    auto steps = [](bool undo, bool redo) {
+        return Outcome{true, std::string("can_undo ") + (undo ? "1" : "0") + ", can_redo " + (redo ? "1" : "0")};
+    };
+    expect("DocumentHistory steps", input, steps(versions.size() > 1, false),
+           steps(history.can_undo(), history.can_redo()));
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    unsigned seed = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1;
+
+    std::vector<std::string> seeds;
+    for (int i = 3; i < argc; i++) {
+        std::ifstream file(argv[i], std::ios::binary);
+        if (not file) {
+            std::cerr << "Cannot read " << argv[i] << std::endl;
+            return 2;
+        }
+        std::stringstream content;
+        content << file.rdbuf();
+        seeds.push_back(content.str());
+    }
+
+    std::mt19937 random(seed);
+    Generator generator(random);
+    check_parallel(random);
+    check_deep_lazy();
+    check_tag_index_neighbours();
+    check_snapshot_comment();
+    size_t accepted = 0;
+    for (auto &input : seeds)
+        accepted += check(input, random);
+    for (size_t i = 0; i < iterations; i++) {
+        // generated documents, half of them mutated, and mutated copies of the files
+        std::string input;
+        if (not seeds.empty() and random() % 4 == 0)
+            input = mutate(seeds[random() % seeds.size()], random);
+        else
+            input = random() % 2 ? generator.document() : mutate(generator.document(), random);
+        accepted += check(input, random);
+    }
+
+    // documents the parser accepts, as starting points for the edits
+    size_t documents = std::max<size_t>(iterations / 50, 1);
+    for (size_t i = 0; i < documents; i++) {
+        std::string input;
+        do {
+            input = random() % 2 ? generator.document() : mutate(generator.document(), random);
+        } while (XML::Parser().try_check(input));
+        check_persistent(input, 50, random);
+    }
+
+    std::cout << "inputs: " << seeds.size() + iterations << ", accepted: " << accepted
+              << ", edited documents: " << documents << ", mismatches: " << failures << std::endl;
+    return failures ? 1 : 0;
+}
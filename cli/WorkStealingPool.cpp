@@ -0,0 +1,135 @@
+#include <algorithm>
+#include "WorkStealingPool.hpp"
+
+namespace Cli
+{
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+        : count(threads ? threads : std::max(1u, std::thread::hardware_concurrency())), task(nullptr),
+          generation(0), busy(0), stopping(false)
+{
+    queues = std::make_unique<Queue[]>(count);
+    this->threads.reserve(count - 1);
+    for (size_t worker = 1; worker < count; worker++)
+        this->threads.emplace_back([this, worker] { work(worker); });
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+}
+
+size_t WorkStealingPool::size() const
+{
+    return count;
+}
+
+void WorkStealingPool::run(size_t count, const Task &task)
+{
+    if (count == 0)
+        return;
+
+    // the workers are idle between runs, so the queues can be filled without their locks
+    for (size_t worker = 0; worker < this->count; worker++) {
+        queues[worker].begin = count * worker / this->count;
+        queues[worker].end = count * (worker + 1) / this->count;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->task = &task;
+        busy = this->count - 1;
+        generation++;
+    }
+    wake.notify_all();
+
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this] { return busy == 0; });
+    this->task = nullptr;
+}
+
+void WorkStealingPool::work(size_t worker)
+{
+    size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping or generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        drain(worker);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+            done.notify_all();
+    }
+}
+
+void WorkStealingPool::drain(size_t worker)
+{
+    // tasks never add work, so once every queue is seen empty there is nothing left to steal
+    size_t index;
+    while (pop(worker, index) or (steal(worker) and pop(worker, index)))
+        (*task)(index, worker);
+}
+
+bool WorkStealingPool::pop(size_t worker, size_t &index)
+{
+    auto &queue = queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.begin == queue.end)
+        return false;
+    index = queue.begin++;
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t worker)
+{
+    while (true) {
+        // sizes change while scanning, the victim is checked again when its range is cut
+        size_t victim = worker;
+        size_t most = 0;
+        for (size_t other = 0; other < count; other++) {
+            if (other == worker)
+                continue;
+            std::lock_guard<std::mutex> lock(queues[other].mutex);
+            auto size = queues[other].end - queues[other].begin;
+            if (size > most) {
+                most = size;
+                victim = other;
+            }
+        }
+        if (victim == worker)
+            return false;
+
+        size_t begin, end;
+        {
+            std::lock_guard<std::mutex> lock(queues[victim].mutex);
+            auto &queue = queues[victim];
+            if (queue.begin == queue.end)
+                continue;
+            // the owner keeps the front, the thief takes the rest rounded up, so a single index is taken too
+            end = queue.end;
+            queue.end -= (queue.end - queue.begin + 1) / 2;
+            begin = queue.end;
+        }
+
+        std::lock_guard<std::mutex> lock(queues[worker].mutex);
+        queues[worker].begin = begin;
+        queues[worker].end = end;
+        return true;
+    }
+}
+
+} // namespace Cli
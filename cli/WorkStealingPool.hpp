@@ -0,0 +1,83 @@
+#ifndef CLI_WORKSTEALINGPOOL_HPP
+#define CLI_WORKSTEALINGPOOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Cli
+{
+
+/// Fixed set of threads running index ranges. Each worker owns a queue holding a range of indices, takes them
+/// one at a time from its front and, once it's empty, steals the back half of the fullest other queue, so
+/// workers that got cheap items help the ones stuck with expensive items
+class WorkStealingPool
+{
+public:
+    /// Task for one index, must not throw
+    /// \param index Index in [0, count)
+    /// \param worker Number of the worker running it, in [0, size())
+    using Task = std::function<void(size_t index, size_t worker)>;
+
+    /// Starts the workers
+    /// \param threads Number of workers including the thread calling run(), 0 for one per core
+    explicit WorkStealingPool(size_t threads = 0);
+
+    /// Stops and joins the workers
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /// Returns number of workers
+    /// \return Number of workers
+    size_t size() const;
+
+    /// Runs task for every index in [0, count) and returns when all of them are done.
+    /// The calling thread is worker 0
+    /// \param count Number of indices
+    /// \param task Task
+    void run(size_t count, const Task &task);
+
+private:
+    /// Indices [begin, end) left to a worker
+    struct Queue
+    {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    /// Waits for run() to hand out work, until the pool is destroyed
+    void work(size_t worker);
+
+    /// Runs tasks from the workers own queue and stolen ones until every queue is empty
+    void drain(size_t worker);
+
+    /// Takes the next index of the workers own queue
+    bool pop(size_t worker, size_t &index);
+
+    /// Moves the back half of the fullest other queue to the workers own queue
+    bool steal(size_t worker);
+
+    std::unique_ptr<Queue[]> queues;
+    size_t count;
+    std::vector<std::thread> threads;
+
+    // run() state, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    const Task *task;
+    size_t generation;
+    size_t busy;
+    bool stopping;
+};
+
+} // namespace Cli
+
+#endif //CLI_WORKSTEALINGPOOL_HPP
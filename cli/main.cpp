@@ -0,0 +1,443 @@
+// Checks, parses or reformats many XML files on all cores without Qt.
+//
+// Usage: olive [options] <file or directory>...
+//
+// Directories are searched recursively for files with the extension given by --extension. Every file gets
+// a status line, errors are reported as path:line:column: message. The totals at the end have the throughput
+// and the median and 99th percentile time per file. The exit status is 0 if every file is well-formed,
+// 1 if some are not or can't be read or written, 2 on bad usage.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.hpp"
+#include "Parser.hpp"
+#include "Serializer.hpp"
+#include "WorkStealingPool.hpp"
+
+namespace
+{
+
+namespace fs = std::filesystem;
+using clock = std::chrono::steady_clock;
+
+const char usage[] =
+    "Usage: olive [options] <file or directory>...\n"
+    "\n"
+    "Modes:\n"
+    "  --check             check that files are well-formed (default)\n"
+    "  --parse             also build every document\n"
+    "  --pretty[=N]        reformat documents indented by N spaces (4 by default)\n"
+    "  --minify            reformat documents without line breaks and indentation\n"
+    "\n"
+    "Options:\n"
+    "  --output DIR        write reformatted documents under DIR, keeping paths relative to the arguments\n"
+    "  --in-place          replace input files with reformatted documents\n"
+    "                      (without either, a single reformatted document is written to stdout)\n"
+    "  --files-from FILE   read more paths from FILE, one per line, - for stdin\n"
+    "  --extension EXT     extension of files taken from directories (.xml by default)\n"
+    "  --threads N         number of threads, 0 for one per core (default)\n"
+    "  --engine NAME       lexer or index (see XML::Parser::Engine), index by default\n"
+    "  --max-depth N       maximum element nesting\n"
+    "  --quiet             print only failures and totals\n"
+    "  --help              print this help\n";
+
+enum class Mode
+{
+    CHECK,
+    PARSE,
+    PRETTY,
+    MINIFY
+};
+
+struct Options
+{
+    Mode mode = Mode::CHECK;
+    size_t tab_size = 4;
+    std::string output;
+    bool in_place = false;
+    std::string extension = ".xml";
+    size_t threads = 0;
+    XML::Parser::Engine engine = XML::Parser::Engine::STRUCTURAL_INDEX;
+    size_t max_depth = XML::Parser::default_max_depth;
+    bool quiet = false;
+    std::vector<std::string> paths;
+    std::vector<std::string> lists;
+};
+
+struct Input
+{
+    std::string path;
+    // path under --output
+    std::string relative;
+};
+
+/// Outcome of one file, written by the worker that processed it
+struct Status
+{
+    bool ok = false;
+    size_t bytes = 0;
+    double seconds = 0;
+};
+
+class UsageError : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+size_t parse_number(const std::string &option, const std::string &value)
+{
+    char *end = nullptr;
+    auto number = std::strtoull(value.c_str(), &end, 10);
+    if (value.empty() or *end)
+        throw UsageError("Invalid number for " + option + ": " + value);
+    return number;
+}
+
+Options parse_options(int argc, char *argv[])
+{
+    Options options;
+    bool paths_only = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw UsageError("Missing value for " + arg);
+            return argv[++i];
+        };
+
+        if (paths_only or arg.empty() or arg[0] != '-' or arg == "-") {
+            options.paths.push_back(arg);
+        } else if (arg == "--") {
+            paths_only = true;
+        } else if (arg == "--check") {
+            options.mode = Mode::CHECK;
+        } else if (arg == "--parse") {
+            options.mode = Mode::PARSE;
+        } else if (arg == "--pretty") {
+            options.mode = Mode::PRETTY;
+        } else if (arg.rfind("--pretty=", 0) == 0) {
+            options.mode = Mode::PRETTY;
+            options.tab_size = parse_number("--pretty", arg.substr(9));
+        } else if (arg == "--minify") {
+            options.mode = Mode::MINIFY;
+        } else if (arg == "--output") {
+            options.output = value();
+        } else if (arg == "--in-place") {
+            options.in_place = true;
+        } else if (arg == "--files-from") {
+            options.lists.push_back(value());
+        } else if (arg == "--extension") {
+            options.extension = value();
+            if (not options.extension.empty() and options.extension[0] != '.')
+                options.extension.insert(0, ".");
+        } else if (arg == "--threads") {
+            options.threads = parse_number(arg, value());
+        } else if (arg == "--engine") {
+            auto engine = value();
+            if (engine == "lexer")
+                options.engine = XML::Parser::Engine::LEXER;
+            else if (engine == "index")
+                options.engine = XML::Parser::Engine::STRUCTURAL_INDEX;
+            else
+                throw UsageError("Unknown engine: " + engine);
+        } else if (arg == "--max-depth") {
+            options.max_depth = parse_number(arg, value());
+        } else if (arg == "--quiet") {
+            options.quiet = true;
+        } else if (arg == "--help") {
+            std::cout << usage;
+            std::exit(0);
+        } else {
+            throw UsageError("Unknown option: " + arg);
+        }
+    }
+
+    if (not options.output.empty() and options.in_place)
+        throw UsageError("--output and --in-place can't be used together");
+    if ((not options.output.empty() or options.in_place) and
+        options.mode != Mode::PRETTY and options.mode != Mode::MINIFY)
+        throw UsageError("--output and --in-place need --pretty or --minify");
+    return options;
+}
+
+/// Adds path, or the files under it if it's a directory
+void collect(const std::string &path, const Options &options, std::vector<Input> &inputs)
+{
+    std::error_code error;
+    if (not fs::is_directory(path, error)) {
+        // missing files are reported with the others
+        inputs.push_back({path, fs::path(path).filename().string()});
+        return;
+    }
+
+    std::vector<Input> found;
+    fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied, error), end;
+    for (; not error and it != end; it.increment(error)) {
+        std::error_code file_error;
+        if (it->is_regular_file(file_error) and it->path().extension() == options.extension)
+            found.push_back({it->path().string(), it->path().lexically_relative(path).string()});
+    }
+    if (error)
+        std::cerr << "Cannot read directory " << path << ": " << error.message() << std::endl;
+
+    // directory order is arbitrary, sorted paths make runs comparable
+    std::sort(found.begin(), found.end(), [](auto &a, auto &b) { return a.path < b.path; });
+    inputs.insert(inputs.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+}
+
+void collect_list(const std::string &list, const Options &options, std::vector<Input> &inputs)
+{
+    std::ifstream file;
+    if (list != "-") {
+        file.open(list);
+        if (not file)
+            throw UsageError("Cannot open " + list);
+    }
+    auto &in = list == "-" ? std::cin : file;
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (not line.empty() and line.back() == '\r')
+            line.pop_back();
+        if (not line.empty())
+            collect(line, options, inputs);
+    }
+}
+
+/// Throws UsageError if two inputs would be written to the same file, e.g. a/x.xml and b/x.xml under --output
+void check_targets(const std::vector<Input> &inputs, const Options &options)
+{
+    if (options.output.empty() and not options.in_place)
+        return;
+
+    std::vector<std::string> targets;
+    targets.reserve(inputs.size());
+    for (auto &input : inputs)
+        targets.push_back(fs::path(options.in_place ? input.path : input.relative).lexically_normal().string());
+    std::sort(targets.begin(), targets.end());
+
+    auto duplicate = std::adjacent_find(targets.begin(), targets.end());
+    if (duplicate != targets.end())
+        throw UsageError("Several inputs would be written to " +
+                         (options.in_place ? *duplicate : (fs::path(options.output) / *duplicate).string()));
+}
+
+/// Turns a byte offset into a 1-based line and column
+std::string location(std::string_view input, size_t offset)
+{
+    offset = std::min(offset, input.size());
+    auto line = std::count(input.begin(), input.begin() + offset, '\n') + 1;
+    auto line_begin = offset ? input.rfind('\n', offset - 1) : std::string_view::npos;
+    auto column = offset - (line_begin == std::string_view::npos ? 0 : line_begin + 1) + 1;
+    return std::to_string(line) + ":" + std::to_string(column);
+}
+
+/// Writes document to path through a temporary file renamed over it, so a reader never sees half of it
+/// and an input file that is still mapped keeps its old content. A file that is replaced keeps its permissions
+/// \param worker Index of the calling worker, part of the temporary name so workers never share one
+void write_file(const XML::DOM::Document &document, const Options &options, const std::string &path, size_t worker)
+{
+    auto target = fs::path(path);
+    if (target.has_parent_path())
+        fs::create_directories(target.parent_path());
+
+    auto temporary = path + ".olive-tmp" + std::to_string(worker);
+#ifdef _WIN32
+    int fd = ::_open(temporary.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, 0644);
+#else
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+    if (fd < 0)
+        throw XML::IOError("Cannot open file " + temporary);
+
+    // errors of delayed writes (ENOSPC, NFS) may only be reported by close(), the file is not renamed then
+    auto close_file = [&] {
+#ifdef _WIN32
+        return ::_close(fd) == 0;
+#else
+        return ::close(fd) == 0;
+#endif
+    };
+    try {
+#ifndef _WIN32
+        struct stat original;
+        if (::stat(path.c_str(), &original) == 0 and ::fchmod(fd, original.st_mode & 07777) != 0)
+            throw XML::IOError("Cannot set permissions of file " + temporary);
+#endif
+        XML::FileDescriptorSink sink(fd);
+        XML::Serializer serializer(sink, options.tab_size);
+        serializer.set_minified(options.mode == Mode::MINIFY);
+        serializer.write(document);
+        sink.flush();
+    } catch (...) {
+        close_file();
+        fs::remove(temporary);
+        throw;
+    }
+    if (not close_file()) {
+        fs::remove(temporary);
+        throw XML::IOError("Cannot write file " + temporary);
+    }
+    fs::rename(temporary, target);
+}
+
+void write_stdout(const XML::DOM::Document &document, const Options &options)
+{
+    XML::FileDescriptorSink sink(1);
+    XML::Serializer serializer(sink, options.tab_size);
+    serializer.set_minified(options.mode == Mode::MINIFY);
+    serializer.write(document);
+    sink.flush();
+}
+
+/// Check whether documents are written to stdout
+bool reformats_to_stdout(const Options &options)
+{
+    return (options.mode == Mode::PRETTY or options.mode == Mode::MINIFY) and
+           options.output.empty() and not options.in_place;
+}
+
+/// Processes one file
+/// \param worker Index of the calling worker
+/// \param message Set to the error if the file fails, starting with its location if it's a syntax error
+/// \return True if the file is well-formed and its output was written
+bool process(const Input &input, const Options &options, XML::Parser &parser, size_t worker, size_t &bytes,
+             std::string &message)
+{
+    try {
+        XML::MappedFile file(input.path);
+        auto view = file.view();
+        bytes = view.size();
+
+        XML::ParseError error;
+        if (options.mode == Mode::CHECK) {
+            error = parser.try_check(view);
+        } else {
+            auto result = parser.try_parse(view);
+            error = result.error;
+            if (not error and options.mode != Mode::PARSE) {
+                if (options.in_place)
+                    write_file(result.document, options, input.path, worker);
+                else if (not options.output.empty())
+                    write_file(result.document, options, (fs::path(options.output) / input.relative).string(), worker);
+                else
+                    write_stdout(result.document, options);
+            }
+        }
+
+        if (error) {
+            message = location(view, error.offset) + ": " + error.message();
+            return false;
+        }
+        return true;
+    } catch (std::exception &e) {
+        message = std::string(" ") + e.what();
+        return false;
+    }
+}
+
+/// Returns the value below which the given share of sorted latencies lies
+double percentile(const std::vector<double> &sorted, double share)
+{
+    if (sorted.empty())
+        return 0;
+    auto rank = static_cast<size_t>(share * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    std::vector<Input> inputs;
+    try {
+        options = parse_options(argc, argv);
+        for (auto &path : options.paths)
+            collect(path, options, inputs);
+        for (auto &list : options.lists)
+            collect_list(list, options, inputs);
+        if (inputs.empty())
+            throw UsageError("No input files");
+        if (reformats_to_stdout(options) and inputs.size() > 1)
+            throw UsageError("Reformatting several files needs --output or --in-place");
+        check_targets(inputs, options);
+    } catch (UsageError &e) {
+        std::cerr << e.what() << "\n\n" << usage;
+        return 2;
+    }
+
+    // with a document on stdout the report goes to stderr
+    auto &report = reformats_to_stdout(options) ? std::cerr : std::cout;
+
+    // one parser per worker, so their buffers are reused from file to file
+    Cli::WorkStealingPool pool(options.threads);
+    std::vector<XML::Parser> parsers;
+    parsers.reserve(pool.size());
+    for (size_t worker = 0; worker < pool.size(); worker++) {
+        parsers.emplace_back(options.max_depth);
+        parsers.back().set_engine(options.engine);
+    }
+    std::vector<Status> statuses(inputs.size());
+    std::mutex report_mutex;
+
+    auto start = clock::now();
+    pool.run(inputs.size(), [&](size_t index, size_t worker) {
+        auto &input = inputs[index];
+        auto &status = statuses[index];
+        std::string message;
+
+        auto file_start = clock::now();
+        status.ok = process(input, options, parsers[worker], worker, status.bytes, message);
+        status.seconds = std::chrono::duration<double>(clock::now() - file_start).count();
+
+        if (status.ok and options.quiet)
+            return;
+        std::ostringstream line;
+        if (status.ok)
+            line << "ok    " << input.path << " (" << status.bytes << " bytes, " << status.seconds * 1e3 << " ms)\n";
+        else
+            line << "error " << input.path << ":" << message << "\n";
+        std::lock_guard<std::mutex> lock(report_mutex);
+        report << line.str();
+    });
+    auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+    size_t failed = 0, bytes = 0;
+    std::vector<double> latencies;
+    latencies.reserve(statuses.size());
+    for (auto &status : statuses) {
+        failed += not status.ok;
+        bytes += status.bytes;
+        latencies.push_back(status.seconds);
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    report << "files: " << inputs.size() << ", ok: " << inputs.size() - failed << ", failed: " << failed << "\n"
+           << "bytes: " << bytes << ", time: " << seconds << " s, threads: " << pool.size() << "\n"
+           << "throughput: " << bytes / seconds / 1e6 << " MB/s, " << inputs.size() / seconds << " files/s\n"
+           << "latency per file: p50 " << percentile(latencies, 0.5) * 1e3 << " ms, p99 "
+           << percentile(latencies, 0.99) * 1e3 << " ms, max " << latencies.back() * 1e3 << " ms" << std::endl;
+
+    return failed ? 1 : 0;
+}